@@ -110,6 +110,20 @@ struct AttributeFunctor
      */
     void doUpdateDistant(bool update) { _doUpdateDistant = update; }
 
+    /**
+     * \brief Get the version of the attribute, incremented each time it is successfully set.
+     * \return Returns the version.
+     */
+    uint64_t getVersion() const { return _version; }
+
+    /**
+     * \brief Check whether the attribute changed since its values were last sent to the distant object, and mark the given values as sent.
+     * Changes are detected through the version, and through the values as some getters reflect internal state.
+     * \param values Current values of the attribute.
+     * \return Returns true if the attribute changed since the last call.
+     */
+    bool updateDistantValues(const Values& values);
+
     /**
      * \brief Get the types of the wanted arguments.
      * \return Returns the expected types in a Values.
@@ -190,6 +204,10 @@ struct AttributeFunctor
 
     bool _isLocked{false};
 
+    std::atomic<uint64_t> _version{0}; //!< Incremented each time the attribute is set
+    uint64_t _distantVersion{0};       //!< Version last sent to the distant object
+    Values _distantValues{};           //!< Values last sent to the distant object
+
     bool _defaultSetAndGet{true};
     bool _doUpdateDistant{false}; // True if the World should send this attr values to Scenes
     bool _savable{true};          // True if this attribute should be saved
@@ -354,11 +372,12 @@ class BaseObject
     std::unordered_map<std::string, Values> getAttributes(bool includeDistant = false) const;
 
     /**
-     * \brief Get the map of the attributes which should be updated from World to Scene
+     * \brief Get the map of the attributes which should be updated from World to Scene, and which changed since the last call
      * \brief This is the case when the distant object is different from the World one
+     * \param all If true, returns all distant attributes even if they did not change
      * \return Returns a map of the distant attributes
      */
-    std::unordered_map<std::string, Values> getDistantAttributes() const;
+    std::unordered_map<std::string, Values> getDistantAttributes(bool all = false);
 
     /**
      * \brief Get the savability for this object
@@ -592,12 +611,24 @@ class BufferObject : public BaseObject
      */
     virtual std::string getDistantName() const { return _name; }
 
+    /**
+     * \brief Tell whether the buffer is small enough to be sent to Scenes connected through a limited bandwidth
+     * \return Return true by default
+     */
+    virtual bool fitsLimitedBandwidth() const { return true; }
+
     /**
      * \brief Get the timestamp for the current buffer object
      * \return Return the timestamp
      */
     int64_t getTimestamp() const { return _timestamp; }
 
+    /**
+     * \brief Get the index of the current buffer, incremented each time the buffer is updated
+     * \return Return the frame index
+     */
+    uint64_t getFrameId() const { return _frameId; }
+
     /**
      * \brief Serialize the object
      * \return Return a serialized representation of the object
@@ -611,7 +642,7 @@ class BufferObject : public BaseObject
     void setSerializedObject(std::shared_ptr<SerializedObject> obj);
 
     /**
-     * \brief Updates the timestamp of the object. Also, set the update flag to true.
+     * \brief Updates the timestamp and frame index of the object. Also, set the update flag to true.
      */
     void updateTimestamp();
 
@@ -620,6 +651,7 @@ class BufferObject : public BaseObject
     mutable Spinlock _writeMutex;                     //!< Write mutex locked when the object is written to
     std::atomic_bool _serializedObjectWaiting{false}; //!< True if a serialized object has been set and waits for processing
     int64_t _timestamp{0};                            //!< Timestamp
+    uint64_t _frameId{0};                             //!< Frame index, incremented along with the timestamp
     bool _updatedBuffer{false};                       //!< True if the BufferObject has been updated
 
     std::shared_ptr<SerializedObject> _serializedObject; //!< Internal buffer object
@@ -711,7 +743,7 @@ class RootObject : public BaseObject
     /**
      * \brief Signals that a BufferObject has been updated
      */
-    void signalBufferObjectUpdated();
+    virtual void signalBufferObjectUpdated();
 
   protected:
     std::string _configurationPath{""}; //!< Path to the configuration file
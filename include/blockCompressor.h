@@ -0,0 +1,117 @@
+/*
+ * Copyright (C) 2017 Emmanuel Durand
+ *
+ * This file is part of Splash.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Splash is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Splash.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * @blockCompressor.h
+ * The BlockCompressor class, compressing RGBA images to GPU block formats on the CPU
+ */
+
+#ifndef SPLASH_BLOCKCOMPRESSOR_H
+#define SPLASH_BLOCKCOMPRESSOR_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "config.h"
+
+#include "./imageBuffer.h"
+
+namespace Splash
+{
+
+/*************/
+//! Block compression of 8 bits RGBA images, to BC1 (RGB_DXT1), BC3 (RGBA_DXT5) or BC7 (RGBA_BC7, through mode 6 only).
+//! The resulting buffers follow the same layout as the Hap frames, so they are uploaded as is by Texture_Image.
+//! Compressed images can be cached on disk, keyed by the source path and its modification time.
+class BlockCompressor
+{
+  public:
+    enum class Codec
+    {
+        None,
+        BC1,
+        BC3,
+        BC7
+    };
+
+    /**
+     * \brief Get the codec from its name
+     * \param name Codec name, either "bc1", "bc3" or "bc7". Any other name gives Codec::None
+     * \return Return the codec
+     */
+    static Codec codecFromString(const std::string& name);
+
+    /**
+     * \brief Get the name of a codec
+     * \param codec Codec
+     * \return Return the codec name, or an empty string for Codec::None
+     */
+    static std::string codecToString(Codec codec);
+
+    /**
+     * \brief Compress an image, in parallel on the thread pool
+     * \param image 8 bits RGBA image, whose size must be a multiple of 4
+     * \param codec Codec to use
+     * \return Return the compressed image, or nullptr if the image can not be compressed
+     */
+    static std::unique_ptr<ImageBuffer> compress(const ImageBuffer& image, Codec codec);
+
+    /**
+     * \brief Compress a single block
+     * \param block 4x4 RGBA pixels, row by row
+     * \param output Compressed block, 8 bytes for BC1 and 16 bytes for BC3 and BC7
+     * \param codec Codec to use
+     */
+    static void compressBlock(const uint8_t* block, uint8_t* output, Codec codec);
+
+    /**
+     * \brief Load a compressed image from the cache
+     * \param filepath Path to the source image
+     * \param codec Codec used for the compression
+     * \return Return the compressed image, or nullptr if it is not in the cache or if the source changed since
+     */
+    static std::unique_ptr<ImageBuffer> loadFromCache(const std::string& filepath, Codec codec);
+
+    /**
+     * \brief Save a compressed image to the cache
+     * \param filepath Path to the source image
+     * \param codec Codec used for the compression
+     * \param image Compressed image
+     * \return Return true if the image has been saved
+     */
+    static bool saveToCache(const std::string& filepath, Codec codec, const ImageBuffer& image);
+
+  private:
+    /**
+     * \brief Get the path of the cache file for a given source, which changes with the modification time of the source
+     * \param filepath Path to the source image
+     * \param codec Codec used for the compression
+     * \return Return the cache file path, or an empty string if the source does not exist
+     */
+    static std::string getCachePath(const std::string& filepath, Codec codec);
+
+    static void compressBlockBC1(const uint8_t* block, uint8_t* output);
+    static void compressBlockBC3(const uint8_t* block, uint8_t* output);
+    static void compressBlockBC7(const uint8_t* block, uint8_t* output);
+};
+
+} // end of namespace
+
+#endif // SPLASH_BLOCKCOMPRESSOR_H
@@ -0,0 +1,188 @@
+/*
+ * Copyright (C) 2017 Emmanuel Durand
+ *
+ * This file is part of Splash.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Splash is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Splash.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * @bufferPool.h
+ * The BufferPool class, recycling big allocations
+ */
+
+#ifndef SPLASH_BUFFERPOOL_H
+#define SPLASH_BUFFERPOOL_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "config.h"
+
+namespace Splash
+{
+
+/*************/
+//! Pool of big memory blocks, sorted in size buckets.
+//! Released blocks are kept to be handed over to the next allocation of the same bucket, so that
+//! steady-state frame buffers do not go through the system allocator and do not page fault.
+//! Sizes are rounded up to a bucket size, in steps of 1/8th of their highest power of two.
+//! All blocks are aligned on 64 bytes. Blocks bigger than a huge page are mapped directly and can be backed by huge pages.
+class BufferPool
+{
+  public:
+    //! Huge pages policy for the biggest blocks
+    enum class HugePages : uint8_t
+    {
+        none,        //!< Regular pages
+        transparent, //!< Transparent huge pages, through madvise
+        reserved     //!< Pages from the reserved huge pages pool (MAP_HUGETLB), falling back to transparent huge pages
+    };
+
+    struct Stats
+    {
+        uint64_t hits{0};        //!< Allocations served from the pool
+        uint64_t misses{0};      //!< Allocations which needed a new block
+        uint64_t recycled{0};    //!< Blocks given back to the pool
+        uint64_t freed{0};       //!< Blocks given back to the system, the pool being full
+        uint64_t cachedBytes{0}; //!< Bytes currently held by the pool
+
+        /**
+         * \brief Get the ratio of allocations served from the pool
+         * \return Return the hit rate, between 0 and 1
+         */
+        double hitRate() const { return hits + misses == 0 ? 0.0 : static_cast<double>(hits) / static_cast<double>(hits + misses); }
+    };
+
+    /**
+     * \brief Get the singleton
+     * \return Return the pool
+     */
+    static BufferPool& get()
+    {
+        static auto instance = new BufferPool;
+        return *instance;
+    }
+
+    /**
+     * \brief Get the alignment of all allocated blocks
+     * \return Return the alignment in bytes
+     */
+    static size_t getAlignment();
+
+    /**
+     * \brief Tell whether an allocation of the given size goes through the pool
+     * \param size Size in bytes
+     * \return Return true if the size is big enough to be pooled
+     */
+    static bool isPooled(size_t size);
+
+    /**
+     * \brief Get the bucket size for the given size
+     * \param size Size in bytes
+     * \return Return the bucket size, which is the real size of the allocated block
+     */
+    static size_t getBucketSize(size_t size);
+
+    /**
+     * \brief Allocate a block, reusing a released one if possible. Small blocks are not pooled, but are still aligned.
+     * \param size Size in bytes
+     * \return Return a pointer to a block of at least getBucketSize(size) bytes, or nullptr if the allocation failed
+     */
+    void* allocate(size_t size);
+
+    /**
+     * \brief Give a block back to the pool
+     * \param ptr Pointer to the block, as returned by allocate
+     * \param size Size given to allocate
+     */
+    void release(void* ptr, size_t size);
+
+    /**
+     * \brief Free all blocks held by the pool
+     */
+    void clear();
+
+    /**
+     * \brief Get the pool statistics
+     * \return Return the statistics
+     */
+    Stats getStats() const;
+
+    /**
+     * \brief Set the maximum number of bytes held by the pool
+     * \param size Maximum size in bytes
+     */
+    void setMaxCachedBytes(uint64_t size);
+
+    /**
+     * \brief Set the huge pages policy, used for the next allocated blocks
+     * \param policy Huge pages policy
+     */
+    void setHugePages(HugePages policy) { _hugePages = policy; }
+
+    /**
+     * \brief Set the huge pages policy from its name
+     * \param policy Policy name, either "none", "transparent" or "reserved"
+     * \return Return false if the name is not valid
+     */
+    bool setHugePages(const std::string& policy);
+
+    /**
+     * \brief Get the huge pages policy
+     * \return Return the policy
+     */
+    HugePages getHugePages() const { return _hugePages; }
+
+    /**
+     * \brief Get the name of the huge pages policy
+     * \return Return the policy name
+     */
+    std::string getHugePagesName() const;
+
+  private:
+    BufferPool();
+    ~BufferPool() = default;
+    BufferPool(const BufferPool&) = delete;
+    BufferPool& operator=(const BufferPool&) = delete;
+
+    mutable std::mutex _mutex{};
+    std::map<size_t, std::vector<void*>> _buckets{}; //!< Released blocks, per bucket size
+    uint64_t _maxCachedBytes;
+    std::atomic<HugePages> _hugePages{HugePages::transparent};
+    Stats _stats{};
+
+    /**
+     * \brief Allocate a block from the system
+     * \param size Block size
+     * \return Return the block, or nullptr
+     */
+    void* allocateBlock(size_t size);
+
+    /**
+     * \brief Give a block back to the system
+     * \param ptr Block pointer
+     * \param size Block size, as given to allocateBlock
+     */
+    static void freeBlock(void* ptr, size_t size);
+};
+
+} // end of namespace
+
+#endif // SPLASH_BUFFERPOOL_H
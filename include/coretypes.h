@@ -40,6 +40,7 @@
 #include <cstring>
 #include <deque>
 #include <execinfo.h>
+#include <functional>
 #include <memory>
 #include <mutex>
 #include <ostream>
@@ -51,6 +52,7 @@
 #include <GLFW/glfw3.h>
 // clang-format on
 
+#include "./bufferPool.h"
 #include "./threadpool.h"
 
 #ifndef SPLASH_CORETYPES_H
@@ -101,6 +103,8 @@ template <typename T>
 class ResizableArray
 {
   public:
+    using Deleter = std::function<void(T*)>;
+
     /**
      * \brief Constructor
      */
@@ -130,10 +134,24 @@ class ResizableArray
 
         _size = static_cast<size_t>(end - start);
         _shift = 0;
-        _buffer = std::unique_ptr<T[]>(new T[_size]);
+        _buffer = allocate(_size);
         memcpy(_buffer.get(), start, _size * sizeof(T));
     }
 
+    /**
+     * \brief Constructor adopting an externally allocated buffer, without copying it.
+     * The deleter is called with the given pointer when the array releases it.
+     * \param data Pointer to the external buffer
+     * \param size Buffer size
+     * \param deleter Function called to release the buffer
+     */
+    ResizableArray(T* data, size_t size, const Deleter& deleter)
+        : _size(size)
+        , _shift(0)
+        , _buffer(data, deleter)
+    {
+    }
+
     /**
      * \brief Copy constructor
      * \param a ResizableArray to copy
@@ -142,7 +160,7 @@ class ResizableArray
     {
         _size = a.size();
         _shift = 0;
-        _buffer = std::unique_ptr<T[]>(new T[_size]);
+        _buffer = allocate(_size);
         memcpy(data(), a.data(), _size);
     }
 
@@ -168,7 +186,7 @@ class ResizableArray
 
         _size = a.size();
         _shift = 0;
-        _buffer = std::unique_ptr<T[]>(new T[_size]);
+        _buffer = allocate(_size);
         memcpy(data(), a.data(), _size);
 
         return *this;
@@ -228,11 +246,11 @@ class ResizableArray
      */
     inline void resize(size_t size)
     {
-        auto newBuffer = std::unique_ptr<T[]>(new T[size]);
+        auto newBuffer = allocate(size);
         if (size >= _size)
-            memcpy(newBuffer.get(), _buffer.get(), _size);
+            memcpy(newBuffer.get(), data(), _size);
         else
-            memcpy(newBuffer.get(), _buffer.get(), size);
+            memcpy(newBuffer.get(), data(), size);
 
         std::swap(_buffer, newBuffer);
         _size = size;
@@ -240,9 +258,28 @@ class ResizableArray
     }
 
   private:
-    size_t _size{0};                       //!< Buffer size
-    size_t _shift{0};                      //!< Buffer shift
-    std::unique_ptr<T[]> _buffer{nullptr}; //!< Pointer to the buffer data
+    size_t _size{0};                                //!< Buffer size
+    size_t _shift{0};                               //!< Buffer shift
+    std::unique_ptr<T[], Deleter> _buffer{nullptr}; //!< Pointer to the buffer data
+
+    /**
+     * \brief Allocate a buffer on the heap. Buffers of trivial types are left uninitialized and aligned on BufferPool::getAlignment() bytes,
+     * big ones are taken from the BufferPool and given back to it when released
+     * \param size Buffer size
+     * \return Return the buffer along with its deleter
+     */
+    static std::unique_ptr<T[], Deleter> allocate(size_t size)
+    {
+        auto byteSize = size * sizeof(T);
+        if (std::is_trivial<T>::value && byteSize != 0)
+        {
+            auto ptr = static_cast<T*>(BufferPool::get().allocate(byteSize));
+            if (ptr != nullptr)
+                return std::unique_ptr<T[], Deleter>(ptr, [byteSize](T* p) { BufferPool::get().release(p, byteSize); });
+        }
+
+        return std::unique_ptr<T[], Deleter>(new T[size], [](T* p) { delete[] p; });
+    }
 };
 
 /*************/
@@ -270,6 +307,15 @@ struct SerializedObject
     {
     }
 
+    /**
+     * \brief Constructor taking ownership of an existing buffer
+     * \param data Buffer to take ownership of
+     */
+    SerializedObject(ResizableArray<char>&& data)
+        : _data(std::move(data))
+    {
+    }
+
     /**
      * \brief Get the pointer to the data
      * \return Return a pointer to the data
@@ -0,0 +1,157 @@
+/*
+ * Copyright (C) 2017 Emmanuel Durand
+ *
+ * This file is part of Splash.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Splash is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Splash.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * @decodeScheduler.h
+ * The DecodeScheduler class, sharing a fixed set of decoding threads between all media sources
+ */
+
+#ifndef SPLASH_DECODESCHEDULER_H
+#define SPLASH_DECODESCHEDULER_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <map>
+#include <mutex>
+
+#include "config.h"
+
+namespace Splash
+{
+
+/*************/
+//! Process-wide decode scheduler.
+//! Sources register a step function, decoding a single packet, and a slack function giving how far ahead of its
+//! presentation time the source is buffered. Workers always run the source with the smallest slack.
+//! The scheduler also caps the total number of threads the codecs can use for frame threading.
+class DecodeScheduler
+{
+  public:
+    //! Slack value for a source which has nothing to decode for now
+    static constexpr int64_t idle = std::numeric_limits<int64_t>::max();
+
+    /**
+     * \brief Get the singleton
+     * \return Return the scheduler
+     */
+    static DecodeScheduler& get()
+    {
+        static auto instance = new DecodeScheduler;
+        return *instance;
+    }
+
+    /**
+     * \brief Register a source
+     * \param step Function decoding a bit of the source, returning false once the source is done
+     * \param slack Function returning the time the source can wait before being decoded again in us, or DecodeScheduler::idle
+     * \return Return the source id
+     */
+    uint32_t addSource(const std::function<bool()>& step, const std::function<int64_t()>& slack);
+
+    /**
+     * \brief Unregister a source, waiting for its current step to finish
+     * \param id Source id
+     */
+    void removeSource(uint32_t id);
+
+    /**
+     * \brief Wake up the workers, to be called when an idle source may have something to decode
+     */
+    void notify();
+
+    /**
+     * \brief Reserve threads for a codec, within the global budget
+     * \param wanted Number of threads the codec would like to use
+     * \return Return the number of threads granted, at least one
+     */
+    int acquireCodecThreads(int wanted);
+
+    /**
+     * \brief Give back threads reserved by acquireCodecThreads
+     * \param count Number of threads
+     */
+    void releaseCodecThreads(int count);
+
+    /**
+     * \brief Set the number of decoding workers
+     * \param count Number of workers
+     */
+    void setWorkerCount(unsigned int count);
+
+    /**
+     * \brief Get the number of decoding workers
+     * \return Return the number of workers
+     */
+    unsigned int getWorkerCount() const;
+
+    /**
+     * \brief Set the maximum number of threads shared by all codecs
+     * \param budget Number of threads
+     */
+    void setCodecThreadBudget(int budget);
+
+    /**
+     * \brief Get the maximum number of threads shared by all codecs
+     * \return Return the number of threads
+     */
+    int getCodecThreadBudget() const;
+
+  private:
+    struct Source
+    {
+        std::function<bool()> step{};
+        std::function<int64_t()> slack{};
+        bool running{false};
+        bool finished{false};
+    };
+
+    mutable std::mutex _mutex{};
+    std::condition_variable _workCondition{};
+    std::condition_variable _stepCondition{}; //!< Notified when a step ends
+    std::map<uint32_t, Source> _sources{};
+    uint32_t _nextSourceId{1};
+
+    unsigned int _workerCount;       //!< Requested number of workers
+    unsigned int _runningWorkers{0}; //!< Workers currently running, which are detached as the scheduler lives as long as the process
+    unsigned int _workersToStop{0};  //!< Workers asked to stop, after a decrease of the worker count
+
+    int _codecThreadBudget;
+    int _codecThreadsInUse{0};
+
+    DecodeScheduler();
+    ~DecodeScheduler() = default;
+    DecodeScheduler(const DecodeScheduler&) = delete;
+    DecodeScheduler& operator=(const DecodeScheduler&) = delete;
+
+    /**
+     * \brief Start workers until there are as many as requested. Must be called with _mutex locked
+     */
+    void startWorkers();
+
+    /**
+     * \brief Worker thread function
+     */
+    void workerLoop();
+};
+
+} // end of namespace
+
+#endif // SPLASH_DECODESCHEDULER_H
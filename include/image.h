@@ -25,12 +25,15 @@
 #ifndef SPLASH_IMAGE_H
 #define SPLASH_IMAGE_H
 
+#include <array>
 #include <chrono>
+#include <map>
 #include <mutex>
 
 #include "config.h"
 
 #include "basetypes.h"
+#include "blockCompressor.h"
 #include "coretypes.h"
 #include "imageBuffer.h"
 
@@ -99,6 +102,12 @@ class Image : public BufferObject
      */
     ImageBufferSpec getSpec() const;
 
+    /**
+     * \brief Tell whether the image is small enough to be sent to Scenes connected through a limited bandwidth
+     * \return Return true if the image is GPU-compressed, as when decoded from Hap
+     */
+    bool fitsLimitedBandwidth() const;
+
     /**
      * \brief Set the image from an ImageBuffer
      * \param img Image buffer
@@ -162,9 +171,36 @@ class Image : public BufferObject
     bool _benchmark{false};
     bool _worldObject{false};
 
+    // Regions of the image sampled by each Scene, as {x0, y0, x1, y1} in normalized coordinates
+    struct RegionOfInterest
+    {
+        std::array<float, 4> region{};
+        int64_t time{0}; //!< Time of the last refresh by the Scene, in us
+    };
+    mutable std::mutex _regionMutex{};
+    std::map<std::string, RegionOfInterest> _regionsOfInterest{};
+    bool _cropToRegion{true};
+
+    // Block compression of the still images, cached on disk
+    BlockCompressor::Codec _compression{BlockCompressor::Codec::None};
+    bool _compressionCache{true};
+
     void createDefaultImage(); //< Create a default black image
     void createPattern();      //< Create a default pattern
 
+    /**
+     * \brief Get the spec of the region of the image to transmit, which is the union of the regions sampled by the Scenes
+     * \param spec Spec of the whole image
+     * \return Return the spec of the region, or the given spec if the whole image has to be transmitted
+     */
+    ImageBufferSpec getRegionSpec(const ImageBufferSpec& spec) const;
+
+    /**
+     * \brief Get the union of the regions sampled by the Scenes. Must be called with _regionMutex locked
+     * \return Return the union as {x0, y0, x1, y1}, which is empty if no region is set
+     */
+    std::array<float, 4> getRegionsUnion() const;
+
     /**
      * \brief Read the specified image file
      * \param filename File path
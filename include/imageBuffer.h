@@ -26,8 +26,11 @@
 #define SPLASH_IMAGEBUFFER_H
 
 #include <chrono>
+#include <cstdint>
 #include <memory>
 #include <mutex>
+#include <string>
+#include <vector>
 
 #include "config.h"
 
@@ -48,6 +51,70 @@ class ImageBufferSpec
         FLOAT = 4
     };
 
+    //! Known pixel formats, so that they can be transmitted without their string form
+    enum class Format : uint8_t
+    {
+        Custom = 0, //!< Format not in this list, its name is given as a string
+        R,
+        RG,
+        RGB,
+        RGBA,
+        BGR,
+        BGRA,
+        YUYV,
+        UYVY,
+        RGB_DXT1,
+        RGBA_DXT5,
+        YCoCg_DXT5,
+        D,
+        YUV420P,   //!< Planar 4:2:0, 8 bits: Y plane, then U and V planes
+        YUV422P,   //!< Planar 4:2:2, 8 bits: Y plane, then U and V planes
+        NV12,      //!< Semi-planar 4:2:0, 8 bits: Y plane, then an interleaved UV plane
+        YUV420P10, //!< Planar 4:2:0, 10 bits stored in 16 bits little endian
+        YUV422P10, //!< Planar 4:2:2, 10 bits stored in 16 bits little endian
+        RGBA_BC7,  //!< BC7 compressed blocks, one byte per pixel
+        YUVJ420P,  //!< Same as YUV420P, with full range samples
+        YUVJ422P   //!< Same as YUV422P, with full range samples
+    };
+
+    //! Plane of an image, planar formats having one plane per component group
+    struct Plane
+    {
+        uint32_t width{0};
+        uint32_t height{0};
+        uint32_t channels{0}; //!< Samples per pixel in this plane
+        size_t offset{0};     //!< Offset of the plane from the start of the image data, in bytes
+        size_t size{0};       //!< Plane size, in bytes
+    };
+
+#pragma pack(push, 1)
+    //! Binary header prepended to serialized images, of a fixed size
+    struct FrameHeader
+    {
+        static const uint32_t MAGIC = 0x53504c49; // "SPLI"
+        static const uint16_t VERSION = 2;
+
+        uint32_t magic{MAGIC};
+        uint16_t version{VERSION};
+        uint16_t headerSize{0}; //!< Offset of the image data from the start of the header
+        uint32_t width{0};
+        uint32_t height{0};
+        uint32_t channels{0};
+        uint8_t bpp{0};
+        uint8_t type{0};
+        uint8_t format{0};     //!< Value of ImageBufferSpec::Format
+        uint8_t videoFrame{0};
+        int64_t timestamp{0};  //!< Timestamp of the image on the sender side, in us
+        uint64_t frameId{0};   //!< Index of the image on the sender side
+        char formatName[24]{}; //!< Format name, only set if format is Format::Custom
+        uint32_t regionX{0};   //!< Position of the transmitted region in the whole image
+        uint32_t regionY{0};
+        uint32_t fullWidth{0}; //!< Size of the whole image, 0 if the whole image is transmitted
+        uint32_t fullHeight{0};
+    };
+#pragma pack(pop)
+    static_assert(sizeof(FrameHeader) == 80, "ImageBufferSpec::FrameHeader must be 80 bytes long");
+
     /**
      * \brief Constructor
      */
@@ -101,6 +168,12 @@ class ImageBufferSpec
     std::string format{};
     bool videoFrame{true};
 
+    // Region of a larger image held by the buffer, when only the part sampled by the Scenes is transmitted
+    uint32_t regionX{0};
+    uint32_t regionY{0};
+    uint32_t fullWidth{0};  //!< Width of the whole image, 0 if the buffer holds the whole image
+    uint32_t fullHeight{0}; //!< Height of the whole image, 0 if the buffer holds the whole image
+
     inline bool operator==(const ImageBufferSpec& spec) const
     {
         if (width != spec.width)
@@ -115,6 +188,8 @@ class ImageBufferSpec
             return false;
         if (format != spec.format)
             return false;
+        if (regionX != spec.regionX || regionY != spec.regionY || fullWidth != spec.fullWidth || fullHeight != spec.fullHeight)
+            return false;
 
         return true;
     }
@@ -122,7 +197,7 @@ class ImageBufferSpec
     inline bool operator!=(const ImageBufferSpec& spec) const { return !(*this == spec); }
 
     /**
-     * \brief Convert the spec to a string
+     * \brief Convert the spec to a string, for debugging purposes
      * \return Return a string representation of the spec
      */
     std::string to_string();
@@ -133,17 +208,76 @@ class ImageBufferSpec
      */
     void from_string(const std::string& spec);
 
+    /**
+     * \brief Convert the spec to a binary frame header
+     * \param timestamp Timestamp of the frame
+     * \param frameId Index of the frame
+     * \return Return the header
+     */
+    FrameHeader toFrameHeader(int64_t timestamp, uint64_t frameId) const;
+
+    /**
+     * \brief Update from a binary frame header
+     * \param header Frame header
+     * \return Return false if the header is not valid
+     */
+    bool fromFrameHeader(const FrameHeader& header);
+
+    /**
+     * \brief Get the format enum matching a format name
+     * \param format Format name
+     * \return Return the format, or Format::Custom if unknown
+     */
+    static Format formatFromString(const std::string& format);
+
+    /**
+     * \brief Get the name of a format
+     * \param format Format
+     * \return Return the format name, or an empty string for Format::Custom
+     */
+    static std::string formatToString(Format format);
+
     /**
      * \brief Get channel size in bytes
      * \return Return channel size
      */
     int pixelBytes() const { return bpp / 8; }
 
+    /**
+     * \brief Check whether the format stores its components in separate planes
+     * \return Return true for planar and semi-planar formats
+     */
+    bool isPlanar() const;
+
+    /**
+     * \brief Check whether the format holds GPU compressed blocks
+     * \return Return true for DXT and BC7 formats
+     */
+    bool isCompressed() const;
+
+    /**
+     * \brief Check whether the format holds full range YUV samples, as opposed to the video range
+     * \return Return true for YUVJ formats
+     */
+    bool isFullRange() const;
+
+    /**
+     * \brief Get the planes of the image, tightly packed one after the other
+     * \return Return the planes, a single one for packed formats
+     */
+    std::vector<Plane> getPlanes() const;
+
     /**
      * \brief Get image size in bytes
      * \return Return image size
      */
-    int rawSize() const { return pixelBytes() * width * height; }
+    int rawSize() const;
+
+    /**
+     * \brief Check whether the buffer only holds a region of the image
+     * \return Return true if the image has been cropped
+     */
+    bool hasRegion() const { return fullWidth != 0 && fullHeight != 0; }
 };
 
 /*************/
@@ -161,6 +295,13 @@ class ImageBuffer
      */
     ImageBuffer(const ImageBufferSpec& spec);
 
+    /**
+     * \brief Constructor adopting the given buffer, whose size must match the spec
+     * \param spec Image spec
+     * \param buffer Buffer to use as inner buffer
+     */
+    ImageBuffer(const ImageBufferSpec& spec, ResizableArray<char>&& buffer);
+
     /**
      * \brief Destructor
      */
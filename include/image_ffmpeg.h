@@ -44,6 +44,8 @@ extern "C" {
 #include "./basetypes.h"
 #include "./coretypes.h"
 #include "./image.h"
+#include "./loopCache.h"
+#include "./videoIndex.h"
 #if HAVE_PORTAUDIO
 #include "./speaker.h"
 #endif
@@ -79,15 +81,47 @@ class Image_FFmpeg : public Image
     bool read(const std::string& filename);
 
   private:
-    std::thread _readLoopThread;
     std::atomic_bool _continueRead{false};
     std::atomic_bool _loopOnVideo{true};
 
+    // Decoding state, stepped by the DecodeScheduler workers
+    uint32_t _decodeSourceId{0};
+    AVCodecContext* _videoCodecContext{nullptr};
+    AVFrame* _frame{nullptr};
+    AVFrame* _rgbFrame{nullptr};
+    struct SwsContext* _swsContext{nullptr};
+    AVPacket _packet;
+    bool _isHap{false};
+    bool _newPass{true};
+    int _codecThreads{0};                      //!< Codec threads granted by the DecodeScheduler
+    std::atomic_bool _endOfFile{false};        //!< Set when the last packet has been read
+    std::atomic_bool _bufferFull{false};       //!< Set when the frame queue reached half of _maximumBufferSize
+    std::atomic<int64_t> _queuedUntil{0};      //!< Timing of the last queued frame, in us
+    std::atomic<int64_t> _queuedFrames{0};     //!< Frames waiting in _timedFrames
+    std::atomic<int64_t> _displayQueueSize{0}; //!< Frames waiting in the display loop
+
+    // Frame and keyframe index, used for frame-exact seeks
+    std::thread _indexThread{};
+    std::shared_ptr<const VideoIndex> _index{};
+    int64_t _seekTarget{-1};              //!< Timing of the frame targeted by the last seek, earlier frames being dropped, in us
+    std::atomic_bool _seekPending{false}; //!< Set until the first frame after a seek is queued, when timing in debug mode
+
+    // Loop cache, replacing the decoder once a whole pass has been recorded
+    std::atomic_bool _loopCache{false};
+    bool _loopCacheFailed{false};                         //!< Set if the clip does not fit in the cache budget
+    std::shared_ptr<LoopCache::Clip> _recording{};        //!< Pass being recorded
+    std::shared_ptr<const LoopCache::Clip> _cachedClip{}; //!< Cached clip, if any
+    size_t _cacheIndex{0};                                //!< Next cached frame to queue
+    size_t _cacheAudioIndex{0};                           //!< Next cached audio frame to queue
+    int64_t _loopOffset{0};                               //!< Offset added to the cached timings, increased at each pass
+    int64_t _frameDuration{0};                            //!< Duration of a frame according to the stream frame rate, in us
+
     std::thread _videoDisplayThread;
     struct TimedFrame
     {
         std::unique_ptr<ImageBuffer> frame{};
         int64_t timing{0ull}; // in us
+        int64_t offset{0};    // Loop offset included in the timing, in us
     };
     std::deque<TimedFrame> _timedFrames;
 
@@ -102,8 +136,8 @@ class Image_FFmpeg : public Image
     std::atomic_bool _timeJump{false};
 
     bool _intraOnly{false};
-    int64_t _startTime{0};
-    int64_t _currentTime{0};
+    std::atomic<int64_t> _startTime{0};
+    std::atomic<int64_t> _currentTime{0};
     int64_t _elapsedTime{0};
     float _shiftTime{0};
     float _seekTime{0};
@@ -120,6 +154,7 @@ class Image_FFmpeg : public Image
 
 #if HAVE_PORTAUDIO
     std::unique_ptr<Speaker> _speaker;
+    AVCodecContext* _audioCodecContext{nullptr};
     int _audioStreamIndex{-1};
     double _audioTimeBase{0.001};
     bool _planar{false};
@@ -143,6 +178,22 @@ class Image_FFmpeg : public Image
      */
     std::string tagToFourCC(unsigned int tag);
 
+    /**
+     * \brief Get the ImageBufferSpec format matching a decoded pixel format, if it can be handed to the GPU as is
+     * \param pixelFormat FFmpeg pixel format
+     * \param fullRange True if the samples use the full range, as for MJPEG
+     * \return Return the format name, or an empty string if the frame has to be converted on the CPU
+     */
+    static std::string getNativeFormat(int pixelFormat, bool fullRange);
+
+    /**
+     * \brief Copy the planes of a decoded frame to an image, without any conversion
+     * \param frame Decoded frame
+     * \param format Image format, as returned by getNativeFormat
+     * \return Return the image
+     */
+    static std::unique_ptr<ImageBuffer> copyNativeFrame(const AVFrame* frame, const std::string& format);
+
     /**
      * \brief Free everything related to FFmpeg
      */
@@ -154,9 +205,75 @@ class Image_FFmpeg : public Image
     void init();
 
     /**
-     * \brief File read loop
+     * \brief Build the index of the video stream, and save it next to the file
+     * \param filepath Path to the video file
+     * \param videoStreamIndex Index of the video stream in the file
+     */
+    void buildIndex(const std::string& filepath, int videoStreamIndex);
+
+    /**
+     * \brief Find the streams and open the decoders
+     * \return Return true if a video stream can be decoded
+     */
+    bool openDecoders();
+
+    /**
+     * \brief Close the decoders and free the frames
+     */
+    void closeDecoders();
+
+    /**
+     * \brief Read and decode a single packet, looping at the end of the file if needed
+     * \return Return false once there is nothing more to decode
+     */
+    bool decodeStep();
+
+    /**
+     * \brief Queue a frame for the display loop
+     * \param image Frame
+     * \param timing Frame timing, in us
+     * \param offset Loop offset to add to the timing, in us
+     */
+    void queueFrame(std::unique_ptr<ImageBuffer>&& image, int64_t timing, int64_t offset);
+
+    /**
+     * \brief Queue the next frame of the cached clip, looping without any gap
+     * \return Return true
+     */
+    bool cachedStep();
+
+    /**
+     * \brief Add a copy of a decoded frame to the pass being recorded. Must be called with _videoSeekMutex locked
+     * \param image Frame
+     * \param timing Frame timing, in us
+     */
+    void recordFrame(const ImageBuffer& image, int64_t timing);
+
+#if HAVE_PORTAUDIO
+    /**
+     * \brief Add a copy of a decoded audio frame to the pass being recorded. Must be called with _videoSeekMutex locked
+     * \param samples Audio samples
+     * \param timing Frame timing, in us
+     */
+    void recordAudioFrame(const ResizableArray<uint8_t>& samples, int64_t timing);
+#endif
+
+    /**
+     * \brief Move the recorded pass to the loop cache
+     * \return Return true if the clip is now cached
+     */
+    bool finishRecording();
+
+    /**
+     * \brief Drop the pass being recorded
+     */
+    void abortRecording();
+
+    /**
+     * \brief Get how long the decoding can wait before the display loop runs out of frames
+     * \return Return the slack in us, or DecodeScheduler::idle
      */
-    void readLoop();
+    int64_t getDecodeSlack() const;
 
     /**
      * \brief Seek in the video
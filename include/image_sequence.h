@@ -0,0 +1,149 @@
+/*
+ * Copyright (C) 2017 Emmanuel Durand
+ *
+ * This file is part of Splash.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Splash is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Splash.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * @image_sequence.h
+ * The Image_Sequence class, playing numbered image files at a given framerate
+ */
+
+#ifndef SPLASH_IMAGE_SEQUENCE_H
+#define SPLASH_IMAGE_SEQUENCE_H
+
+#include <atomic>
+#include <future>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "config.h"
+
+#include "./basetypes.h"
+#include "./coretypes.h"
+#include "./image.h"
+
+namespace Splash
+{
+
+/*************/
+//! Image sequence player.
+//! The file attribute is either a directory, a printf-like pattern (i.e. "shot_%05d.dpx") or any file of the sequence.
+//! The frames following the current one are decoded ahead of time on the thread pool, PNG, TGA, JPEG and BMP being read
+//! through stb_image and DPX with a dedicated reader. All frames are converted to 8 bits RGBA.
+class Image_Sequence : public Image
+{
+  public:
+    /**
+     * \brief Constructor
+     * \param root Root object
+     */
+    Image_Sequence(std::weak_ptr<RootObject> root);
+
+    /**
+     * \brief Destructor
+     */
+    ~Image_Sequence();
+
+    /**
+     * No copy constructor
+     */
+    Image_Sequence(const Image_Sequence&) = delete;
+    Image_Sequence& operator=(const Image_Sequence&) = delete;
+
+    /**
+     * \brief Set the sequence to read from
+     * \param filename Directory, pattern or file of the sequence
+     * \return Return true if at least one frame has been found
+     */
+    bool read(const std::string& filename);
+
+    /**
+     * \brief Find the frames of a sequence
+     * \param filepath Directory, pattern or file of the sequence
+     * \return Return the paths of the frames, in playback order
+     */
+    static std::vector<std::string> findFrames(const std::string& filepath);
+
+    /**
+     * \brief Decode a single frame
+     * \param filepath Frame path
+     * \return Return the image, or nullptr if the file could not be decoded
+     */
+    static std::unique_ptr<ImageBuffer> decodeFrame(const std::string& filepath);
+
+  private:
+    //! Decoding statistics, shared with the decoding tasks which may outlive a sequence
+    struct DecodeStats
+    {
+        std::atomic<int64_t> frames{0}; //!< Decoded frames
+        std::atomic<int64_t> time{0};   //!< Total decoding time, in us
+    };
+
+    std::vector<std::string> _frames{};
+    std::thread _playbackThread{};
+    std::atomic_bool _continuePlayback{false};
+
+    std::map<int64_t, std::future<std::unique_ptr<ImageBuffer>>> _prefetched{}; //!< Frames being decoded, per index
+    std::shared_ptr<DecodeStats> _stats{std::make_shared<DecodeStats>()};
+    std::atomic<int64_t> _underruns{0};  //!< Frames which were not decoded in time
+    std::atomic<float> _decodeRate{0.f}; //!< Decoded frames per second, over the last second
+    std::atomic<float> _decodeTime{0.f}; //!< Mean decoding time of a frame, in ms
+
+    std::atomic<float> _framerate{25.f};
+    std::atomic_int _prefetchCount{8};
+    std::atomic_bool _loop{true};
+    std::atomic_bool _paused{false};
+
+    std::atomic<int64_t> _startTime{0};   //!< Time at which the first frame was (or would have been) shown, in us
+    std::atomic<int64_t> _currentTime{0}; //!< Playback position, in us
+    float _shiftTime{0};
+    float _seekTime{0};
+    bool _useClock{false};
+
+    /**
+     * \brief Base init for the class
+     */
+    void init();
+
+    /**
+     * \brief Stop the playback and drop the prefetched frames
+     */
+    void stop();
+
+    /**
+     * \brief Playback loop, following the local or master clock and keeping the prefetch window filled
+     */
+    void playbackLoop();
+
+    /**
+     * \brief Read a DPX file
+     * \param filepath File path
+     * \return Return the image, or nullptr if the file is not a supported DPX
+     */
+    static std::unique_ptr<ImageBuffer> readDPX(const std::string& filepath);
+
+    /**
+     * \brief Register new functors to modify attributes
+     */
+    void registerAttributes();
+};
+
+} // end of namespace
+
+#endif // SPLASH_IMAGE_SEQUENCE_H
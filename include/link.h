@@ -27,9 +27,11 @@
 
 #include <atomic>
 #include <chrono>
+#include <condition_variable>
 #include <deque>
 #include <map>
 #include <mutex>
+#include <set>
 #include <string>
 #include <thread>
 #include <vector>
@@ -37,6 +39,7 @@
 
 #include "config.h"
 #include "coretypes.h"
+#include "sharedMemoryRing.h"
 
 namespace Splash
 {
@@ -48,12 +51,29 @@ class BufferObject;
 class Link
 {
   public:
+    //! Statistics of the buffers sent to an outer peer
+    struct BufferStats
+    {
+        uint64_t sent{0};       //!< Buffers sent
+        uint64_t superseded{0}; //!< Buffers replaced by a newer one before being sent
+        uint64_t dropped{0};    //!< Buffers discarded because of a failed send, an unsubscription or a disconnection
+    };
+
+    //! Compression applied to the buffers sent to a remote peer
+    enum class BufferCompression : uint8_t
+    {
+        none = 0,   //!< Buffers are sent as is
+        snappy = 1, //!< Buffers are compressed with Snappy
+        hap = 2     //!< Only buffers fitting a limited bandwidth are sent (i.e. DXT from Hap), compressed with Snappy as in the original Hap stream
+    };
+
     /**
      * \brief Constructor
      * \param root Root object
      * \param name Name of the link
+     * \param tcpPort If not zero, also listen to remote peers on this TCP port for messages, and on the next one for buffers
      */
-    Link(std::weak_ptr<RootObject> root, std::string name);
+    Link(std::weak_ptr<RootObject> root, std::string name, int tcpPort = 0);
 
     /**
      * \brief Destructor
@@ -66,6 +86,15 @@ class Link
      */
     void connectTo(const std::string& name);
 
+    /**
+     * \brief Connect to a pair running on another host, through TCP
+     * \param name Peer name
+     * \param address Host address of the peer
+     * \param port TCP port the peer listens to for messages, buffers being sent to the next one
+     * \param compression Compression applied to the buffers sent to this peer
+     */
+    void connectTo(const std::string& name, const std::string& address, int port, BufferCompression compression = BufferCompression::snappy);
+
     /**
      * \brief Connect to a pair given its name and a shared_ptr, useful when the peer is an object of _root
      * \param name Peer name
@@ -83,8 +112,9 @@ class Link
      * \brief Send a buffer to the connected peers
      * \param name Buffer name
      * \param buffer Serialized buffer
+     * \param fitsLimitedBandwidth If false, the buffer is not sent to peers using BufferCompression::hap
      */
-    bool sendBuffer(const std::string& name, std::shared_ptr<SerializedObject> buffer);
+    bool sendBuffer(const std::string& name, std::shared_ptr<SerializedObject> buffer, bool fitsLimitedBandwidth = true);
 
     /**
      * \brief Send a buffer to the connected peers
@@ -112,6 +142,55 @@ class Link
     template <typename T>
     bool sendMessage(const std::string& name, const std::string& attribute, const std::vector<T>& message);
 
+    /**
+     * \brief Queue the messages sent to other processes from now on, until stopMessageBatch is called
+     */
+    void startMessageBatch();
+
+    /**
+     * \brief Send all queued messages to other processes as a single ZMQ message, and keep queuing the next ones
+     * \return Return true if all went well
+     */
+    bool flushMessageBatch();
+
+    /**
+     * \brief Send all queued messages to other processes, and stop queuing them
+     * \return Return true if all went well
+     */
+    bool stopMessageBatch();
+
+    /**
+     * \brief Enable or disable the shared memory transport for buffers sent to other processes
+     * \param enable If true, buffers are written once in shared memory and only their descriptors go through the socket
+     */
+    void setSharedMemoryTransport(bool enable) { _useSharedMemory = enable; }
+
+    /**
+     * \brief Only receive the buffers with the given names. By default, all buffers are received.
+     * The subscriptions are applied by the buffer input thread, and forwarded to the sending peers which drop unneeded buffers.
+     * \param names Names of the buffers to receive
+     */
+    void setBufferSubscriptions(const std::set<std::string>& names);
+
+    /**
+     * \brief Check whether a buffer is needed by any connected peer
+     * \param name Buffer name
+     * \return Return true if an inner peer is connected, or if an outer peer subscribed to this buffer
+     */
+    bool isBufferNeeded(const std::string& name);
+
+    /**
+     * \brief Get the buffers which got a new subscriber since the last call, which may need to be sent again
+     * \return Return the buffer names
+     */
+    std::vector<std::string> getNewBufferSubscriptions();
+
+    /**
+     * \brief Get the statistics of the buffers sent to each outer peer
+     * \return Return the statistics, per peer name
+     */
+    std::map<std::string, BufferStats> getBufferStats();
+
     /**
      * \brief Check that all buffers were sent to the client
      * \param maximumWait Maximum waiting time
@@ -120,11 +199,50 @@ class Link
     bool waitForBufferSending(std::chrono::milliseconds maximumWait);
 
   private:
+    //! Transport used for a buffer, sent right after the buffer name
+    enum class BufferTransport : uint8_t
+    {
+        inline_data = 0,
+        shared_memory = 1,
+        snappy = 2
+    };
+
+    //! Buffer output channel to an outer peer
+    struct BufferPeer
+    {
+        Link* link{nullptr};
+        std::string messageEndpoint{""};                                    //!< Endpoint the message socket is connected to for this peer
+        bool remote{false};                                                 //!< True if the peer is on another host
+        BufferCompression compression{BufferCompression::none};             //!< Compression of the buffers sent to a remote peer
+        std::shared_ptr<zmq::socket_t> socket{nullptr};                     //!< Output socket, nullptr once disconnected
+        std::set<std::string> subscriptions{};                              //!< Buffers the peer subscribed to, an empty name meaning all of them
+        std::map<std::string, std::shared_ptr<SerializedObject>> mailbox{}; //!< Latest buffer waiting to be sent, per name
+        std::map<std::string, int> inFlight{};                              //!< Number of buffers currently being sent, per name, protected by _otgMutex
+        BufferStats stats{};
+    };
+
+    //! Handle to a buffer being sent, given to ZMQ and released with the buffer
+    struct OutgoingBuffer
+    {
+        BufferPeer* peer;
+        std::string name;
+        std::shared_ptr<SerializedObject> buffer;
+        std::shared_ptr<SharedMemoryRing> ring{nullptr}; //!< Ring the buffer is a descriptor of, if sent through shared memory
+    };
+
+    //! Shared memory ring replaced by a larger one, kept until the descriptors sent from it are acknowledged
+    struct RetiredRing
+    {
+        std::shared_ptr<SharedMemoryRing> ring;
+        uint64_t sent{0};      //!< Number of descriptors sent from this ring
+        int64_t retireTime{0}; //!< Time at which the ring was replaced, in us
+    };
+
     std::weak_ptr<RootObject> _rootObject;
     std::string _name;
+    int _tcpPort{0};
     std::shared_ptr<zmq::context_t> _context;
     Spinlock _msgSendMutex;
-    Spinlock _bufferSendMutex;
 
     std::vector<std::string> _connectedTargets;
     std::map<std::string, std::weak_ptr<RootObject>> _connectedTargetPointers;
@@ -133,24 +251,156 @@ class Link
     bool _connectedToOuter{false};
 
     std::shared_ptr<zmq::socket_t> _socketBufferIn;
-    std::shared_ptr<zmq::socket_t> _socketBufferOut;
     std::shared_ptr<zmq::socket_t> _socketMessageIn;
     std::shared_ptr<zmq::socket_t> _socketMessageOut;
 
-    std::deque<std::shared_ptr<SerializedObject>> _otgBuffers;
-    Spinlock _otgMutex;
-    std::atomic_int _otgNumber{0};
+    std::vector<char> _messageBatch{}; //!< Encoded messages waiting to be sent
+    bool _batchMessages{false};        //!< If true, messages are queued until stopMessageBatch is called
+
+    std::map<std::string, std::unique_ptr<BufferPeer>> _bufferPeers; //!< Buffer output channels, per peer name. Never removed, as ZMQ may release buffers after a disconnection
+    std::mutex _bufferPeersMutex;                                     //!< Protects the peers and their sockets
+    std::atomic_bool _bufferOutRunning{true};
+    std::mutex _otgMutex;                         //!< Protects the buffers being sent, and the output thread wake up flag
+    std::condition_variable _bufferSentCondition; //!< Notified when a buffer is queued or released
+    bool _bufferOutWakeUp{false};                 //!< Set to wake up the output thread
+    std::atomic_int _otgNumber{0};                //!< Number of buffers being sent
+    std::atomic_int _mailboxNumber{0};            //!< Number of buffers waiting in the mailboxes
+
+    std::atomic_bool _useSharedMemory{true};                                        //!< If true, buffers are sent to other processes through shared memory
+    uint32_t _sharedMemoryRingIndex{0};                                             //!< Index used to name the next ring
+    std::map<std::string, std::shared_ptr<SharedMemoryRing>> _sharedMemoryRingsOut; //!< Rings written to, per buffer name
+    std::map<std::string, uint64_t> _sharedMemorySent;                              //!< Number of descriptors sent from the rings written to, per buffer name
+    std::vector<RetiredRing> _sharedMemoryRingsRetired;                             //!< Replaced rings, which the peers may still have to open
+    std::map<std::string, std::shared_ptr<SharedMemoryRing>> _sharedMemoryRingsIn;  //!< Rings mapped from peers, per buffer name
+
+    std::map<std::string, std::pair<std::shared_ptr<SerializedObject>, std::shared_ptr<SerializedObject>>> _sharedMemoryLastWrites; //!< Last buffer written, and its descriptor
+    std::map<std::string, std::pair<std::shared_ptr<SerializedObject>, std::shared_ptr<SerializedObject>>> _compressedLastWrites;   //!< Last buffer compressed, and its compressed version
+
+    std::vector<std::string> _newBufferSubscribers; //!< Buffers which got a subscriber since the last call to getNewBufferSubscriptions
+    std::set<std::string> _requestedSubscriptions;  //!< Subscriptions to apply to the buffer input socket
+    bool _subscriptionsRequested{false};            //!< True if _requestedSubscriptions has not been applied yet
+    std::mutex _requestedSubscriptionsMutex;        //!< Protects the requested subscriptions
+    std::set<std::string> _bufferSubscriptions;     //!< Subscriptions currently applied to the buffer input socket
+    bool _subscribedToAllBuffers{true};             //!< True while the buffer input socket receives everything
 
     std::thread _bufferInThread;
+    std::thread _bufferOutThread;
     std::thread _messageInThread;
 
     /**
      * \brief Callback to remove the shared_ptr to a sent buffer
      * \param data Pointer to sent data
-     * \param hint Pointer to the Link
+     * \param hint Pointer to the OutgoingBuffer handle
      */
     static void freeOlderBuffer(void* data, void* hint);
 
+    /**
+     * \brief Wake up the output thread, and the threads waiting for buffers to be sent
+     */
+    void notifyBufferOutput();
+
+    /**
+     * \brief Append the binary encoding of a message to a buffer
+     * A message is encoded as the target name and attribute, both null terminated, followed by the encoded values.
+     * \param buffer Buffer to append to
+     * \param name Target name
+     * \param attribute Target attribute
+     * \param message Message values
+     */
+    static void encodeMessage(std::vector<char>& buffer, const std::string& name, const std::string& attribute, const Values& message);
+
+    /**
+     * \brief Append the binary encoding of values to a buffer
+     * Values are encoded as their count (uint32_t), then each value as its type (uint8_t) followed by its content:
+     * an int64_t, a double, a string size (uint32_t) and characters, or nested values
+     * \param buffer Buffer to append to
+     * \param values Values to encode
+     */
+    static void encodeValues(std::vector<char>& buffer, const Values& values);
+
+    /**
+     * \brief Decode values encoded with encodeValues
+     * \param ptr Pointer to the encoded values, moved past them
+     * \param end End of the encoded data
+     * \param values Decoded values
+     * \return Return false if the encoded data is malformed
+     */
+    static bool decodeValues(const char*& ptr, const char* end, Values& values);
+
+    /**
+     * \brief Send a buffer to a peer, from the output thread
+     * \param peer Peer to send to
+     * \param name Buffer name
+     * \param buffer Serialized buffer
+     * \return Return false if the buffer could not be sent
+     */
+    bool sendBufferToPeer(BufferPeer& peer, const std::string& name, const std::shared_ptr<SerializedObject>& buffer);
+
+    /**
+     * \brief Write a buffer in shared memory, unless it was the last one written for this name
+     * \param name Buffer name
+     * \param buffer Serialized buffer
+     * \return Return the descriptor to send to the peers, or nullptr if the buffer could not be written to shared memory
+     */
+    std::shared_ptr<SerializedObject> writeBufferToSharedMemory(const std::string& name, const std::shared_ptr<SerializedObject>& buffer);
+
+    /**
+     * \brief Release the last written buffers which no peer waits for anymore, and the replaced rings all peers are done with
+     */
+    void releaseLastWrites();
+
+    /**
+     * \brief Compress a buffer with Snappy, unless it was the last one compressed for this name
+     * \param name Buffer name
+     * \param buffer Serialized buffer
+     * \return Return the compressed buffer
+     */
+    std::shared_ptr<SerializedObject> compressBuffer(const std::string& name, const std::shared_ptr<SerializedObject>& buffer);
+
+    /**
+     * \brief Uncompress a buffer compressed with Snappy
+     * \param msg Message holding the compressed buffer
+     * \return Return the buffer, or nullptr if it could not be uncompressed
+     */
+    static std::shared_ptr<SerializedObject> uncompressBuffer(const zmq::message_t& msg);
+
+    /**
+     * \brief Connect the message socket and a new buffer socket to the given endpoints
+     * \param name Peer name
+     * \param messageEndpoint ZMQ endpoint for messages
+     * \param bufferEndpoint ZMQ endpoint for buffers
+     * \param remote True if the peer is on another host
+     * \param compression Compression applied to the buffers sent to a remote peer
+     */
+    void connectToEndpoints(const std::string& name, const std::string& messageEndpoint, const std::string& bufferEndpoint, bool remote, BufferCompression compression);
+
+    /**
+     * \brief Check whether a peer subscribed to a buffer
+     * \param peer Peer
+     * \param name Buffer name
+     * \return Return true if the peer subscribed to this buffer, or to all of them
+     */
+    static bool isSubscribed(const BufferPeer& peer, const std::string& name);
+
+    /**
+     * \brief Get the buffer pointed at by a shared memory descriptor
+     * \param name Buffer name
+     * \param msg Message holding the descriptor
+     * \return Return the buffer, or nullptr if it is not available anymore
+     */
+    std::shared_ptr<SerializedObject> receiveBufferFromSharedMemory(const std::string& name, const zmq::message_t& msg);
+
+    /**
+     * \brief Read the subscription changes forwarded by the peers to their buffer output socket
+     * Must be called with _bufferPeersMutex locked.
+     */
+    void readBufferSubscribers();
+
+    /**
+     * \brief Apply the requested subscriptions to the buffer input socket, from the buffer input thread
+     */
+    void applyBufferSubscriptions();
+
     /**
      * \brief Message input thread function
      */
@@ -160,6 +410,11 @@ class Link
      * \brief Buffer input thread function
      */
     void handleInputBuffers();
+
+    /**
+     * \brief Buffer output thread function, sending the latest buffers to each peer
+     */
+    void handleOutputBuffers();
 };
 
 /*************/
@@ -0,0 +1,154 @@
+/*
+ * Copyright (C) 2017 Emmanuel Durand
+ *
+ * This file is part of Splash.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Splash is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Splash.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * @loopCache.h
+ * The LoopCache class, holding fully decoded video clips in memory
+ */
+
+#ifndef SPLASH_LOOPCACHE_H
+#define SPLASH_LOOPCACHE_H
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "config.h"
+
+#include "./coretypes.h"
+#include "./imageBuffer.h"
+
+namespace Splash
+{
+
+/*************/
+//! Process-wide cache of fully decoded clips, shared by all the video sources reading the same file.
+//! All clips, complete or being recorded, are accounted against a single byte budget. Complete clips
+//! which are not used by any source anymore are evicted, least recently used first, to make room for new ones.
+class LoopCache
+{
+  public:
+    struct Frame
+    {
+        ImageBuffer image{};
+        int64_t timing{0}; //!< Presentation time, in us
+    };
+
+    struct AudioFrame
+    {
+        ResizableArray<uint8_t> samples{};
+        int64_t timing{0}; //!< Presentation time, in us
+    };
+
+    struct Clip
+    {
+        std::vector<Frame> frames{};
+        std::vector<AudioFrame> audioFrames{};
+        int64_t duration{0}; //!< Duration of a single pass, in us
+        uint64_t size{0};    //!< Size reserved in the cache, in bytes
+    };
+
+    /**
+     * \brief Get the singleton
+     * \return Return the cache
+     */
+    static LoopCache& get()
+    {
+        static auto instance = new LoopCache;
+        return *instance;
+    }
+
+    /**
+     * \brief Get the complete clip for the given file
+     * \param path File path
+     * \return Return the clip, or nullptr if the file is not cached
+     */
+    std::shared_ptr<const Clip> find(const std::string& path);
+
+    /**
+     * \brief Add a complete clip to the cache. Its size must have been reserved while recording it
+     * \param path File path
+     * \param clip Clip
+     * \return Return the cached clip, which is another one if the file has been cached in the meantime
+     */
+    std::shared_ptr<const Clip> insert(const std::string& path, const std::shared_ptr<Clip>& clip);
+
+    /**
+     * \brief Reserve room for frames being recorded, evicting unused clips if needed
+     * \param size Size in bytes
+     * \return Return false if the budget does not allow for it
+     */
+    bool reserve(uint64_t size);
+
+    /**
+     * \brief Give back room reserved for frames which will not be cached
+     * \param size Size in bytes
+     */
+    void release(uint64_t size);
+
+    /**
+     * \brief Set the cache budget, evicting unused clips if needed
+     * \param size Budget in bytes
+     */
+    void setBudget(uint64_t size);
+
+    /**
+     * \brief Get the cache budget
+     * \return Return the budget in bytes
+     */
+    uint64_t getBudget() const;
+
+    /**
+     * \brief Get the size used by the cached and recording clips
+     * \return Return the size in bytes
+     */
+    uint64_t getUsedSize() const;
+
+  private:
+    struct Entry
+    {
+        std::shared_ptr<const Clip> clip{};
+        uint64_t lastUse{0};
+    };
+
+    mutable std::mutex _mutex{};
+    std::map<std::string, Entry> _clips{};
+    uint64_t _budget;
+    uint64_t _usedSize{0};
+    uint64_t _useCounter{0};
+
+    LoopCache();
+    ~LoopCache() = default;
+    LoopCache(const LoopCache&) = delete;
+    LoopCache& operator=(const LoopCache&) = delete;
+
+    /**
+     * \brief Evict unused clips until the given size fits in the budget. Must be called with _mutex locked
+     * \param size Size to make room for, in bytes
+     * \return Return true if the size fits
+     */
+    bool makeRoom(uint64_t size);
+};
+
+} // end of namespace
+
+#endif // SPLASH_LOOPCACHE_H
@@ -245,6 +245,7 @@ class Object : public BaseObject
     std::string _fill{"texture"};
     std::vector<std::string> _fillParameters{};
     int _sideness{0};
+    int _textureLayer{0}; //!< Layer sampled when the texture is a texture array
     glm::dvec4 _color{0.0, 1.0, 0.0, 1.0};
     float _normalExponent{0.0};
 
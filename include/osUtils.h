@@ -25,6 +25,7 @@
 #ifndef SPLASH_OSUTILS_H
 #define SPLASH_OSUTILS_H
 
+#include <cerrno>
 #include <dirent.h>
 #include <string>
 #include <unistd.h>
@@ -34,6 +35,7 @@
 #endif
 #include <pwd.h>
 #include <sched.h>
+#include <sys/resource.h>
 #include <sys/stat.h>
 #include <sys/syscall.h>
 #include <sys/types.h>
@@ -70,9 +72,10 @@ inline int getCoreCount()
 /**
  * \brief Set the CPU core affinity. If one of the specified cores is not reachable, does nothing.
  * \param cores Vector of the target cores
+ * \param threadId Id of the thread to set the affinity of, 0 for the current thread
  * \return Return true if all went well
  */
-inline bool setAffinity(const std::vector<int>& cores)
+inline bool setAffinity(const std::vector<int>& cores, int threadId = 0)
 {
 #if HAVE_LINUX
     auto ncores = getCoreCount();
@@ -85,7 +88,7 @@ inline bool setAffinity(const std::vector<int>& cores)
     for (auto& core : cores)
         CPU_SET(core, &set);
 
-    if (sched_setaffinity(getThreadId(), sizeof(set), &set) != 0)
+    if (sched_setaffinity(threadId == 0 ? getThreadId() : threadId, sizeof(set), &set) != 0)
         return false;
 
     return true;
@@ -95,15 +98,131 @@ inline bool setAffinity(const std::vector<int>& cores)
 }
 
 /**
- * \brief Set the current thread as realtime (nice = 99, SCHED_RR)
+ * \brief Set a thread as realtime (priority = 99, SCHED_RR or SCHED_FIFO)
+ * \param fifo If true, use SCHED_FIFO instead of SCHED_RR
+ * \param threadId Id of the thread to set the scheduling of, 0 for the current thread
  * \return Return true if it was able to set the scheduling
  */
-inline bool setRealTime()
+inline bool setRealTime(bool fifo = false, int threadId = 0)
 {
 #if HAVE_LINUX
     sched_param params;
     params.sched_priority = 99;
-    if (sched_setscheduler(getThreadId(), SCHED_RR, &params) != 0)
+    if (sched_setscheduler(threadId == 0 ? getThreadId() : threadId, fifo ? SCHED_FIFO : SCHED_RR, &params) != 0)
+        return false;
+
+    return true;
+#else
+    return false;
+#endif
+}
+
+/**
+ * \brief Scheduling policy and priorities of a thread
+ */
+struct Scheduling
+{
+    int policy{SCHED_OTHER};
+    int priority{0}; //!< Static priority, used by the realtime policies
+    int nice{0};     //!< Nice value, used by the other policies
+};
+
+/**
+ * \brief Get the CPU core affinity
+ * \param cores Vector filled with the cores the thread can run on
+ * \param threadId Id of the thread to get the affinity of, 0 for the current thread
+ * \return Return true if all went well
+ */
+inline bool getAffinity(std::vector<int>& cores, int threadId = 0)
+{
+#if HAVE_LINUX
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(threadId == 0 ? getThreadId() : threadId, sizeof(set), &set) != 0)
+        return false;
+
+    cores.clear();
+    for (int core = 0; core < CPU_SETSIZE; ++core)
+        if (CPU_ISSET(core, &set))
+            cores.push_back(core);
+
+    return true;
+#else
+    return false;
+#endif
+}
+
+/**
+ * \brief Get the scheduling of a thread
+ * \param scheduling Scheduling filled with the policy and priorities of the thread
+ * \param threadId Id of the thread to get the scheduling of, 0 for the current thread
+ * \return Return true if all went well
+ */
+inline bool getScheduling(Scheduling& scheduling, int threadId = 0)
+{
+#if HAVE_LINUX
+    auto tid = threadId == 0 ? getThreadId() : threadId;
+    auto policy = sched_getscheduler(tid);
+    if (policy == -1)
+        return false;
+
+    sched_param params;
+    if (sched_getparam(tid, &params) != 0)
+        return false;
+
+    // getpriority can legitimately return -1, errors are only told by errno
+    errno = 0;
+    auto nice = getpriority(PRIO_PROCESS, tid);
+    if (nice == -1 && errno != 0)
+        return false;
+
+    scheduling.policy = policy;
+    scheduling.priority = params.sched_priority;
+    scheduling.nice = nice;
+    return true;
+#else
+    return false;
+#endif
+}
+
+/**
+ * \brief Set the scheduling of a thread, as returned by getScheduling
+ * \param scheduling Scheduling policy and priorities
+ * \param threadId Id of the thread to set the scheduling of, 0 for the current thread
+ * \return Return true if it was able to set the scheduling
+ */
+inline bool setScheduling(const Scheduling& scheduling, int threadId = 0)
+{
+#if HAVE_LINUX
+    auto tid = threadId == 0 ? getThreadId() : threadId;
+    sched_param params;
+    params.sched_priority = scheduling.priority;
+    if (sched_setscheduler(tid, scheduling.policy, &params) != 0)
+        return false;
+    if (setpriority(PRIO_PROCESS, tid, scheduling.nice) != 0)
+        return false;
+
+    return true;
+#else
+    return false;
+#endif
+}
+
+/**
+ * \brief Set a thread back to the default scheduling policy, with the given nice value
+ * \param niceValue Nice value, from -20 (highest priority) to 19 (lowest priority)
+ * \param threadId Id of the thread to set the scheduling of, 0 for the current thread
+ * \return Return true if it was able to set the scheduling
+ */
+inline bool setNormalScheduling(int niceValue, int threadId = 0)
+{
+#if HAVE_LINUX
+    auto tid = threadId == 0 ? getThreadId() : threadId;
+    sched_param params;
+    params.sched_priority = 0;
+    if (sched_setscheduler(tid, SCHED_OTHER, &params) != 0)
+        return false;
+    if (setpriority(PRIO_PROCESS, tid, niceValue) != 0)
         return false;
 
     return true;
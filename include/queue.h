@@ -79,6 +79,12 @@ class Queue : public BufferObject
      */
     std::string getDistantName() const;
 
+    /**
+     * \brief Tell whether the current source is small enough to be sent to Scenes connected through a limited bandwidth
+     * \return Return true if the current source fits
+     */
+    bool fitsLimitedBandwidth() const { return _currentSource && _currentSource->fitsLimitedBandwidth(); }
+
     /**
      * \brief Serialize the underlying source
      * \return Return the serialized object
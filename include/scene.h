@@ -25,10 +25,13 @@
 #ifndef SPLASH_SCENE_H
 #define SPLASH_SCENE_H
 
+#include <array>
 #include <atomic>
 #include <cstddef>
 #include <future>
 #include <list>
+#include <map>
+#include <set>
 #include <vector>
 
 #include "./config.h"
@@ -61,9 +64,10 @@ class Scene : public RootObject
     /**
      * \brief Constructor
      * \param name Scene name
-     * \param autoRun If true, the Scene will start without waiting for a start message from the World
+     * \param worldAddress If not empty, address and port (as in address:port) of a World running on another host
+     * \param tcpPort TCP port to listen to for a World running on another host
      */
-    Scene(const std::string& name = "Splash");
+    Scene(const std::string& name = "Splash", const std::string& worldAddress = "", int tcpPort = 0);
 
     /**
      * \brief Destructor
@@ -211,6 +215,11 @@ class Scene : public RootObject
      */
     void sendMessageToWorld(const std::string& message, const Values& value = {});
 
+    /**
+     * \brief Signals that a BufferObject has been updated, which wakes up the texture upload thread
+     */
+    void signalBufferObjectUpdated() final;
+
     /**
      * \brief Set a message to be sent to the world, and wait for the World to send an answer
      * \param message Message type to send, which should correspond to a World attribute
@@ -264,11 +273,16 @@ class Scene : public RootObject
     // Texture upload context
     std::future<void> _textureUploadFuture;
     std::mutex _textureUploadMutex;
+    std::mutex _textureUploadRequestMutex;
     std::condition_variable _textureUploadCondition;
+    bool _textureUploadRequested{false};           //!< Set when a buffer has been delivered and deserialized, protected by _textureUploadRequestMutex
+    std::atomic_bool _textureUploadDeferred{false}; //!< Set when the upload budget deferred some textures to the next frame
     std::shared_ptr<GlWindow> _textureUploadWindow;
     std::atomic_bool _textureUploadDone{false};
     Spinlock _textureMutex; //!< Sync between texture and render loops
-    GLsync _textureUploadFence, _cameraDrawnFence;
+    GLsync _textureUploadFence{nullptr}, _cameraDrawnFence{nullptr};
+    std::atomic<int64_t> _uploadBudgetBytes{0}; //!< Maximum amount of data uploaded per frame, 0 for no limit
+    std::atomic<int64_t> _uploadBudgetTime{0};  //!< Maximum time spent updating textures per frame in us, 0 for no limit
 
     // NV Swap group specific
     GLuint _maxSwapGroups{0};
@@ -276,6 +290,15 @@ class Scene : public RootObject
 
     unsigned long _nextId{0};
 
+    std::string _worldAddress{""}; //!< Address and port of the World, if it runs on another host
+    int _tcpPort{0};               //!< TCP port to listen to for a World on another host
+
+    std::set<std::string> _bufferSubscriptions{}; //!< Names of the buffer objects hosted by this Scene, which it subscribed to
+
+    std::map<std::string, std::array<float, 4>> _regionsOfInterest{}; //!< Regions of the images sampled by this Scene, as last sent to the World
+    int64_t _regionsOfInterestTime{0};                                  //!< Time of the last update of the regions, in us
+    int64_t _regionsOfInterestRefreshTime{0};                           //!< Time at which all the regions were last sent, in us
+
     /**
      * \brief Find which OpenGL version is available (from a predefined list)
      * \return Return MAJOR and MINOR
@@ -315,6 +338,11 @@ class Scene : public RootObject
      */
     void textureUploadRun();
 
+    /**
+     * \brief Wake up the texture upload thread
+     */
+    void requestTextureUpload();
+
     /**
      * \brief Register new attributes
      */
@@ -324,6 +352,27 @@ class Scene : public RootObject
      * \brief Update the various inputs (mouse, keyboard...)
      */
     void updateInputs();
+
+    /**
+     * \brief Subscribe to the buffers of the hosted buffer objects, so that the other ones are not received
+     */
+    void updateBufferSubscriptions();
+
+    /**
+     * \brief Compute the region of each image sampled by the objects of this Scene, from the UV coordinates of their meshes,
+     * and send the regions which changed to the World. Images shown by other means, i.e. windows, warps or the GUI, are needed whole.
+     * All regions are sent again periodically, so that the World can forget the Scenes which disappeared
+     */
+    void updateRegionsOfInterest();
+
+    /**
+     * \brief Update the textures within the upload budget, the others being deferred to the next frame.
+     * Textures seen by a camera come first, then the closest deadlines, then the ones deferred the most times in a row.
+     * \param textures Textures to update
+     * \param visible Objects linked, directly or not, to a camera
+     * \return Return true if some textures were deferred
+     */
+    bool uploadTextures(const std::vector<std::shared_ptr<Texture>>& textures, const std::set<BaseObject*>& visible);
 };
 
 } // end of namespace
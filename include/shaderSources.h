@@ -121,18 +121,23 @@ struct ShaderSources
         //
         // YUV to RGB and RGB to YUV
         {"yuv", R"(
-            vec3 yuv2rgb(vec3 c)
+            vec3 yuv2rgb(vec3 c, float blackLevel)
             {
                 // Input colors are stored with a gamma applied to them
                 vec3 yuv = pow(c, vec3(1.0/2.2));
-                vec3 rgb = vec3((yuv.r - 16.0/255.0) + 1.403*(yuv.b - 0.5),
-                                (yuv.r - 16.0/255.0) - 0.344*(yuv.g - 0.5) - 0.714*(yuv.b - 0.5),
-                                (yuv.r - 16.0/255.0) + 1.772*(yuv.g - 0.5));
+                vec3 rgb = vec3((yuv.r - blackLevel) + 1.403*(yuv.b - 0.5),
+                                (yuv.r - blackLevel) - 0.344*(yuv.g - 0.5) - 0.714*(yuv.b - 0.5),
+                                (yuv.r - blackLevel) + 1.772*(yuv.g - 0.5));
                 rgb = clamp(rgb, vec3(0.0), vec3(1.0));
                 rgb = pow(rgb, vec3(2.2));
                 return rgb;
             }
 
+            vec3 yuv2rgb(vec3 c)
+            {
+                return yuv2rgb(c, 16.0/255.0);
+            }
+
             vec3 rgb2yuv(vec3 c)
             {
                 // Input colors are stored with a gamma applied to them
@@ -819,9 +824,17 @@ struct ShaderSources
         // Texture transformation
         uniform int _tex0_flip = 0;
         uniform int _tex0_flop = 0;
+        uniform vec4 _tex0_region = vec4(0.0, 0.0, 1.0, 1.0); // Offset and scale of the region held by the texture, in the whole image
         // Format specific parameters
         uniform int _tex0_YCoCg = 0;
-        uniform int _tex0_YUV = 0; // 1 = UYVY, 2 = YUYV
+        uniform int _tex0_YUV = 0; // 1 = UYVY, 2 = YUYV, 3 = planar YUV, 4 = semi-planar YUV (NV12)
+        uniform float _tex0_YUVScale = 1.0; // Scale to apply to samples stored on more bits than they use
+        uniform int _tex0_YUVFullRange = 0; // 1 if the luma black level is 0 instead of 16
+    #ifndef TEXTURE_RECT
+        // Chroma planes of planar formats, the luma being in _tex0
+        uniform sampler2D _tex0_chroma0;
+        uniform sampler2D _tex0_chroma1;
+    #endif
 
         // Film uniforms
         uniform float _filmDuration = 0.f;
@@ -870,6 +883,9 @@ struct ShaderSources
             else
                 realCoords = texCoord;
 
+            // Only a region of the image may have been received
+            realCoords = (realCoords - _tex0_region.xy) / _tex0_region.zw;
+
     #ifdef TEXTURE_RECT
             vec4 color = texture(_tex0, realCoords * _tex0_size);
     #else
@@ -888,7 +904,7 @@ struct ShaderSources
             }
 
             // If the color format is YUYV
-            if (_tex0_YUV > 0)
+            if (_tex0_YUV == 1 || _tex0_YUV == 2)
             {
                 // Texture coord rounded to the closer even pixel
                 vec2 yuyvCoords = vec2((round((realCoords.x * _tex0_size.x + 0.5) / 2.0) * 2.0 + 0.5) / _tex0_size.x, realCoords.y);
@@ -904,6 +920,19 @@ struct ShaderSources
                 else // Odd pixel
                     color.rgb = yuv2rgb(yuyv.bga);
             }
+    #ifndef TEXTURE_RECT
+            // If the color format is planar, chroma is read from the other planes
+            else if (_tex0_YUV == 3)
+            {
+                vec3 yuv = vec3(color.r, texture(_tex0_chroma0, realCoords).r, texture(_tex0_chroma1, realCoords).r);
+                color = vec4(yuv2rgb(yuv * _tex0_YUVScale, _tex0_YUVFullRange == 1 ? 0.0 : 16.0/255.0), 1.0);
+            }
+            else if (_tex0_YUV == 4)
+            {
+                vec3 yuv = vec3(color.r, texture(_tex0_chroma0, realCoords).rg);
+                color = vec4(yuv2rgb(yuv * _tex0_YUVScale), 1.0);
+            }
+    #endif
             
             // Invert channels
             if (_invertChannels == 1)
@@ -1080,6 +1109,9 @@ struct ShaderSources
 
     #ifdef TEXTURE_RECT
         uniform sampler2DRect _tex0;
+    #elif defined(TEXTURE_ARRAY)
+        uniform sampler2DArray _tex0;
+        uniform int _tex0_layer = 0; // Layer of the texture array sampled by this object
     #else
         uniform sampler2D _tex0;
     #endif
@@ -1127,6 +1159,8 @@ struct ShaderSources
 
         #ifdef TEXTURE_RECT
             vec4 color = texture(_tex0, texCoord * _tex0_size);
+        #elif defined(TEXTURE_ARRAY)
+            vec4 color = texture(_tex0, vec3(texCoord, float(_tex0_layer)));
         #else
             vec4 color = texture(_tex0, texCoord);
         #endif
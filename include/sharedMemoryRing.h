@@ -0,0 +1,165 @@
+/*
+ * Copyright (C) 2017 Emmanuel Durand
+ *
+ * This file is part of Splash.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Splash is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Splash.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * @sharedMemoryRing.h
+ * The SharedMemoryRing class, used to transmit buffers between processes on the same host
+ */
+
+#ifndef SPLASH_SHAREDMEMORYRING_H
+#define SPLASH_SHAREDMEMORYRING_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "config.h"
+#include "coretypes.h"
+
+namespace Splash
+{
+
+/*************/
+//! Ring of frame slots held in POSIX shared memory.
+//! The writer process copies each buffer once into a free slot, readers map the slots read-only
+//! and hold them without copying. Each slot has a state word in a small read-write header, holding
+//! a generation number (upper 32 bits) and the count of readers currently holding it (lower 32 bits).
+//! A slot is only rewritten once all its readers released it, otherwise the writer falls back to another slot.
+//! Readers also count the descriptors they received, so that the writer knows when a ring it replaced can be removed.
+class SharedMemoryRing
+{
+  public:
+    //! Description of a written slot, sent to the readers along with the buffer name
+    struct Descriptor
+    {
+        uint32_t magic{0};
+        uint32_t slotIndex{0};
+        uint32_t generation{0};
+        uint32_t slotCount{0};
+        uint64_t slotSize{0};
+        uint64_t size{0};
+        char segment[64]{};
+    };
+
+    /**
+     * \brief Destructor. The segment is unlinked if this object created it, mappings held by readers stay valid.
+     */
+    ~SharedMemoryRing();
+
+    SharedMemoryRing(const SharedMemoryRing&) = delete;
+    SharedMemoryRing& operator=(const SharedMemoryRing&) = delete;
+
+    /**
+     * \brief Create a new ring, as the writer
+     * \param segment Shared memory segment name, starting with a slash
+     * \param slotCount Number of slots
+     * \param slotSize Minimum size of each slot
+     * \return Return the ring, or nullptr if it could not be created
+     */
+    static std::unique_ptr<SharedMemoryRing> create(const std::string& segment, uint32_t slotCount, uint64_t slotSize);
+
+    /**
+     * \brief Open an existing ring as a reader. Slots data are mapped read-only.
+     * \param desc Descriptor of any slot of the ring
+     * \return Return the ring, or nullptr if it could not be opened
+     */
+    static std::shared_ptr<SharedMemoryRing> open(const Descriptor& desc);
+
+    /**
+     * \brief Get ownership over the slot described by desc, without copying it
+     * The slot is released when the returned array is destroyed. The array content must not be modified.
+     * \param ring Ring holding the slot
+     * \param desc Slot descriptor
+     * \return Return the slot content, or an empty array if the slot has been rewritten since desc was emitted
+     */
+    static ResizableArray<char> acquire(const std::shared_ptr<SharedMemoryRing>& ring, const Descriptor& desc);
+
+    /**
+     * \brief Acknowledge the reception of a descriptor of this ring, as a reader
+     */
+    void acknowledge();
+
+    /**
+     * \brief Get the number of descriptors acknowledged by the readers
+     * \return Return the acknowledgement count
+     */
+    uint64_t getAcknowledgements() const;
+
+    /**
+     * \brief Copy the given buffer in a free slot
+     * \param data Pointer to the buffer
+     * \param size Buffer size, which must not exceed the slot size
+     * \param desc Descriptor to fill for the readers
+     * \return Return false if no slot is free
+     */
+    bool write(const char* data, uint64_t size, Descriptor& desc);
+
+    /**
+     * \brief Get the segment name
+     * \return Return the segment name
+     */
+    std::string getSegment() const { return _segment; }
+
+    /**
+     * \brief Get the size of each slot
+     * \return Return the slot size
+     */
+    uint64_t getSlotSize() const { return _slotSize; }
+
+    /**
+     * \brief Check whether the given descriptor comes from this ring
+     * \param desc Slot descriptor
+     * \return Return true if desc points to this ring
+     */
+    bool matches(const Descriptor& desc) const { return _segment == desc.segment && _slotCount == desc.slotCount && _slotSize == desc.slotSize; }
+
+  private:
+    SharedMemoryRing() = default;
+
+    std::string _segment{""};
+    bool _isWriter{false};
+    uint32_t _slotCount{0};
+    uint32_t _nextSlot{0};
+    uint64_t _slotSize{0};
+    size_t _headerSize{0};
+
+    std::atomic<uint64_t>* _acknowledgements{nullptr}; //!< Descriptors received by the readers, in the read-write header
+    std::atomic<uint64_t>* _slotStates{nullptr};       //!< Slot states, in the read-write header
+    char* _header{nullptr};                            //!< Header mapping
+    char* _slots{nullptr};                             //!< Slots mapping, read-only for readers
+
+    /**
+     * \brief Get the header size needed to hold the given slot count
+     * \param slotCount Slot count
+     * \return Return the header size, aligned on the page size
+     */
+    static size_t getHeaderSize(uint32_t slotCount);
+
+    /**
+     * \brief Round up the given size to the page size
+     * \param size Size
+     * \return Return the rounded size
+     */
+    static uint64_t alignOnPage(uint64_t size);
+};
+
+} // end of namespace
+
+#endif // SPLASH_SHAREDMEMORYRING_H
@@ -0,0 +1,159 @@
+/*
+ * Copyright (C) 2017 Emmanuel Durand
+ *
+ * This file is part of Splash.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Splash is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Splash.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * @texture_array.h
+ * The Texture_Array class, packing images of the same format as the layers of a single texture
+ */
+
+#ifndef SPLASH_TEXTURE_ARRAY_H
+#define SPLASH_TEXTURE_ARRAY_H
+
+#include <memory>
+#include <vector>
+
+#include "config.h"
+
+#include "basetypes.h"
+#include "coretypes.h"
+#include "image.h"
+#include "texture.h"
+
+namespace Splash
+{
+
+/*************/
+//! Array texture, holding one image per layer.
+//! Images are added as layers in the order they are linked, and must all share the size and format of the first one.
+//! All the layers updated in a frame are copied to a single PBO and uploaded together, and objects linked to the array
+//! sample the layer given by their textureLayer attribute.
+class Texture_Array : public Texture
+{
+  public:
+    /**
+     * \brief Constructor
+     * \param root Root object
+     */
+    Texture_Array(const std::weak_ptr<RootObject>& root);
+
+    /**
+     * \brief Destructor
+     */
+    ~Texture_Array();
+
+    /**
+     * No copy constructor
+     */
+    Texture_Array(const Texture_Array&) = delete;
+    Texture_Array& operator=(const Texture_Array&) = delete;
+
+    /**
+     * \brief Bind this texture
+     */
+    void bind();
+
+    /**
+     * \brief Unbind this texture
+     */
+    void unbind();
+
+    /**
+     * \brief Get the number of layers
+     * \return Return the number of layers
+     */
+    int getLayerCount() const { return _layers.size(); }
+
+    /**
+     * \brief Get the shader parameters related to this texture. Texture should be locked first.
+     * \return Return the shader uniforms
+     */
+    std::unordered_map<std::string, Values> getShaderUniforms() const { return _shaderUniforms; }
+
+    /**
+     * \brief Get spec of a single layer
+     * \return Return the spec
+     */
+    ImageBufferSpec getSpec() const { return _spec; }
+
+    /**
+     * \brief Try to link the given BaseObject to this object, images being added as new layers
+     * \param obj Shared pointer to the (wannabe) child object
+     */
+    bool linkTo(std::shared_ptr<BaseObject> obj);
+
+    /**
+     * \brief Unlink a given object, removing its layer
+     * \param obj Object to unlink from
+     */
+    void unlinkFrom(std::shared_ptr<BaseObject> obj);
+
+    /**
+     * \brief Update the layers whose image changed
+     */
+    void update();
+
+  private:
+    struct Layer
+    {
+        std::weak_ptr<Image> image{};
+        int64_t timestamp{0};
+        bool mismatch{false}; //!< True if the image does not match the format of the array, to warn only once
+    };
+
+    std::vector<Layer> _layers{};
+
+    GLuint _glTex{0};
+    GLuint _pbo{0};
+    int64_t _pboSize{0};
+    int _allocatedLayers{0}; //!< Number of layers of the current texture storage
+
+    // Store some texture parameters
+    bool _filtering{false};
+    bool _srgb{false};
+    GLenum _texFormat{GL_RGBA}, _texType{GL_UNSIGNED_BYTE};
+    GLint _texInternalFormat{GL_RGBA8};
+
+    // And some temporary attributes
+    GLint _activeTexture{0}; // Texture unit to which the texture is bound
+
+    // Parameters to send to the shader
+    std::unordered_map<std::string, Values> _shaderUniforms;
+
+    /**
+     * \brief Initialization
+     */
+    void init();
+
+    /**
+     * \brief Allocate the storage for all the layers, according to the given layer spec
+     * \param spec Spec of a single layer
+     * \param srgb If true, 8 bits color images are stored as sRGB
+     * \return Return false if the format is not supported
+     */
+    bool allocate(const ImageBufferSpec& spec, bool srgb);
+
+    /**
+     * \brief Register new functors to modify attributes
+     */
+    void registerAttributes();
+};
+
+} // end of namespace
+
+#endif // SPLASH_TEXTURE_ARRAY_H
@@ -25,6 +25,7 @@
 #ifndef SPLASH_TEXTURE_IMAGE_H
 #define SPLASH_TEXTURE_IMAGE_H
 
+#include <atomic>
 #include <chrono>
 #include <glm/glm.hpp>
 #include <memory>
@@ -83,9 +84,19 @@ class Texture_Image : public Texture
 
     /**
      * \brief Flush the PBO copy which may still be happening. Do this before closing the current context!
+     * With the streaming ring, the copy is only checked for completion and is otherwise finished by the next update
      */
     void flushPbo();
 
+    /**
+     * \brief Count an update which has been deferred by the upload scheduler
+     */
+    void deferUpdate()
+    {
+        ++_deferredUploads;
+        ++_consecutiveDeferrals;
+    }
+
     /**
      * \brief Generate the mipmaps for the texture
      */
@@ -97,6 +108,30 @@ class Texture_Image : public Texture
      */
     GLuint getTexId() const { return _glTex; }
 
+    /**
+     * \brief Get the number of updates deferred in a row by the upload scheduler
+     * \return Return the number of consecutive deferrals
+     */
+    int getConsecutiveDeferrals() const { return _consecutiveDeferrals; }
+
+    /**
+     * \brief Check whether the image changed since the last update
+     * \return Return true if the next update will upload something
+     */
+    bool hasPendingUpdate() const;
+
+    /**
+     * \brief Get the amount of data the next update will upload, estimated from the current image spec
+     * \return Return the size in bytes, or 0 if the image did not change since the last update
+     */
+    int64_t getPendingUploadSize() const;
+
+    /**
+     * \brief Get the time by which the image waiting to be uploaded should be shown, which is when the next image of the source is expected
+     * \return Return the deadline in us, on the same clock as the timestamps, or 0 if there is nothing to upload
+     */
+    int64_t getPendingDeadline() const;
+
     /**
      * \brief Get the shader parameters related to this texture. Texture should be locked first.
      * \return Return the shader uniforms
@@ -161,11 +196,30 @@ class Texture_Image : public Texture
   private:
     GLint _glVersionMajor{0};
     GLint _glVersionMinor{0};
+    GLint _glMaxTextureUnits{0};     //!< Texture image units available to the fragment shader
+    bool _planeUnitsExceeded{false}; //!< True once the lack of chroma plane units has been reported
 
     GLuint _glTex{0};
+    GLuint _glPlaneTex[2]{0, 0}; //!< Chroma planes of planar images, the luma plane being held by _glTex
     GLuint _pbos[2];
     int _pboReadIndex{0};
-    std::vector<unsigned int> _pboCopyThreadIds;
+    TaskGroup _pboCopyTasks;
+    bool _pboMapped{false}; //!< True if the next PBO is mapped and being filled
+
+    // Persistently mapped streaming ring, replacing the PBOs when buffer storage is available
+    bool _useRing{false};
+    GLuint _ringBuffer{0};
+    GLubyte* _ringData{nullptr};       //!< Persistent and coherent mapping of the whole ring
+    int _ringSlotSize{0};              //!< Size of a slot, in bytes
+    std::vector<GLsync> _ringFences{}; //!< Fences signaled when the GPU is done reading each slot
+    int _ringWriteSlot{0};             //!< Slot filled by the copy tasks
+    int _ringReadySlot{-1};            //!< Slot holding a complete image, to be uploaded at the next update
+
+    // Upload scheduling
+    std::atomic<int64_t> _deferredUploads{0}; //!< Updates deferred by the Scene upload scheduler since the creation of the texture
+    int _consecutiveDeferrals{0};             //!< Updates deferred since the last upload
+    uint64_t _frameId{0};                     //!< Frame index of the last uploaded image
+    int64_t _framePeriod{0};                  //!< Estimated period between two images of the source, in us
 
     // Store some texture parameters
     bool _filtering{false};
@@ -196,11 +250,56 @@ class Texture_Image : public Texture
 
     /**
      * \brief Update the pbos according to the parameters
-     * \param width Width
-     * \param height Height
-     * \param bytes Bytes per pixel
+     * \param size Size of the image data, in bytes
+     */
+    void updatePbos(int size);
+
+    /**
+     * \brief Allocate the streaming ring, falling back to the PBOs if it fails
+     * \param size Size of the image data, in bytes
+     */
+    void updateRing(int size);
+
+    /**
+     * \brief Unmap and delete the streaming ring
+     */
+    void deleteRing();
+
+    /**
+     * \brief Get the next ring slot, waiting for the GPU to be done reading it
+     * \return Return the slot index
+     */
+    int acquireRingSlot();
+
+    /**
+     * \brief Wait for the copy to the ring to be done and mark its slot as ready
+     */
+    void finishRingCopy();
+
+    /**
+     * \brief Upload the image from the bound pixel unpack buffer
+     * \param spec Image spec
+     * \param channelOrder GL channel order
+     * \param dataFormat GL data format
+     * \param internalFormat GL internal format, for compressed images
+     * \param isCompressed True if the image is compressed
+     * \param dataSize Size of the image data, in bytes
+     * \param offset Offset of the image in the buffer, in bytes
+     */
+    void uploadFromUnpackBuffer(const ImageBufferSpec& spec, GLenum channelOrder, GLenum dataFormat, GLenum internalFormat, bool isCompressed, int dataSize, uintptr_t offset);
+
+    /**
+     * \brief Create the textures holding the chroma planes of a planar image
+     * \param spec Image spec
+     */
+    void createPlaneTextures(const ImageBufferSpec& spec);
+
+    /**
+     * \brief Upload the chroma planes of a planar image
+     * \param spec Image spec
+     * \param data Pointer to the image data, or nullptr to upload from the bound PBO
      */
-    void updatePbos(int width, int height, int bytes);
+    void uploadPlaneTextures(const ImageBufferSpec& spec, const char* data);
 
     /**
      * \brief Register new functors to modify attributes
@@ -0,0 +1,202 @@
+/*
+ * Copyright (C) 2017 Emmanuel Durand
+ *
+ * This file is part of Splash.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Splash is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Splash.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * @threadPlacement.h
+ * The ThreadPlacement class, assigning threads to CPU cores depending on their role
+ */
+
+#ifndef SPLASH_THREADPLACEMENT_H
+#define SPLASH_THREADPLACEMENT_H
+
+#include <array>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "config.h"
+#include "./osUtils.h"
+
+namespace Splash
+{
+
+/*************/
+//! Automatic thread placement, based on the CPU topology read from sysfs.
+//! Threads register with the class matching their role, and are moved to the cores assigned to this class.
+//! Render and upload threads get dedicated physical cores for each process, decode and background threads share the remaining ones.
+class ThreadPlacement
+{
+  public:
+    //! Thread classes, from the most to the least latency sensitive
+    enum class Class : uint8_t
+    {
+        render = 0, //!< Main loops of the World and the Scenes
+        upload,     //!< Texture upload and buffer transmission threads
+        decode,     //!< Media decoding threads and thread pool workers
+        background  //!< Everything else: user inputs, controllers, clocks
+    };
+
+    static constexpr int classCount = 4;
+
+    //! Logical CPU, as described by sysfs
+    struct Cpu
+    {
+        int id{0};   //!< Logical CPU index
+        int core{0}; //!< First logical CPU of the physical core (SMT siblings)
+        int l3{0};   //!< First logical CPU sharing the same L3 cache
+        int node{0}; //!< NUMA node
+    };
+
+    //! Cores assigned to each thread class, for a single process
+    struct Assignment
+    {
+        std::array<std::vector<int>, classCount> cores{};
+        bool realtime{false}; //!< If true, render and upload threads are set to SCHED_FIFO
+
+        bool empty() const { return cores[static_cast<int>(Class::render)].empty(); }
+    };
+
+    //! Handle to a registered thread, unregistering it on destruction
+    class Registration
+    {
+      public:
+        Registration() = default;
+        explicit Registration(int threadId)
+            : _threadId(threadId)
+        {
+        }
+        ~Registration();
+        Registration(const Registration&) = delete;
+        Registration& operator=(const Registration&) = delete;
+        Registration(Registration&& other)
+            : _threadId(other._threadId)
+        {
+            other._threadId = 0;
+        }
+        Registration& operator=(Registration&&) = delete;
+
+      private:
+        int _threadId{0};
+    };
+
+    /**
+     * \brief Get the singleton
+     * \return Return the thread placement
+     */
+    static ThreadPlacement& get()
+    {
+        static auto instance = new ThreadPlacement;
+        return *instance;
+    }
+
+    /**
+     * \brief Get the name of a thread class
+     * \param threadClass Thread class
+     * \return Return the name
+     */
+    static std::string getClassName(Class threadClass);
+
+    /**
+     * \brief Read the CPU topology from sysfs
+     * \return Return the online logical CPUs, or an empty vector if the topology is not available
+     */
+    static std::vector<Cpu> readTopology();
+
+    /**
+     * \brief Parse a sysfs CPU list, i.e. "0-3,8-11"
+     * \param list CPU list
+     * \return Return the CPU indices
+     */
+    static std::vector<int> parseCpuList(const std::string& list);
+
+    /**
+     * \brief Compute the cores assigned to each thread class, for the given number of processes
+     * Physical cores are sorted by NUMA node and L3 domain, so that the render and upload cores of a process share their cache.
+     * If there are not enough physical cores, upload threads fall back to the SMT sibling of the render core.
+     * \param cpus Logical CPUs
+     * \param processCount Number of processes to place
+     * \return Return one assignment per process, or an empty vector if there are not enough cores
+     */
+    static std::vector<Assignment> computeAssignments(const std::vector<Cpu>& cpus, int processCount);
+
+    /**
+     * \brief Get a readable description of an assignment
+     * \param assignment Assignment
+     * \return Return the description
+     */
+    static std::string describe(const Assignment& assignment);
+
+    /**
+     * \brief Register the calling thread, which is moved to the cores of its class if an assignment is active
+     * \param threadClass Thread class
+     * \return Return a handle which unregisters the thread when destroyed
+     */
+    Registration registerThread(Class threadClass);
+
+    /**
+     * \brief Set the active assignment, and apply it to all registered threads
+     * \param assignment Assignment, an empty one restoring the default placement
+     */
+    void setAssignment(const Assignment& assignment);
+
+    /**
+     * \brief Get the active assignment
+     * \return Return the assignment
+     */
+    Assignment getAssignment() const;
+
+  private:
+    ThreadPlacement() = default;
+    ~ThreadPlacement() = default;
+    ThreadPlacement(const ThreadPlacement&) = delete;
+    ThreadPlacement& operator=(const ThreadPlacement&) = delete;
+
+    //! Registered thread, with its scheduling from before the placement was applied
+    struct Thread
+    {
+        Class threadClass{Class::background};
+        bool saved{false}; //!< True if the original scheduling and affinity are saved
+        Utils::Scheduling scheduling{};
+        std::vector<int> cores{};
+    };
+
+    mutable std::mutex _mutex{};
+    Assignment _assignment{};
+    std::unordered_map<int, Thread> _threads{}; //!< Registered threads, per thread id
+
+    /**
+     * \brief Apply the active assignment to a thread, saving its original scheduling the first time. Must be called with _mutex locked
+     * \param threadId Thread id
+     * \param thread Registered thread
+     * \param previous Previous assignment, to know whether the scheduling has to be restored
+     */
+    void applyToThread(int threadId, Thread& thread, const Assignment& previous);
+
+    /**
+     * \brief Unregister a thread
+     * \param threadId Thread id
+     */
+    void unregisterThread(int threadId);
+};
+
+} // end of namespace
+
+#endif // SPLASH_THREADPLACEMENT_H
@@ -26,118 +26,424 @@
 #ifndef SPLASH_THREADPOOL_H
 #define SPLASH_THREADPOOL_H
 
+#include <algorithm>
 #include <atomic>
 #include <condition_variable>
 #include <deque>
+#include <functional>
+#include <future>
 #include <iostream>
 #include <memory>
 #include <mutex>
 #include <thread>
+#include <type_traits>
+#include <unordered_set>
 #include <vector>
 
 #include "config.h"
 
-/*************/
-class ThreadPool;
+#define SPLASH_THREADPOOL_MAX_WORKERS 64
 
 /*************/
-class Worker
-{
-  public:
-    Worker(ThreadPool& s)
-        : pool(s)
-    {
-    }
-    void operator()();
-
-  private:
-    ThreadPool& pool;
-    bool affinitySet{false};
-};
+class TaskGroup;
 
 /*************/
+//! Work-stealing thread pool
+//! Each worker has its own task deque. Tasks submitted from a worker go to the back of its own deque,
+//! others are spread over all deques. A worker runs the tasks from the back of its deque, and steals
+//! from the front of the other ones when it is empty. Idle workers sleep on a condition variable.
 class ThreadPool
 {
   public:
+    /**
+     * \brief Constructor
+     * \param threads Number of workers, -1 to match the number of cores
+     */
     ThreadPool(int threads = -1);
+
+    /**
+     * \brief Destructor
+     */
     ~ThreadPool();
 
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    /**
+     * \brief Submit a task
+     * \param f Task
+     * \return Return a future holding the result of the task
+     */
+    template <class F>
+    std::future<typename std::result_of<F()>::type> submit(F f);
+
+    /**
+     * \brief Submit a task, to be waited for with waitThreads. Prefer submit or TaskGroup for new code
+     * \param f Task
+     * \return Return the task id
+     */
     template <class F>
     unsigned int enqueue(F f);
+
+    /**
+     * \brief Submit a task which will not be waited for
+     * \param f Task
+     */
     template <class F>
     void enqueueWithoutId(F f);
-    unsigned int getTasksNumber();
+
+    /**
+     * \brief Get the number of tasks waiting to be run
+     * \return Return the number of queued tasks
+     */
+    unsigned int getTasksNumber() const { return _queuedTasks; }
+
+    /**
+     * \brief Get the number of workers
+     * \return Return the number of workers
+     */
+    unsigned int getWorkersNumber() const { return _workersNumber; }
+
+    /**
+     * \brief Add workers to the pool, up to SPLASH_THREADPOOL_MAX_WORKERS
+     * \param nbr Number of workers to add
+     */
     void addWorkers(unsigned int nbr);
+
+    /**
+     * \brief Set the cores the workers run on
+     * \param cores Core indices
+     */
     void setAffinity(const std::vector<int>& cores);
+
+    /**
+     * \brief Wait for all tasks to be finished
+     */
     void waitAllThreads();
-    void waitThreads(std::vector<unsigned int>&);
+
+    /**
+     * \brief Wait for the given tasks to be finished, then clear the list
+     * \param list Ids of the tasks, as returned by enqueue
+     */
+    void waitThreads(std::vector<unsigned int>& list);
+
+    /**
+     * \brief Run a function over a range, split in chunks run in parallel. The calling thread runs one of the chunks, and returns once all are done
+     * \param begin Beginning of the range
+     * \param end End of the range
+     * \param f Function called with the beginning and end of each chunk
+     * \param grain Minimum chunk size, every chunk size but the last one being a multiple of it
+     * \param maxChunks Maximum number of chunks, 0 to use all the workers and the calling thread
+     */
+    template <class F>
+    void parallelFor(size_t begin, size_t end, const F& f, size_t grain = 1, unsigned int maxChunks = 0);
+
+    /**
+     * \brief Copy a buffer using multiple threads. Small buffers are copied directly.
+     * Chunks are aligned on pages, so that each page is first written by a single thread, and their number
+     * is limited as a few threads are enough to saturate the memory bandwidth
+     * \param dst Destination
+     * \param src Source
+     * \param size Size in bytes
+     */
+    void parallelCopy(void* dst, const void* src, size_t size);
 
   private:
-    friend class Worker;
+    friend class TaskGroup;
+
+    struct Task
+    {
+        std::function<void()> function{};
+        TaskGroup* group{nullptr}; //!< Group the task belongs to, if any
+        unsigned int id{0};        //!< Task id, if it is to be waited for with waitThreads
+    };
+
+    struct TaskQueue
+    {
+        std::mutex mutex{};
+        std::deque<Task> tasks{};
+    };
+
+    std::vector<std::thread> _workers{};
+    TaskQueue _queues[SPLASH_THREADPOOL_MAX_WORKERS]; //!< Task deques, one per worker
+    std::atomic_uint _workersNumber{0};
+    std::atomic_uint _nextQueue{0};
+    std::atomic_bool _stop{false};
+
+    std::atomic_uint _queuedTasks{0};  //!< Tasks waiting to be run
+    std::atomic_uint _runningTasks{0}; //!< Tasks being run
+    std::mutex _sleepMutex{};
+    std::condition_variable _sleepCondition{}; //!< Signaled when a task is queued
+    std::mutex _doneMutex{};
+    std::condition_variable _doneCondition{}; //!< Signaled when a task with an id is done, or when no task is left
 
-    std::vector<std::thread> workers;
-    std::vector<int> cores{};
-    std::deque<std::shared_ptr<std::function<void()>>> tasks;
-    std::deque<unsigned int> tasksId;
-    std::deque<unsigned int> tasksFinished;
+    std::mutex _coresMutex{};
+    std::vector<int> _cores{};
+    std::atomic_uint _coresVersion{0};
 
-    std::atomic_uint workingThreads{0};
-    std::mutex queue_mutex;
-    std::condition_variable condition;
-    bool stop{false};
+    std::atomic_uint _nextId{1};
+    std::unordered_set<unsigned int> _pendingIds{}; //!< Ids of the tasks not finished yet, protected by _doneMutex
 
-    std::atomic_uint nextId{1};
+    /**
+     * \brief Add a task to the queues
+     * \param task Task
+     */
+    void push(Task&& task);
+
+    /**
+     * \brief Get a task from the given queue, or steal one from another queue
+     * \param index Index of the queue to look into first
+     * \param task Task to fill
+     * \return Return true if a task was found
+     */
+    bool pop(unsigned int index, Task& task);
+
+    /**
+     * \brief Take a queued task belonging to the given group, from any queue
+     * \param group Task group
+     * \param task Task to fill
+     * \return Return true if a task was found
+     */
+    bool popFromGroup(const TaskGroup* group, Task& task);
+
+    /**
+     * \brief Run a task and signal its completion
+     * \param task Task
+     */
+    void run(Task& task);
+
+    /**
+     * \brief Worker loop
+     * \param index Worker index, which is also the index of its queue
+     */
+    void workerLoop(unsigned int index);
 };
 
 /*************/
-template <class F>
-unsigned int ThreadPool::enqueue(F f)
+// Global thread pool
+struct SThread
+{
+  public:
+    static ThreadPool pool;
+};
+
+/*************/
+//! Group of tasks which can be waited for together.
+//! The waiting thread runs the tasks of the group which have not been started yet, so that waiting from
+//! inside a worker does not deadlock the pool. A group can be reused once waited for.
+class TaskGroup
 {
-    unsigned int id;
+  public:
+    /**
+     * \brief Constructor
+     * \param pool Thread pool to run the tasks on
+     */
+    TaskGroup(ThreadPool& pool = SThread::pool)
+        : _pool(pool)
     {
-    // Acquire lock
-    std:;
-        std::lock_guard<std::mutex> lock(queue_mutex);
+    }
 
-        id = std::atomic_fetch_add(&nextId, 1u);
-        if (id == std::numeric_limits<unsigned int>::max())
-            nextId = 1;
+    /**
+     * \brief Destructor, waits for the tasks of the group
+     */
+    ~TaskGroup() { wait(); }
 
-        // Add the task
-        tasks.push_back(std::shared_ptr<std::function<void()>>(new std::function<void()>(f)));
-        tasksId.push_back(id);
+    TaskGroup(const TaskGroup&) = delete;
+    TaskGroup& operator=(const TaskGroup&) = delete;
+
+    /**
+     * \brief Run a task as part of the group
+     * \param f Task
+     */
+    template <class F>
+    void run(F f);
+
+    /**
+     * \brief Wait for all the tasks of the group to be finished
+     */
+    void wait();
+
+    /**
+     * \brief Check whether some tasks of the group are not finished
+     * \return Return true if tasks are pending
+     */
+    bool isPending()
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _pendingTasks != 0;
     }
 
-    // Wake up one thread
-    condition.notify_one();
+  private:
+    friend class ThreadPool;
 
-    return id;
+    ThreadPool& _pool;
+    std::mutex _mutex{};
+    std::condition_variable _condition{};
+    unsigned int _pendingTasks{0}; //!< Protected by _mutex
+
+    /**
+     * \brief Signal that a task of the group is finished
+     */
+    void taskDone();
+};
+
+/*************/
+//! Graph of tasks run on a thread pool. Each node starts as soon as all the nodes it depends on are finished,
+//! on the worker which finished the last of them. Nodes are added before calling run, and the graph is not reusable.
+class TaskGraph
+{
+  public:
+    using NodeId = size_t;
+
+    /**
+     * \brief Constructor
+     * \param pool Thread pool to run the nodes on
+     */
+    TaskGraph(ThreadPool& pool = SThread::pool)
+        : _tasks(pool)
+    {
+    }
+
+    /**
+     * \brief Destructor, waits for all the nodes
+     */
+    ~TaskGraph() { wait(); }
+
+    TaskGraph(const TaskGraph&) = delete;
+    TaskGraph& operator=(const TaskGraph&) = delete;
+
+    /**
+     * \brief Add a node to the graph
+     * \param f Task of the node
+     * \param dependencies Nodes which have to be finished before this one starts
+     * \return Return the node id
+     */
+    NodeId addNode(const std::function<void()>& f, const std::vector<NodeId>& dependencies = {});
+
+    /**
+     * \brief Start the nodes which have no dependency
+     */
+    void run();
+
+    /**
+     * \brief Wait for all the nodes to be finished
+     */
+    void wait() { _tasks.wait(); }
+
+    /**
+     * \brief Check whether some nodes are not finished
+     * \return Return true if nodes are pending
+     */
+    bool isPending() { return _tasks.isPending(); }
+
+  private:
+    struct Node
+    {
+        std::function<void()> function{};
+        std::vector<NodeId> successors{};
+        std::atomic_uint remainingDependencies{0};
+    };
+
+    std::vector<std::unique_ptr<Node>> _nodes{};
+    TaskGroup _tasks;
+
+    /**
+     * \brief Run a node, then start its successors which are ready
+     * \param id Node id
+     */
+    void runNode(NodeId id);
+};
+
+/*************/
+template <class F>
+std::future<typename std::result_of<F()>::type> ThreadPool::submit(F f)
+{
+    using ResultType = typename std::result_of<F()>::type;
+    auto task = std::make_shared<std::packaged_task<ResultType()>>(std::move(f));
+    auto future = task->get_future();
+
+    Task queuedTask;
+    queuedTask.function = [task]() { (*task)(); };
+    push(std::move(queuedTask));
+
+    return future;
 }
 
 /*************/
 template <class F>
-void ThreadPool::enqueueWithoutId(F f)
+void ThreadPool::parallelFor(size_t begin, size_t end, const F& f, size_t grain, unsigned int maxChunks)
 {
+    if (end <= begin)
+        return;
+
+    grain = std::max<size_t>(grain, 1);
+    size_t chunks = std::max<size_t>((end - begin) / grain, 1);
+    chunks = std::min<size_t>(chunks, _workersNumber + 1);
+    if (maxChunks != 0)
+        chunks = std::min<size_t>(chunks, maxChunks);
+
+    if (chunks == 1)
     {
-    // Acquire lock
-    std:;
-        std::lock_guard<std::mutex> lock(queue_mutex);
+        f(begin, end);
+        return;
+    }
+
+    auto chunkSize = (end - begin + chunks - 1) / chunks;
+    chunkSize = (chunkSize + grain - 1) / grain * grain;
 
-        // Add the task
-        tasks.push_back(std::shared_ptr<std::function<void()>>(new std::function<void()>(f)));
-        tasksId.push_back(0);
+    TaskGroup tasks(*this);
+    for (auto chunkBegin = begin + chunkSize; chunkBegin < end; chunkBegin += chunkSize)
+    {
+        auto chunkEnd = std::min(chunkBegin + chunkSize, end);
+        tasks.run([=, &f]() { f(chunkBegin, chunkEnd); });
+    }
+    f(begin, std::min(begin + chunkSize, end));
+    tasks.wait();
+}
+
+/*************/
+template <class F>
+unsigned int ThreadPool::enqueue(F f)
+{
+    auto id = _nextId.fetch_add(1);
+    if (id == 0)
+        id = _nextId.fetch_add(1);
+
+    {
+        std::lock_guard<std::mutex> lock(_doneMutex);
+        _pendingIds.insert(id);
     }
 
-    // Wake up one thread
-    condition.notify_one();
+    Task task;
+    task.function = std::function<void()>(f);
+    task.id = id;
+    push(std::move(task));
+
+    return id;
 }
 
 /*************/
-// Global thread pool
-struct SThread
+template <class F>
+void ThreadPool::enqueueWithoutId(F f)
 {
-  public:
-    static ThreadPool pool;
-};
+    Task task;
+    task.function = std::function<void()>(f);
+    push(std::move(task));
+}
+
+/*************/
+template <class F>
+void TaskGroup::run(F f)
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        ++_pendingTasks;
+    }
+
+    ThreadPool::Task task;
+    task.function = std::function<void()>(f);
+    task.group = this;
+    _pool.push(std::move(task));
+}
 
 #endif // SPLASH_THREADPOOL_H
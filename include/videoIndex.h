@@ -0,0 +1,118 @@
+/*
+ * Copyright (C) 2017 Emmanuel Durand
+ *
+ * This file is part of Splash.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Splash is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Splash.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * @videoIndex.h
+ * The VideoIndex class, listing the frames and keyframes of a video stream
+ */
+
+#ifndef SPLASH_VIDEOINDEX_H
+#define SPLASH_VIDEOINDEX_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "config.h"
+
+namespace Splash
+{
+
+/*************/
+//! Presentation timestamps of all the frames of a video stream, with their keyframe flag.
+//! The index is saved next to the media file, and is considered valid as long as the media size and modification time do not change.
+class VideoIndex
+{
+  public:
+    struct Entry
+    {
+        int64_t pts{0};       //!< Presentation timestamp, in stream time base
+        bool keyframe{false}; //!< True if decoding can start from this frame
+    };
+
+    /**
+     * \brief Get the path of the index file for the given media
+     * \param mediaPath Media file path
+     * \return Return the index file path
+     */
+    static std::string getIndexPath(const std::string& mediaPath);
+
+    /**
+     * \brief Load the index of the given media
+     * \param mediaPath Media file path
+     * \return Return false if there is no index, or if it does not match the media anymore
+     */
+    bool load(const std::string& mediaPath);
+
+    /**
+     * \brief Save the index next to the given media
+     * \param mediaPath Media file path
+     * \return Return false if the index could not be written
+     */
+    bool save(const std::string& mediaPath) const;
+
+    /**
+     * \brief Set the entries, which are sorted by timestamp
+     * \param entries Index entries
+     */
+    void setEntries(std::vector<Entry>&& entries);
+
+    /**
+     * \brief Get the number of indexed frames
+     * \return Return the frame count
+     */
+    size_t size() const { return _entries.size(); }
+
+    /**
+     * \brief Tell whether the index holds any keyframe
+     * \return Return true if the index can not be used for seeking
+     */
+    bool empty() const { return _keyframeCount == 0; }
+
+    /**
+     * \brief Find the first frame at or after a timestamp
+     * \param pts Timestamp
+     * \return Return the frame timestamp, or the last frame timestamp if pts is past the end
+     */
+    int64_t findFrame(int64_t pts) const;
+
+    /**
+     * \brief Find the last keyframe at or before a timestamp
+     * \param pts Timestamp
+     * \return Return the keyframe timestamp, or the first keyframe timestamp if none is before pts
+     */
+    int64_t findKeyframe(int64_t pts) const;
+
+  private:
+    std::vector<Entry> _entries{};
+    size_t _keyframeCount{0};
+
+    /**
+     * \brief Get the size and modification time of a file
+     * \param path File path
+     * \param size Set to the file size
+     * \param modificationTime Set to the modification time
+     * \return Return false if the file does not exist
+     */
+    static bool getFileStamp(const std::string& path, uint64_t& size, int64_t& modificationTime);
+};
+
+} // end of namespace
+
+#endif // SPLASH_VIDEOINDEX_H
@@ -25,12 +25,16 @@
 #ifndef SPLASH_WORLD_H
 #define SPLASH_WORLD_H
 
+#include <atomic>
 #include <condition_variable>
+#include <deque>
 #include <glm/glm.hpp>
 #include <mutex>
 #include <signal.h>
 #include <string>
 #include <thread>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 #include "./config.h"
@@ -97,13 +101,17 @@ class World : public RootObject
     struct sigaction _signals; //!< System signals
     std::string _executionPath{""};
     std::mutex _configurationMutex;
-    bool _enforceCoreAffinity{false}; //!< If true, World and Scenes have their affinity fixed in specific, separate cores
-    bool _enforceRealtime{false};     //!< If true, realtime scheduling is asked to the system, if possible
+    bool _enforceCoreAffinity{false};  //!< If true, World and Scenes have their affinity fixed in specific, separate cores
+    bool _enforceRealtime{false};      //!< If true, realtime scheduling is asked to the system, if possible
+    std::string _threadPlacement{"manual"}; //!< Thread placement mode, either "manual" or "auto"
+    bool _threadPlacementRealtime{false};   //!< If true, render and upload threads are set to SCHED_FIFO by the automatic placement
+    bool _sharedMemoryTransport{true}; //!< If true, buffers are sent to the Scenes through shared memory
 
     // World parameters
     unsigned int _worldFramerate{60}; //!< World framerate, default 60, because synchronous tasks need the loop to run
     std::string _blendingMode{};      //!< Blending mode: can be none, once or continuous
     bool _runInBackground{false};     //!< If true, no window will be created
+    int _tcpPort{0};                  //!< If not zero, TCP port to listen to for remote Scenes
 
     std::map<std::string, int> _scenes; //!< Map holding the PID of the Scene processes
     std::string _masterSceneName{""};   //!< Name of the master Scene
@@ -113,6 +121,14 @@ class World : public RootObject
     std::atomic_int _nextId{0};
     std::map<std::string, std::vector<std::string>> _objectDest;
 
+    uint64_t _loopIndex{0};                                             //!< Number of world loops run so far
+    std::unordered_map<std::string, unsigned long long> _sentDurations; //!< Durations last sent to the master Scene
+
+    std::mutex _buffersInFlightMutex{};
+    std::unordered_set<std::string> _buffersInFlight{};   //!< Distant names of the buffers being serialized or sent
+    std::deque<std::unique_ptr<TaskGraph>> _frameGraphs{}; //!< Task graphs of the previous loops which may still be running
+    std::atomic<int64_t> _sendDuration{0};                 //!< Time taken to serialize and send the buffers of the last finished loop, in us
+
     std::string _configFilename;  //!< Configuration file path
     std::string _projectFilename; //!< Project configuration file path
     Json::Value _config;          //!< Configuration as JSon
@@ -188,6 +204,11 @@ class World : public RootObject
      */
     void init();
 
+    /**
+     * \brief Compute the thread placement of the World and of the local Scenes from the CPU topology, and send it to them
+     */
+    void applyThreadPlacement();
+
     /**
      * \brief Handle the exit signal messages
      */
@@ -40,6 +40,9 @@ AttributeFunctor& AttributeFunctor::operator=(AttributeFunctor&& a)
         _valuesTypes = move(a._valuesTypes);
         _defaultSetAndGet = move(a._defaultSetAndGet);
         _doUpdateDistant = move(a._doUpdateDistant);
+        _version = a._version.load();
+        _distantVersion = a._distantVersion;
+        _distantValues = move(a._distantValues);
         _savable = move(a._savable);
     }
 
@@ -61,6 +64,7 @@ bool AttributeFunctor::operator()(const Values& args)
         for (const auto& a : args)
             _valuesTypes.push_back(a.getTypeAsChar());
 
+        ++_version;
         return true;
     }
     else if (!_setFunc)
@@ -89,7 +93,11 @@ bool AttributeFunctor::operator()(const Values& args)
         }
     }
 
-    return _setFunc(forward<const Values&>(args));
+    if (!_setFunc(forward<const Values&>(args)))
+        return false;
+
+    ++_version;
+    return true;
 }
 
 /*************/
@@ -108,6 +116,18 @@ Values AttributeFunctor::operator()() const
     return _getFunc();
 }
 
+/*************/
+bool AttributeFunctor::updateDistantValues(const Values& values)
+{
+    uint64_t version = _version;
+    if (version == _distantVersion && values == _distantValues)
+        return false;
+
+    _distantVersion = version;
+    _distantValues = values;
+    return true;
+}
+
 /*************/
 Values AttributeFunctor::getArgsTypes() const
 {
@@ -242,7 +262,7 @@ unordered_map<string, Values> BaseObject::getAttributes(bool includeDistant) con
 }
 
 /*************/
-unordered_map<string, Values> BaseObject::getDistantAttributes() const
+unordered_map<string, Values> BaseObject::getDistantAttributes(bool all)
 {
     unordered_map<string, Values> attribs;
     for (auto& attr : _attribFunctions)
@@ -254,6 +274,9 @@ unordered_map<string, Values> BaseObject::getDistantAttributes() const
         if (getAttribute(attr.first, values, false, true) == false || values.size() == 0)
             continue;
 
+        if (!attr.second.updateDistantValues(values) && !all)
+            continue;
+
         attribs[attr.first] = values;
     }
 
@@ -494,6 +517,7 @@ void BufferObject::setSerializedObject(shared_ptr<SerializedObject> obj)
 void BufferObject::updateTimestamp()
 {
     _timestamp = Timer::getTime();
+    ++_frameId;
     _updatedBuffer = true;
     auto root = _root.lock();
     if (root)
@@ -656,6 +680,15 @@ void RootObject::registerAttributes()
         _answerCondition.notify_one();
         return true;
     });
+
+    addAttribute("bufferPoolStats",
+        [&](const Values& args) { return false; },
+        [&]() -> Values {
+            auto stats = BufferPool::get().getStats();
+            return {stats.hitRate(), (int64_t)stats.hits, (int64_t)stats.misses, (int64_t)stats.recycled, (int64_t)stats.freed, (int64_t)stats.cachedBytes};
+        });
+    setAttributeParameter("bufferPoolStats", false, false);
+    setAttributeDescription("bufferPoolStats", "Hit rate of the buffer pool, followed by its hit, miss, recycled and freed counts, and the bytes it currently holds");
 }
 
 /*************/
@@ -684,6 +717,7 @@ Values RootObject::sendMessageWithAnswer(const string& name, const string& attri
 
     unique_lock<mutex> conditionLock(_conditionMutex);
     _link->sendMessage(name, attribute, message);
+    _link->flushMessageBatch(); // The answer would never come if the message was held in a batch
 
     auto cvStatus = cv_status::no_timeout;
     if (timeout == 0ull)
@@ -0,0 +1,499 @@
+#include "./blockCompressor.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <sstream>
+#include <sys/stat.h>
+
+#include "./log.h"
+#include "./osUtils.h"
+#include "./threadpool.h"
+
+#define SPLASH_BLOCK_CACHE_DIR "splash/compressed/"
+
+using namespace std;
+
+namespace Splash
+{
+
+namespace
+{
+/*************/
+// Find the extremities of the block along its principal axis, for the N first channels
+template <int N>
+void findEndpoints(const uint8_t* block, float* e0, float* e1)
+{
+    float mean[N] = {0.f};
+    for (int p = 0; p < 16; ++p)
+        for (int c = 0; c < N; ++c)
+            mean[c] += block[p * 4 + c];
+    for (int c = 0; c < N; ++c)
+        mean[c] /= 16.f;
+
+    float cov[N][N] = {{0.f}};
+    for (int p = 0; p < 16; ++p)
+        for (int i = 0; i < N; ++i)
+            for (int j = 0; j < N; ++j)
+                cov[i][j] += (block[p * 4 + i] - mean[i]) * (block[p * 4 + j] - mean[j]);
+
+    // A few power iterations are enough to get close to the main eigenvector
+    float axis[N];
+    for (int c = 0; c < N; ++c)
+        axis[c] = 1.f;
+    for (int iteration = 0; iteration < 8; ++iteration)
+    {
+        float next[N] = {0.f};
+        float norm = 0.f;
+        for (int i = 0; i < N; ++i)
+        {
+            for (int j = 0; j < N; ++j)
+                next[i] += cov[i][j] * axis[j];
+            norm = max(norm, abs(next[i]));
+        }
+        if (norm < FLT_EPSILON)
+            break;
+        for (int c = 0; c < N; ++c)
+            axis[c] = next[c] / norm;
+    }
+
+    float length = 0.f;
+    for (int c = 0; c < N; ++c)
+        length += axis[c] * axis[c];
+    length = sqrt(length);
+
+    float minT = 0.f, maxT = 0.f;
+    if (length > FLT_EPSILON)
+    {
+        for (int c = 0; c < N; ++c)
+            axis[c] /= length;
+
+        minT = FLT_MAX;
+        maxT = -FLT_MAX;
+        for (int p = 0; p < 16; ++p)
+        {
+            float t = 0.f;
+            for (int c = 0; c < N; ++c)
+                t += (block[p * 4 + c] - mean[c]) * axis[c];
+            minT = min(minT, t);
+            maxT = max(maxT, t);
+        }
+    }
+
+    for (int c = 0; c < N; ++c)
+    {
+        e0[c] = min(max(mean[c] + axis[c] * minT, 0.f), 255.f);
+        e1[c] = min(max(mean[c] + axis[c] * maxT, 0.f), 255.f);
+    }
+}
+
+/*************/
+uint16_t toRGB565(const float* color)
+{
+    auto r = static_cast<uint16_t>(lround(color[0] * 31.f / 255.f));
+    auto g = static_cast<uint16_t>(lround(color[1] * 63.f / 255.f));
+    auto b = static_cast<uint16_t>(lround(color[2] * 31.f / 255.f));
+    return (r << 11) | (g << 5) | b;
+}
+
+/*************/
+void fromRGB565(uint16_t value, int* color)
+{
+    int r = (value >> 11) & 31;
+    int g = (value >> 5) & 63;
+    int b = value & 31;
+    color[0] = (r << 3) | (r >> 2);
+    color[1] = (g << 2) | (g >> 4);
+    color[2] = (b << 3) | (b >> 2);
+}
+
+/*************/
+// Color part of BC1 and BC3 blocks, always in four colors mode
+void compressColorBlock(const uint8_t* block, uint8_t* output)
+{
+    float e0[3], e1[3];
+    findEndpoints<3>(block, e0, e1);
+
+    auto color0 = toRGB565(e1);
+    auto color1 = toRGB565(e0);
+    if (color0 < color1)
+        swap(color0, color1);
+
+    int palette[4][3];
+    fromRGB565(color0, palette[0]);
+    fromRGB565(color1, palette[1]);
+    for (int c = 0; c < 3; ++c)
+    {
+        palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+        palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+    }
+
+    // With equal endpoints, the block is in three colors mode and every pixel uses the first color
+    uint32_t indices = 0;
+    if (color0 != color1)
+    {
+        for (int p = 0; p < 16; ++p)
+        {
+            int bestIndex = 0;
+            int bestError = INT32_MAX;
+            for (int i = 0; i < 4; ++i)
+            {
+                int error = 0;
+                for (int c = 0; c < 3; ++c)
+                {
+                    int diff = block[p * 4 + c] - palette[i][c];
+                    error += diff * diff;
+                }
+                if (error < bestError)
+                {
+                    bestError = error;
+                    bestIndex = i;
+                }
+            }
+            indices |= static_cast<uint32_t>(bestIndex) << (2 * p);
+        }
+    }
+
+    output[0] = color0 & 0xFF;
+    output[1] = color0 >> 8;
+    output[2] = color1 & 0xFF;
+    output[3] = color1 >> 8;
+    for (int i = 0; i < 4; ++i)
+        output[4 + i] = (indices >> (8 * i)) & 0xFF;
+}
+
+/*************/
+// Writes values to a block, least significant bits first
+class BitWriter
+{
+  public:
+    BitWriter(uint8_t* output)
+        : _output(output)
+    {
+    }
+
+    void write(uint32_t value, int bits)
+    {
+        for (int b = 0; b < bits; ++b, ++_position)
+            if ((value >> b) & 1)
+                _output[_position / 8] |= 1 << (_position % 8);
+    }
+
+  private:
+    uint8_t* _output;
+    int _position{0};
+};
+} // end of anonymous namespace
+
+/*************/
+BlockCompressor::Codec BlockCompressor::codecFromString(const string& name)
+{
+    if (name == "bc1")
+        return Codec::BC1;
+    else if (name == "bc3")
+        return Codec::BC3;
+    else if (name == "bc7")
+        return Codec::BC7;
+    else
+        return Codec::None;
+}
+
+/*************/
+string BlockCompressor::codecToString(Codec codec)
+{
+    switch (codec)
+    {
+    default:
+    case Codec::None:
+        return "";
+    case Codec::BC1:
+        return "bc1";
+    case Codec::BC3:
+        return "bc3";
+    case Codec::BC7:
+        return "bc7";
+    }
+}
+
+/*************/
+unique_ptr<ImageBuffer> BlockCompressor::compress(const ImageBuffer& image, Codec codec)
+{
+    auto spec = image.getSpec();
+    if (codec == Codec::None || spec.type != ImageBufferSpec::Type::UINT8 || spec.channels != 4 || spec.format != "RGBA")
+        return nullptr;
+    if (spec.width == 0 || spec.height == 0 || spec.width % 4 != 0 || spec.height % 4 != 0)
+        return nullptr;
+
+    // Compressed images are stored as single channel images of the same size as their data, as for Hap frames
+    ImageBufferSpec outputSpec;
+    int blockSize = 16;
+    if (codec == Codec::BC1)
+    {
+        outputSpec = ImageBufferSpec(spec.width, spec.height / 2, 1, 8, ImageBufferSpec::Type::UINT8);
+        outputSpec.format = "RGB_DXT1";
+        blockSize = 8;
+    }
+    else
+    {
+        outputSpec = ImageBufferSpec(spec.width, spec.height, 1, 8, ImageBufferSpec::Type::UINT8);
+        outputSpec.format = codec == Codec::BC3 ? "RGBA_DXT5" : "RGBA_BC7";
+    }
+    outputSpec.videoFrame = false;
+
+    auto output = unique_ptr<ImageBuffer>(new ImageBuffer(outputSpec));
+    auto input = reinterpret_cast<const uint8_t*>(image.data());
+    auto compressed = reinterpret_cast<uint8_t*>(output->data());
+    int blocksX = spec.width / 4;
+    int blocksY = spec.height / 4;
+
+    SThread::pool.parallelFor(0, blocksY, [&](size_t begin, size_t end) {
+        uint8_t block[64];
+        for (size_t y = begin; y < end; ++y)
+        {
+            for (int x = 0; x < blocksX; ++x)
+            {
+                for (int row = 0; row < 4; ++row)
+                    memcpy(block + row * 16, input + ((y * 4 + row) * spec.width + x * 4) * 4, 16);
+                compressBlock(block, compressed + (y * blocksX + x) * blockSize, codec);
+            }
+        }
+    });
+
+    return output;
+}
+
+/*************/
+void BlockCompressor::compressBlock(const uint8_t* block, uint8_t* output, Codec codec)
+{
+    switch (codec)
+    {
+    default:
+        return;
+    case Codec::BC1:
+        compressBlockBC1(block, output);
+        return;
+    case Codec::BC3:
+        compressBlockBC3(block, output);
+        return;
+    case Codec::BC7:
+        compressBlockBC7(block, output);
+        return;
+    }
+}
+
+/*************/
+void BlockCompressor::compressBlockBC1(const uint8_t* block, uint8_t* output)
+{
+    compressColorBlock(block, output);
+}
+
+/*************/
+void BlockCompressor::compressBlockBC3(const uint8_t* block, uint8_t* output)
+{
+    int alphaMin = 255, alphaMax = 0;
+    for (int p = 0; p < 16; ++p)
+    {
+        alphaMin = min<int>(alphaMin, block[p * 4 + 3]);
+        alphaMax = max<int>(alphaMax, block[p * 4 + 3]);
+    }
+
+    // The alpha ramp goes from alpha1 (min) to alpha0 (max) in eight steps, whose indices are not in ramp order
+    uint64_t indices = 0;
+    if (alphaMax != alphaMin)
+    {
+        for (int p = 0; p < 16; ++p)
+        {
+            auto step = static_cast<int>(lround((block[p * 4 + 3] - alphaMin) * 7.f / (alphaMax - alphaMin)));
+            uint64_t index = step == 7 ? 0 : (step == 0 ? 1 : 8 - step);
+            indices |= index << (3 * p);
+        }
+    }
+
+    output[0] = alphaMax;
+    output[1] = alphaMin;
+    for (int i = 0; i < 6; ++i)
+        output[2 + i] = (indices >> (8 * i)) & 0xFF;
+
+    compressColorBlock(block, output + 8);
+}
+
+/*************/
+void BlockCompressor::compressBlockBC7(const uint8_t* block, uint8_t* output)
+{
+    // Mode 6: a single subset, RGBA endpoints on 7 bits plus a p-bit each, and 4 bits indices
+    static const int weights[16] = {0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+
+    float e0[4], e1[4];
+    findEndpoints<4>(block, e0, e1);
+
+    auto quantize = [](const float* endpoint, int* quantized, int& pbit) {
+        float bestError = FLT_MAX;
+        for (int p = 0; p < 2; ++p)
+        {
+            int values[4];
+            float error = 0.f;
+            for (int c = 0; c < 4; ++c)
+            {
+                values[c] = min(max(static_cast<int>(lround((endpoint[c] - p) / 2.f)), 0), 127);
+                auto diff = static_cast<float>(values[c] * 2 + p) - endpoint[c];
+                error += diff * diff;
+            }
+            if (error < bestError)
+            {
+                bestError = error;
+                pbit = p;
+                copy(values, values + 4, quantized);
+            }
+        }
+    };
+
+    int q0[4], q1[4];
+    int p0 = 0, p1 = 0;
+    quantize(e0, q0, p0);
+    quantize(e1, q1, p1);
+
+    int palette[16][4];
+    for (int i = 0; i < 16; ++i)
+        for (int c = 0; c < 4; ++c)
+            palette[i][c] = ((64 - weights[i]) * (q0[c] * 2 + p0) + weights[i] * (q1[c] * 2 + p1) + 32) >> 6;
+
+    int indices[16];
+    for (int p = 0; p < 16; ++p)
+    {
+        int bestError = INT32_MAX;
+        for (int i = 0; i < 16; ++i)
+        {
+            int error = 0;
+            for (int c = 0; c < 4; ++c)
+            {
+                int diff = block[p * 4 + c] - palette[i][c];
+                error += diff * diff;
+            }
+            if (error < bestError)
+            {
+                bestError = error;
+                indices[p] = i;
+            }
+        }
+    }
+
+    // The most significant bit of the first index is implicitly zero, which is ensured by swapping the endpoints
+    if (indices[0] & 8)
+    {
+        swap(q0, q1);
+        swap(p0, p1);
+        for (auto& index : indices)
+            index = 15 - index;
+    }
+
+    memset(output, 0, 16);
+    BitWriter writer(output);
+    writer.write(1 << 6, 7);
+    for (int c = 0; c < 4; ++c)
+    {
+        writer.write(q0[c], 7);
+        writer.write(q1[c], 7);
+    }
+    writer.write(p0, 1);
+    writer.write(p1, 1);
+    writer.write(indices[0], 3);
+    for (int p = 1; p < 16; ++p)
+        writer.write(indices[p], 4);
+}
+
+/*************/
+string BlockCompressor::getCachePath(const string& filepath, Codec codec)
+{
+    struct stat fileStat;
+    if (stat(filepath.c_str(), &fileStat) != 0)
+        return "";
+
+    string cacheRoot;
+    if (getenv("XDG_CACHE_HOME"))
+        cacheRoot = string(getenv("XDG_CACHE_HOME")) + "/";
+    else
+        cacheRoot = Utils::getHomePath() + "/.cache/";
+
+    ostringstream path;
+    path << cacheRoot << SPLASH_BLOCK_CACHE_DIR << hex << hash<string>()(filepath) << dec << "_" << fileStat.st_mtime << "_" << codecToString(codec);
+    return path.str();
+}
+
+/*************/
+unique_ptr<ImageBuffer> BlockCompressor::loadFromCache(const string& filepath, Codec codec)
+{
+    auto cachePath = getCachePath(filepath, codec);
+    if (cachePath.empty())
+        return nullptr;
+
+    ifstream file(cachePath, ios::binary);
+    if (!file.is_open())
+        return nullptr;
+
+    ImageBufferSpec::FrameHeader header;
+    file.read(reinterpret_cast<char*>(&header), sizeof(header));
+    ImageBufferSpec spec;
+    if (!file || !spec.fromFrameHeader(header) || !spec.isCompressed())
+        return nullptr;
+
+    spec.videoFrame = false;
+    auto image = unique_ptr<ImageBuffer>(new ImageBuffer(spec));
+    file.read(image->data(), spec.rawSize());
+    if (!file)
+        return nullptr;
+
+    return image;
+}
+
+/*************/
+bool BlockCompressor::saveToCache(const string& filepath, Codec codec, const ImageBuffer& image)
+{
+    auto cachePath = getCachePath(filepath, codec);
+    if (cachePath.empty())
+        return false;
+
+    // Create the cache directory, one level at a time
+    auto cacheDir = cachePath.substr(0, cachePath.rfind('/') + 1);
+    for (size_t slash = cacheDir.find('/', 1); slash != string::npos; slash = cacheDir.find('/', slash + 1))
+        mkdir(cacheDir.substr(0, slash).c_str(), 0755);
+
+    // Previous versions of the same source are removed
+    auto cacheName = cachePath.substr(cacheDir.size());
+    auto keyPrefix = cacheName.substr(0, cacheName.find('_') + 1);
+    auto codecSuffix = "_" + codecToString(codec);
+    for (const auto& name : Utils::listDirContent(cacheDir))
+    {
+        if (name != cacheName && name.find(keyPrefix) == 0 && name.size() > codecSuffix.size() && name.substr(name.size() - codecSuffix.size()) == codecSuffix)
+            remove((cacheDir + name).c_str());
+    }
+
+    // The file is written aside then renamed, so that a partially written file is never read
+    auto tmpPath = cachePath + ".tmp";
+    {
+        ofstream file(tmpPath, ios::binary | ios::trunc);
+        if (!file.is_open())
+        {
+            Log::get() << Log::WARNING << "BlockCompressor::" << __FUNCTION__ << " - Unable to write cache file " << tmpPath << Log::endl;
+            return false;
+        }
+
+        auto header = image.getSpec().toFrameHeader(0, 0);
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(image.data(), image.getSize());
+        if (!file)
+        {
+            Log::get() << Log::WARNING << "BlockCompressor::" << __FUNCTION__ << " - Error while writing cache file " << tmpPath << Log::endl;
+            file.close();
+            remove(tmpPath.c_str());
+            return false;
+        }
+    }
+
+    return rename(tmpPath.c_str(), cachePath.c_str()) == 0;
+}
+
+} // end of namespace
@@ -0,0 +1,219 @@
+#include "./bufferPool.h"
+
+#include <cstdlib>
+#include <sys/mman.h>
+
+#define SPLASH_BUFFER_POOL_ALIGNMENT 64
+#define SPLASH_BUFFER_POOL_HUGE_PAGE_SIZE (1 << 21)
+#define SPLASH_BUFFER_POOL_MIN_SIZE (1 << 16)
+#define SPLASH_BUFFER_POOL_MAX_BYTES (1ull << 29)
+#define SPLASH_BUFFER_POOL_MAX_PER_BUCKET 16
+
+using namespace std;
+
+namespace Splash
+{
+
+/*************/
+BufferPool::BufferPool()
+    : _maxCachedBytes(SPLASH_BUFFER_POOL_MAX_BYTES)
+{
+}
+
+/*************/
+size_t BufferPool::getAlignment()
+{
+    return SPLASH_BUFFER_POOL_ALIGNMENT;
+}
+
+/*************/
+bool BufferPool::isPooled(size_t size)
+{
+    return size >= SPLASH_BUFFER_POOL_MIN_SIZE;
+}
+
+/*************/
+size_t BufferPool::getBucketSize(size_t size)
+{
+    if (!isPooled(size))
+        return size;
+
+    size_t highestPower = 1;
+    while (highestPower <= size / 2)
+        highestPower <<= 1;
+    auto step = highestPower / 8;
+    return ((size + step - 1) / step) * step;
+}
+
+/*************/
+void* BufferPool::allocate(size_t size)
+{
+    if (!isPooled(size))
+        return allocateBlock(size);
+
+    auto bucketSize = getBucketSize(size);
+
+    {
+        lock_guard<mutex> lock(_mutex);
+        auto bucketIt = _buckets.find(bucketSize);
+        if (bucketIt != _buckets.end() && !bucketIt->second.empty())
+        {
+            auto ptr = bucketIt->second.back();
+            bucketIt->second.pop_back();
+            _stats.cachedBytes -= bucketSize;
+            ++_stats.hits;
+            return ptr;
+        }
+        ++_stats.misses;
+    }
+
+    return allocateBlock(bucketSize);
+}
+
+/*************/
+void BufferPool::release(void* ptr, size_t size)
+{
+    if (ptr == nullptr)
+        return;
+
+    if (!isPooled(size))
+    {
+        freeBlock(ptr, size);
+        return;
+    }
+
+    auto bucketSize = getBucketSize(size);
+
+    {
+        lock_guard<mutex> lock(_mutex);
+        auto& bucket = _buckets[bucketSize];
+        if (bucket.size() < SPLASH_BUFFER_POOL_MAX_PER_BUCKET && _stats.cachedBytes + bucketSize <= _maxCachedBytes)
+        {
+            bucket.push_back(ptr);
+            _stats.cachedBytes += bucketSize;
+            ++_stats.recycled;
+            return;
+        }
+        ++_stats.freed;
+    }
+
+    freeBlock(ptr, bucketSize);
+}
+
+/*************/
+void BufferPool::clear()
+{
+    lock_guard<mutex> lock(_mutex);
+    for (auto& bucket : _buckets)
+        for (auto ptr : bucket.second)
+            freeBlock(ptr, bucket.first);
+    _buckets.clear();
+    _stats.cachedBytes = 0;
+}
+
+/*************/
+BufferPool::Stats BufferPool::getStats() const
+{
+    lock_guard<mutex> lock(_mutex);
+    return _stats;
+}
+
+/*************/
+void BufferPool::setMaxCachedBytes(uint64_t size)
+{
+    lock_guard<mutex> lock(_mutex);
+    _maxCachedBytes = size;
+
+    // Free the smallest blocks first, bigger ones being the most costly to allocate
+    for (auto& bucket : _buckets)
+    {
+        while (_stats.cachedBytes > _maxCachedBytes && !bucket.second.empty())
+        {
+            freeBlock(bucket.second.back(), bucket.first);
+            bucket.second.pop_back();
+            _stats.cachedBytes -= bucket.first;
+            ++_stats.freed;
+        }
+    }
+}
+
+/*************/
+bool BufferPool::setHugePages(const string& policy)
+{
+    if (policy == "none")
+        _hugePages = HugePages::none;
+    else if (policy == "transparent")
+        _hugePages = HugePages::transparent;
+    else if (policy == "reserved")
+        _hugePages = HugePages::reserved;
+    else
+        return false;
+
+    return true;
+}
+
+/*************/
+string BufferPool::getHugePagesName() const
+{
+    switch (_hugePages.load())
+    {
+    default:
+    case HugePages::none:
+        return "none";
+    case HugePages::transparent:
+        return "transparent";
+    case HugePages::reserved:
+        return "reserved";
+    }
+}
+
+/*************/
+void* BufferPool::allocateBlock(size_t size)
+{
+    if (size == 0)
+        return nullptr;
+
+    if (size < SPLASH_BUFFER_POOL_HUGE_PAGE_SIZE)
+    {
+        void* ptr = nullptr;
+        if (posix_memalign(&ptr, SPLASH_BUFFER_POOL_ALIGNMENT, size) != 0)
+            return nullptr;
+        return ptr;
+    }
+
+    // Big blocks are mapped directly, with a length rounded to the huge page size so that they can be fully backed by huge pages
+    auto length = ((size + SPLASH_BUFFER_POOL_HUGE_PAGE_SIZE - 1) / SPLASH_BUFFER_POOL_HUGE_PAGE_SIZE) * SPLASH_BUFFER_POOL_HUGE_PAGE_SIZE;
+    auto policy = _hugePages.load();
+    void* ptr = MAP_FAILED;
+#ifdef MAP_HUGETLB
+    if (policy == HugePages::reserved)
+        ptr = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+#endif
+    if (ptr == MAP_FAILED)
+    {
+        ptr = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (ptr == MAP_FAILED)
+            return nullptr;
+#ifdef MADV_HUGEPAGE
+        if (policy != HugePages::none)
+            madvise(ptr, length, MADV_HUGEPAGE);
+#endif
+    }
+
+    return ptr;
+}
+
+/*************/
+void BufferPool::freeBlock(void* ptr, size_t size)
+{
+    if (size < SPLASH_BUFFER_POOL_HUGE_PAGE_SIZE)
+    {
+        free(ptr);
+        return;
+    }
+
+    auto length = ((size + SPLASH_BUFFER_POOL_HUGE_PAGE_SIZE - 1) / SPLASH_BUFFER_POOL_HUGE_PAGE_SIZE) * SPLASH_BUFFER_POOL_HUGE_PAGE_SIZE;
+    munmap(ptr, length);
+}
+
+} // end of namespace
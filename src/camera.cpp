@@ -250,11 +250,11 @@ bool Camera::doCalibration()
     vector<double> selectedValues(9);
 
     mutex gslMutex;
-    vector<unsigned int> threadIds;
+    TaskGroup tasks;
     // First step: we try a bunch of starts and keep the best one
     for (int index = 0; index < 4; ++index)
     {
-        threadIds.push_back(SThread::pool.enqueue([&]() {
+        tasks.run([&]() {
             gsl_multimin_fminimizer* minimizer;
             minimizer = gsl_multimin_fminimizer_alloc(minimizerType, 9);
 
@@ -310,9 +310,9 @@ bool Camera::doCalibration()
                 }
 
             gsl_multimin_fminimizer_free(minimizer);
-        }));
+        });
     }
-    SThread::pool.waitThreads(threadIds);
+    tasks.wait();
 
     // Second step: we improve on the best result from the previous step
     for (int index = 0; index < 8; ++index)
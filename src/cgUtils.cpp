@@ -8,13 +8,11 @@ namespace Splash
 /*************/
 void hapDecodeCallback(HapDecodeWorkFunction func, void* p, unsigned int count, void* info)
 {
-    std::vector<unsigned int> threadIds;
-    for (unsigned int i = 0; i < count; ++i)
-    {
-        threadIds.push_back(SThread::pool.enqueue([=]() { func(p, i); }));
-    }
-
-    SThread::pool.waitThreads(threadIds);
+    // Chunks are spread over the pool workers, the calling thread decompressing its own share
+    SThread::pool.parallelFor(0, count, [&](size_t begin, size_t end) {
+        for (auto i = begin; i < end; ++i)
+            func(p, static_cast<unsigned int>(i));
+    });
 }
 
 /*************/
@@ -32,7 +30,7 @@ bool hapDecodeFrame(void* in, unsigned int inSize, void* out, unsigned int outSi
     if (textureFormat == HapTextureFormat_RGB_DXT1)
         format = "RGB_DXT1";
     else if (textureFormat == HapTextureFormat_RGBA_DXT5)
-        format = "RGB_DXT5";
+        format = "RGBA_DXT5";
     else if (textureFormat == HapTextureFormat_YCoCg_DXT5)
         format = "YCoCg_DXT5";
     else
@@ -6,6 +6,7 @@
 
 #include "./log.h"
 #include "./osUtils.h"
+#include "./threadPlacement.h"
 
 using namespace std;
 
@@ -735,6 +736,7 @@ bool PythonEmbedded::run()
         return false;
 
     _loopThread = thread([&]() {
+        auto threadPlacement = ThreadPlacement::get().registerThread(ThreadPlacement::Class::background);
         _doLoop = true;
         loop();
     });
@@ -0,0 +1,183 @@
+#include "./decodeScheduler.h"
+
+#include <algorithm>
+#include <thread>
+
+#include "./log.h"
+#include "./osUtils.h"
+#include "./threadPlacement.h"
+
+#define SPLASH_DECODE_MAX_WORKERS 8
+#define SPLASH_DECODE_IDLE_WAIT_MS 5
+
+using namespace std;
+
+namespace Splash
+{
+
+constexpr int64_t DecodeScheduler::idle;
+
+/*************/
+DecodeScheduler::DecodeScheduler()
+{
+    auto cores = max(1, Utils::getCoreCount());
+    _workerCount = max(2, min(SPLASH_DECODE_MAX_WORKERS, cores / 2));
+    _codecThreadBudget = cores;
+}
+
+/*************/
+uint32_t DecodeScheduler::addSource(const function<bool()>& step, const function<int64_t()>& slack)
+{
+    lock_guard<mutex> lock(_mutex);
+    auto id = _nextSourceId++;
+    auto& source = _sources[id];
+    source.step = step;
+    source.slack = slack;
+
+    startWorkers();
+    _workCondition.notify_one();
+
+    return id;
+}
+
+/*************/
+void DecodeScheduler::removeSource(uint32_t id)
+{
+    unique_lock<mutex> lock(_mutex);
+    auto sourceIt = _sources.find(id);
+    if (sourceIt == _sources.end())
+        return;
+
+    // The source is marked as finished so that no worker picks it up while waiting
+    sourceIt->second.finished = true;
+    _stepCondition.wait(lock, [&]() { return !sourceIt->second.running; });
+    _sources.erase(sourceIt);
+}
+
+/*************/
+void DecodeScheduler::notify()
+{
+    _workCondition.notify_all();
+}
+
+/*************/
+int DecodeScheduler::acquireCodecThreads(int wanted)
+{
+    lock_guard<mutex> lock(_mutex);
+    auto granted = max(1, min(wanted, _codecThreadBudget - _codecThreadsInUse));
+    _codecThreadsInUse += granted;
+    return granted;
+}
+
+/*************/
+void DecodeScheduler::releaseCodecThreads(int count)
+{
+    lock_guard<mutex> lock(_mutex);
+    _codecThreadsInUse = max(0, _codecThreadsInUse - count);
+}
+
+/*************/
+void DecodeScheduler::setWorkerCount(unsigned int count)
+{
+    lock_guard<mutex> lock(_mutex);
+    _workerCount = max(1u, count);
+
+    if (_runningWorkers == 0)
+        return;
+
+    if (_runningWorkers > _workerCount)
+    {
+        _workersToStop = _runningWorkers - _workerCount;
+        _workCondition.notify_all();
+    }
+    else
+    {
+        _workersToStop = 0;
+        startWorkers();
+    }
+}
+
+/*************/
+unsigned int DecodeScheduler::getWorkerCount() const
+{
+    lock_guard<mutex> lock(_mutex);
+    return _workerCount;
+}
+
+/*************/
+void DecodeScheduler::setCodecThreadBudget(int budget)
+{
+    lock_guard<mutex> lock(_mutex);
+    _codecThreadBudget = max(1, budget);
+}
+
+/*************/
+int DecodeScheduler::getCodecThreadBudget() const
+{
+    lock_guard<mutex> lock(_mutex);
+    return _codecThreadBudget;
+}
+
+/*************/
+void DecodeScheduler::startWorkers()
+{
+    while (_runningWorkers - _workersToStop < _workerCount)
+    {
+        ++_runningWorkers;
+        thread([this]() {
+            auto threadPlacement = ThreadPlacement::get().registerThread(ThreadPlacement::Class::decode);
+            workerLoop();
+        }).detach();
+    }
+}
+
+/*************/
+void DecodeScheduler::workerLoop()
+{
+    unique_lock<mutex> lock(_mutex);
+    while (true)
+    {
+        if (_workersToStop > 0)
+        {
+            --_workersToStop;
+            --_runningWorkers;
+            return;
+        }
+
+        // Pick the source which is the closest to running out of frames
+        Source* nextSource = nullptr;
+        int64_t nextSlack = idle;
+        for (auto& source : _sources)
+        {
+            if (source.second.running || source.second.finished)
+                continue;
+            auto slack = source.second.slack();
+            if (slack < nextSlack)
+            {
+                nextSlack = slack;
+                nextSource = &source.second;
+            }
+        }
+
+        // Sources become runnable again when their frames are consumed, which does not always notify us
+        if (!nextSource)
+        {
+            _workCondition.wait_for(lock, chrono::milliseconds(SPLASH_DECODE_IDLE_WAIT_MS));
+            continue;
+        }
+
+        nextSource->running = true;
+        auto step = nextSource->step;
+        lock.unlock();
+        auto keepGoing = step();
+        lock.lock();
+
+        // Sources are only erased once they are not running, so the pointer is still valid
+        nextSource->running = false;
+        if (!keepGoing)
+            nextSource->finished = true;
+        _stepCondition.notify_all();
+    }
+}
+
+} // end of namespace
@@ -17,6 +17,7 @@
 #include "./image_gphoto.h"
 #endif
 #include "./image_ffmpeg.h"
+#include "./image_sequence.h"
 #if HAVE_OPENCV
 #include "./image_opencv.h"
 #endif
@@ -38,6 +39,7 @@
 #include "./queue.h"
 #include "./scene.h"
 #include "./texture.h"
+#include "./texture_array.h"
 #include "./texture_image.h"
 #if HAVE_OSX
 #include "./texture_syphon.h"
@@ -260,6 +262,18 @@ void Factory::registerObjects()
         BaseObject::Category::IMAGE,
         "video");
 
+    _objectBook["image_sequence"] = Page(
+        [&]() {
+            shared_ptr<BaseObject> object;
+            if (!_isScene)
+                object = dynamic_pointer_cast<BaseObject>(make_shared<Image_Sequence>(_root));
+            else
+                object = dynamic_pointer_cast<BaseObject>(make_shared<Image>(_root));
+            return object;
+        },
+        BaseObject::Category::IMAGE,
+        "image sequence");
+
 #if HAVE_GPHOTO
     _objectBook["image_gphoto"] = Page(
         [&]() {
@@ -350,6 +364,9 @@ void Factory::registerObjects()
         BaseObject::Category::IMAGE,
         "video queue");
 
+    _objectBook["texture_array"] =
+        Page([&]() { return dynamic_pointer_cast<BaseObject>(make_shared<Texture_Array>(_root)); }, BaseObject::Category::IMAGE, "array of same sized images");
+
 #if HAVE_OSX
     _objectBook["texture_syphon"] =
         Page([&]() { return dynamic_pointer_cast<BaseObject>(make_shared<Texture_Syphon>(_root)); }, BaseObject::Category::IMAGE, "texture image through Syphon");
@@ -188,6 +188,12 @@ void Filter::render()
 
     auto input = _inTextures[0].lock();
     _outTextureSpec = input->getSpec();
+    // The output covers the whole image even if only a region of it has been received
+    if (_outTextureSpec.hasRegion())
+    {
+        _outTextureSpec.width = _outTextureSpec.fullWidth;
+        _outTextureSpec.height = _outTextureSpec.fullHeight;
+    }
     _outTexture->resize(_outTextureSpec.width, _outTextureSpec.height);
     glViewport(0, 0, _outTextureSpec.width, _outTextureSpec.height);
 
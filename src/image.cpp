@@ -1,5 +1,7 @@
 #include "image.h"
 
+#include <algorithm>
+#include <cmath>
 #include <fstream>
 #include <memory>
 
@@ -13,8 +15,9 @@
 #include "threadpool.h"
 #include "timer.h"
 
-#define SPLASH_IMAGE_COPY_THREADS 2
-#define SPLASH_IMAGE_SERIALIZED_HEADER_SIZE 4096
+#define SPLASH_REGION_MARGIN 2
+#define SPLASH_REGION_MAX_RATIO 0.9f
+#define SPLASH_REGION_EXPIRY 5000000
 
 using namespace std;
 
@@ -94,6 +97,12 @@ ImageBufferSpec Image::getSpec() const
         return ImageBufferSpec();
 }
 
+/*************/
+bool Image::fitsLimitedBandwidth() const
+{
+    return getSpec().isCompressed();
+}
+
 /*************/
 void Image::set(const ImageBuffer& img)
 {
@@ -123,38 +132,54 @@ shared_ptr<SerializedObject> Image::serialize() const
     if (Timer::get().isDebug())
         Timer::get() << "serialize " + _name;
 
-    // We first get the xml version of the specs, and pack them into the obj
+    // We first pack the spec into a binary header, only the region sampled by the Scenes being sent
     if (!_image)
         return {};
-    string xmlSpec = _image->getSpec().to_string();
-    int nbrChar = xmlSpec.size();
-    int imgSize = _image->getSpec().rawSize();
-    int totalSize = SPLASH_IMAGE_SERIALIZED_HEADER_SIZE + imgSize;
+    auto spec = _image->getSpec();
+    auto regionSpec = getRegionSpec(spec);
+    auto header = regionSpec.toFrameHeader(_timestamp, _frameId);
+    int imgSize = regionSpec.rawSize();
+    int totalSize = header.headerSize + imgSize;
 
     auto obj = make_shared<SerializedObject>(totalSize);
-
-    auto currentObjPtr = obj->data();
-    const char* ptr = reinterpret_cast<const char*>(&nbrChar);
-    copy(ptr, ptr + sizeof(nbrChar), currentObjPtr);
-    currentObjPtr += sizeof(nbrChar);
-
-    const char* charPtr = reinterpret_cast<const char*>(xmlSpec.c_str());
-    copy(charPtr, charPtr + nbrChar, currentObjPtr);
-    currentObjPtr = obj->data() + SPLASH_IMAGE_SERIALIZED_HEADER_SIZE;
+    memcpy(obj->data(), &header, sizeof(header));
+    auto currentObjPtr = obj->data() + header.headerSize;
 
     // And then, the image
     const char* imgPtr = reinterpret_cast<const char*>(_image->data());
     if (imgPtr == NULL)
         return {};
 
-    vector<unsigned int> threadIds;
-    int stride = SPLASH_IMAGE_COPY_THREADS;
-    for (int i = 0; i < stride - 1; ++i)
+    if (!regionSpec.hasRegion() || spec.hasRegion())
+    {
+        SThread::pool.parallelCopy(currentObjPtr, imgPtr, imgSize);
+    }
+    else
     {
-        threadIds.push_back(SThread::pool.enqueue([=]() { copy(imgPtr + imgSize / stride * i, imgPtr + imgSize / stride * (i + 1), currentObjPtr + imgSize / stride * i); }));
+        // Copy the lines of the region, plane by plane. Regions are aligned on even pixels so that subsampled planes are cropped exactly
+        auto planes = spec.getPlanes();
+        auto regionPlanes = regionSpec.getPlanes();
+        for (size_t p = 0; p < planes.size(); ++p)
+        {
+            const auto& plane = planes[p];
+            const auto& regionPlane = regionPlanes[p];
+            if (plane.height == 0 || regionPlane.height == 0)
+                continue;
+
+            size_t lineSize = plane.size / plane.height;
+            size_t regionLineSize = regionPlane.size / regionPlane.height;
+            size_t pixelSize = lineSize / plane.width;
+            size_t offsetX = static_cast<size_t>(regionSpec.regionX) * plane.width / spec.width;
+            size_t offsetY = static_cast<size_t>(regionSpec.regionY) * plane.height / spec.height;
+
+            auto src = imgPtr + plane.offset + offsetY * lineSize + offsetX * pixelSize;
+            auto dst = currentObjPtr + regionPlane.offset;
+            SThread::pool.parallelFor(0, regionPlane.height, [&](size_t begin, size_t end) {
+                for (size_t y = begin; y < end; ++y)
+                    memcpy(dst + y * regionLineSize, src + y * lineSize, regionLineSize);
+            });
+        }
     }
-    copy(imgPtr + imgSize / stride * (stride - 1), imgPtr + imgSize, currentObjPtr + imgSize / stride * (stride - 1));
-    SThread::pool.waitThreads(threadIds);
 
     if (Timer::get().isDebug())
         Timer::get() >> "serialize " + _name;
@@ -162,40 +187,101 @@ shared_ptr<SerializedObject> Image::serialize() const
     return obj;
 }
 
+/*************/
+ImageBufferSpec Image::getRegionSpec(const ImageBufferSpec& spec) const
+{
+    if (!_cropToRegion || spec.hasRegion() || spec.width == 0 || spec.height == 0)
+        return spec;
+
+    // GPU-compressed images are stored in a layout which can not be cropped line by line
+    if (spec.isCompressed())
+        return spec;
+
+    array<float, 4> region;
+    {
+        lock_guard<mutex> lock(_regionMutex);
+        if (_regionsOfInterest.empty())
+            return spec;
+        region = getRegionsUnion();
+    }
+
+    // A small margin is kept around the region for texture filtering, and the bounds are aligned on even pixels
+    auto toPixels = [](float coord, uint32_t size, int margin, bool roundUp) {
+        auto pixel = static_cast<int64_t>(roundUp ? ceil(coord * size) : floor(coord * size)) + margin;
+        pixel = min<int64_t>(max<int64_t>(pixel, 0), size);
+        if (roundUp)
+            return static_cast<uint32_t>(min<int64_t>((pixel + 1) / 2 * 2, size));
+        else
+            return static_cast<uint32_t>(pixel / 2 * 2);
+    };
+    auto x0 = toPixels(region[0], spec.width, -SPLASH_REGION_MARGIN, false);
+    auto y0 = toPixels(region[1], spec.height, -SPLASH_REGION_MARGIN, false);
+    auto x1 = toPixels(region[2], spec.width, SPLASH_REGION_MARGIN, true);
+    auto y1 = toPixels(region[3], spec.height, SPLASH_REGION_MARGIN, true);
+    if (x1 <= x0 || y1 <= y0)
+        return spec;
+
+    // Not worth it if most of the image is needed anyway
+    if (static_cast<float>(x1 - x0) * static_cast<float>(y1 - y0) > SPLASH_REGION_MAX_RATIO * static_cast<float>(spec.width) * static_cast<float>(spec.height))
+        return spec;
+
+    auto regionSpec = spec;
+    regionSpec.width = x1 - x0;
+    regionSpec.height = y1 - y0;
+    regionSpec.regionX = x0;
+    regionSpec.regionY = y0;
+    regionSpec.fullWidth = spec.width;
+    regionSpec.fullHeight = spec.height;
+    return regionSpec;
+}
+
+/*************/
+array<float, 4> Image::getRegionsUnion() const
+{
+    array<float, 4> region{1.f, 1.f, 0.f, 0.f};
+    for (const auto& sceneRegion : _regionsOfInterest)
+    {
+        const auto& sceneBounds = sceneRegion.second.region;
+        region[0] = min(region[0], sceneBounds[0]);
+        region[1] = min(region[1], sceneBounds[1]);
+        region[2] = max(region[2], sceneBounds[2]);
+        region[3] = max(region[3], sceneBounds[3]);
+    }
+    return region;
+}
+
 /*************/
 bool Image::deserialize(const shared_ptr<SerializedObject>& obj)
 {
     if (obj.get() == nullptr || obj->size() == 0)
         return false;
 
+    // First, we read the header
+    ImageBufferSpec::FrameHeader header;
+    ImageBufferSpec spec;
+    if (obj->size() < sizeof(header))
+    {
+        Log::get() << Log::WARNING << "Image::" << __FUNCTION__ << " - Serialized object is too small to hold an image" << Log::endl;
+        return false;
+    }
+    memcpy(&header, obj->data(), sizeof(header));
+    if (!spec.fromFrameHeader(header) || obj->size() < header.headerSize + static_cast<size_t>(spec.rawSize()))
+    {
+        Log::get() << Log::WARNING << "Image::" << __FUNCTION__ << " - Invalid or unsupported image header" << Log::endl;
+        return false;
+    }
+
     if (Timer::get().isDebug())
         Timer::get() << "deserialize " + _name;
 
-    // First, we get the size of the metadata
-    int nbrChar;
-    char* ptr = reinterpret_cast<char*>(&nbrChar);
-
-    auto currentObjPtr = obj->data();
-    copy(currentObjPtr, currentObjPtr + sizeof(nbrChar), ptr);
-    currentObjPtr += sizeof(nbrChar);
-
     try
     {
-        char xmlSpecChar[nbrChar];
-        ptr = reinterpret_cast<char*>(xmlSpecChar);
-        copy(currentObjPtr, currentObjPtr + nbrChar, ptr);
-        currentObjPtr = obj->data() + SPLASH_IMAGE_SERIALIZED_HEADER_SIZE;
-        string xmlSpec(xmlSpecChar);
-
-        ImageBufferSpec spec;
-        spec.from_string(xmlSpec.c_str());
-
         ImageBufferSpec curSpec = _bufferDeserialize.getSpec();
         if (spec != curSpec)
             _bufferDeserialize = ImageBuffer(spec);
 
         auto rawBuffer = obj->grabData();
-        rawBuffer.shift(SPLASH_IMAGE_SERIALIZED_HEADER_SIZE);
+        rawBuffer.shift(header.headerSize);
         _bufferDeserialize.setRawBuffer(std::move(rawBuffer));
 
         if (!_bufferImage)
@@ -204,6 +290,7 @@ bool Image::deserialize(const shared_ptr<SerializedObject>& obj)
         _imageUpdated = true;
 
         updateTimestamp();
+        _frameId = header.frameId;
     }
     catch (...)
     {
@@ -236,22 +323,52 @@ bool Image::readFile(const string& filename)
         return false;
     }
 
-    int w, h, c;
-    // We force conversion to RGBA
-    uint8_t* rawImage = stbi_load(filename.c_str(), &w, &h, &c, 4);
+    // Block compressed images are cached, so that a given file is compressed only once
+    auto compression = _compression;
+    unique_ptr<ImageBuffer> cached;
+    if (compression != BlockCompressor::Codec::None && _compressionCache)
+        cached = BlockCompressor::loadFromCache(filename, compression);
 
-    if (!rawImage)
+    ImageBuffer img;
+    if (cached)
     {
-        Log::get() << Log::WARNING << "Image::" << __FUNCTION__ << " - Caught an error while opening image file " << filename << Log::endl;
-        return false;
+        std::swap(img, *cached);
     }
+    else
+    {
+        int w, h, c;
+        // We force conversion to RGBA
+        uint8_t* rawImage = stbi_load(filename.c_str(), &w, &h, &c, 4);
 
-    auto spec = ImageBufferSpec(w, h, 4, 32, ImageBufferSpec::Type::UINT8, "RGBA");
-    spec.videoFrame = false;
+        if (!rawImage)
+        {
+            Log::get() << Log::WARNING << "Image::" << __FUNCTION__ << " - Caught an error while opening image file " << filename << Log::endl;
+            return false;
+        }
 
-    auto img = ImageBuffer(spec);
-    memcpy(img.data(), rawImage, w * h * 4);
-    stbi_image_free(rawImage);
+        auto spec = ImageBufferSpec(w, h, 4, 32, ImageBufferSpec::Type::UINT8, "RGBA");
+        spec.videoFrame = false;
+
+        img = ImageBuffer(spec);
+        memcpy(img.data(), rawImage, w * h * 4);
+        stbi_image_free(rawImage);
+
+        if (compression != BlockCompressor::Codec::None)
+        {
+            auto compressed = BlockCompressor::compress(img, compression);
+            if (compressed)
+            {
+                if (_compressionCache)
+                    BlockCompressor::saveToCache(filename, compression, *compressed);
+                std::swap(img, *compressed);
+            }
+            else
+            {
+                Log::get() << Log::WARNING << "Image::" << __FUNCTION__ << " - Image size must be a multiple of 4 to be compressed, " << filename << " is kept uncompressed"
+                           << Log::endl;
+            }
+        }
+    }
 
     lock_guard<Spinlock> lock(_writeMutex);
     if (!_bufferImage)
@@ -271,7 +388,10 @@ void Image::zero()
     if (!_image)
         return;
 
-    _image->zero();
+    // The buffer may be shared with other sources (as with cached video frames), so it is replaced instead of overwritten
+    auto zeroImage = unique_ptr<ImageBuffer>(new ImageBuffer(_image->getSpec()));
+    zeroImage->zero();
+    _image.swap(zeroImage);
 }
 
 /*************/
@@ -395,6 +515,41 @@ void Image::registerAttributes()
         {'n'});
     setAttributeDescription("srgb", "Set to 1 if the image file is stored as sRGB");
 
+    addAttribute("compression",
+        [&](const Values& args) {
+            auto name = args[0].as<string>();
+            auto codec = BlockCompressor::codecFromString(name);
+            if (codec == BlockCompressor::Codec::None && name != "none")
+            {
+                Log::get() << Log::WARNING << "Image::" << __FUNCTION__ << " - Unknown compression " << name << ", should be none, bc1, bc3 or bc7" << Log::endl;
+                return false;
+            }
+
+            if (codec == _compression)
+                return true;
+            _compression = codec;
+
+            // A still image which is already loaded is read again, other image types do not read files this way
+            if (_type == "image" && !_filepath.empty() && !_isConnectedToRemote)
+                return readFile(_filepath);
+            return true;
+        },
+        [&]() -> Values { return {_compression == BlockCompressor::Codec::None ? "none" : BlockCompressor::codecToString(_compression)}; },
+        {'s'});
+    setAttributeParameter("compression", true, false);
+    setAttributeDescription("compression",
+        "GPU block compression applied to still images when loaded: none, bc1 (RGB), bc3 (RGBA) or bc7 (RGBA, better quality). Image size must be a multiple of 4");
+
+    addAttribute("compressionCache",
+        [&](const Values& args) {
+            _compressionCache = args[0].as<int>();
+            return true;
+        },
+        [&]() -> Values { return {_compressionCache}; },
+        {'n'});
+    setAttributeParameter("compressionCache", true, false);
+    setAttributeDescription("compressionCache", "If set to 1, compressed still images are cached on disk, keyed by file path and modification time");
+
     addAttribute("benchmark",
         [&](const Values& args) {
             if (args[0].as<int>() > 0)
@@ -415,6 +570,65 @@ void Image::registerAttributes()
         [&]() -> Values { return {false}; },
         {'n'});
     setAttributeDescription("pattern", "Set to 1 to replace the image with a pattern");
+
+    addAttribute("regionOfInterest",
+        [&](const Values& args) {
+            auto scene = args[0].as<string>();
+            array<float, 4> region{args[1].as<float>(), args[2].as<float>(), args[3].as<float>(), args[4].as<float>()};
+            for (auto& coord : region)
+                coord = min(max(coord, 0.f), 1.f);
+
+            bool unionChanged;
+            {
+                lock_guard<mutex> lock(_regionMutex);
+                auto previousUnion = getRegionsUnion();
+
+                // Scenes refresh their regions periodically, the ones which stopped doing so (i.e. disconnected) are forgotten
+                auto now = Timer::getTime();
+                for (auto regionIt = _regionsOfInterest.begin(); regionIt != _regionsOfInterest.end();)
+                {
+                    if (now - regionIt->second.time > SPLASH_REGION_EXPIRY)
+                        regionIt = _regionsOfInterest.erase(regionIt);
+                    else
+                        ++regionIt;
+                }
+
+                if (region[2] <= region[0] || region[3] <= region[1])
+                    _regionsOfInterest.erase(scene);
+                else
+                    _regionsOfInterest[scene] = {region, now};
+                unionChanged = getRegionsUnion() != previousUnion;
+            }
+
+            // The image has to be sent again to cover the new region, even if it did not change
+            if (unionChanged)
+                updateTimestamp();
+            return true;
+        },
+        [&]() -> Values {
+            Values regions;
+            lock_guard<mutex> lock(_regionMutex);
+            for (const auto& region : _regionsOfInterest)
+            {
+                const auto& bounds = region.second.region;
+                regions.push_back(Values({region.first, bounds[0], bounds[1], bounds[2], bounds[3]}));
+            }
+            return regions;
+        },
+        {'s', 'n', 'n', 'n', 'n'});
+    setAttributeParameter("regionOfInterest", false, false);
+    setAttributeDescription("regionOfInterest",
+        "Region of the image sampled by the given Scene, as normalized coordinates x0, y0, x1, y1. An empty region removes the Scene, as does a region not refreshed for 5 seconds");
+
+    addAttribute("cropToRegion",
+        [&](const Values& args) {
+            _cropToRegion = args[0].as<int>();
+            return true;
+        },
+        [&]() -> Values { return {_cropToRegion}; },
+        {'n'});
+    setAttributeParameter("cropToRegion", true, false);
+    setAttributeDescription("cropToRegion", "If set to 1, only the region of the image sampled by the Scenes is sent to them");
 }
 
 } // end of namespace
@@ -1,5 +1,8 @@
 #include "./imageBuffer.h"
 
+#include <cstring>
+#include <map>
+
 using namespace std;
 
 namespace Splash
@@ -100,6 +103,242 @@ void ImageBufferSpec::from_string(const string& spec)
     videoFrame = static_cast<bool>(stoi(roi.substr(0, curr)));
 }
 
+/*************/
+ImageBufferSpec::FrameHeader ImageBufferSpec::toFrameHeader(int64_t timestamp, uint64_t frameId) const
+{
+    FrameHeader header;
+    header.headerSize = sizeof(FrameHeader);
+    header.width = width;
+    header.height = height;
+    header.channels = channels;
+    header.bpp = bpp;
+    header.type = static_cast<uint8_t>(type);
+    header.videoFrame = static_cast<uint8_t>(videoFrame);
+    header.timestamp = timestamp;
+    header.frameId = frameId;
+    header.regionX = regionX;
+    header.regionY = regionY;
+    header.fullWidth = fullWidth;
+    header.fullHeight = fullHeight;
+
+    auto formatId = formatFromString(format);
+    header.format = static_cast<uint8_t>(formatId);
+    if (formatId == Format::Custom)
+        strncpy(header.formatName, format.c_str(), sizeof(header.formatName) - 1);
+
+    return header;
+}
+
+/*************/
+bool ImageBufferSpec::fromFrameHeader(const FrameHeader& header)
+{
+    if (header.magic != FrameHeader::MAGIC || header.version != FrameHeader::VERSION || header.headerSize < sizeof(FrameHeader))
+        return false;
+
+    switch (static_cast<Type>(header.type))
+    {
+    case Type::UINT8:
+    case Type::UINT16:
+    case Type::FLOAT:
+        break;
+    default:
+        return false;
+    }
+
+    width = header.width;
+    height = header.height;
+    channels = header.channels;
+    bpp = header.bpp;
+    type = static_cast<Type>(header.type);
+    videoFrame = static_cast<bool>(header.videoFrame);
+    regionX = header.regionX;
+    regionY = header.regionY;
+    fullWidth = header.fullWidth;
+    fullHeight = header.fullHeight;
+
+    auto formatId = static_cast<Format>(header.format);
+    if (formatId == Format::Custom)
+        format = string(header.formatName, strnlen(header.formatName, sizeof(header.formatName)));
+    else
+        format = formatToString(formatId);
+
+    return true;
+}
+
+/*************/
+ImageBufferSpec::Format ImageBufferSpec::formatFromString(const string& format)
+{
+    static const map<string, Format> formats{{"R", Format::R},
+        {"RG", Format::RG},
+        {"RGB", Format::RGB},
+        {"RGBA", Format::RGBA},
+        {"BGR", Format::BGR},
+        {"BGRA", Format::BGRA},
+        {"YUYV", Format::YUYV},
+        {"UYVY", Format::UYVY},
+        {"RGB_DXT1", Format::RGB_DXT1},
+        {"RGBA_DXT5", Format::RGBA_DXT5},
+        {"YCoCg_DXT5", Format::YCoCg_DXT5},
+        {"D", Format::D},
+        {"YUV420P", Format::YUV420P},
+        {"YUV422P", Format::YUV422P},
+        {"NV12", Format::NV12},
+        {"YUV420P10", Format::YUV420P10},
+        {"YUV422P10", Format::YUV422P10},
+        {"RGBA_BC7", Format::RGBA_BC7},
+        {"YUVJ420P", Format::YUVJ420P},
+        {"YUVJ422P", Format::YUVJ422P}};
+
+    auto formatIt = formats.find(format);
+    if (formatIt == formats.end())
+        return Format::Custom;
+    return formatIt->second;
+}
+
+/*************/
+string ImageBufferSpec::formatToString(Format format)
+{
+    switch (format)
+    {
+    default:
+    case Format::Custom:
+        return "";
+    case Format::R:
+        return "R";
+    case Format::RG:
+        return "RG";
+    case Format::RGB:
+        return "RGB";
+    case Format::RGBA:
+        return "RGBA";
+    case Format::BGR:
+        return "BGR";
+    case Format::BGRA:
+        return "BGRA";
+    case Format::YUYV:
+        return "YUYV";
+    case Format::UYVY:
+        return "UYVY";
+    case Format::RGB_DXT1:
+        return "RGB_DXT1";
+    case Format::RGBA_DXT5:
+        return "RGBA_DXT5";
+    case Format::YCoCg_DXT5:
+        return "YCoCg_DXT5";
+    case Format::D:
+        return "D";
+    case Format::YUV420P:
+        return "YUV420P";
+    case Format::YUV422P:
+        return "YUV422P";
+    case Format::NV12:
+        return "NV12";
+    case Format::YUV420P10:
+        return "YUV420P10";
+    case Format::YUV422P10:
+        return "YUV422P10";
+    case Format::RGBA_BC7:
+        return "RGBA_BC7";
+    case Format::YUVJ420P:
+        return "YUVJ420P";
+    case Format::YUVJ422P:
+        return "YUVJ422P";
+    }
+}
+
+/*************/
+bool ImageBufferSpec::isPlanar() const
+{
+    switch (formatFromString(format))
+    {
+    default:
+        return false;
+    case Format::YUV420P:
+    case Format::YUV422P:
+    case Format::NV12:
+    case Format::YUV420P10:
+    case Format::YUV422P10:
+    case Format::YUVJ420P:
+    case Format::YUVJ422P:
+        return true;
+    }
+}
+
+/*************/
+bool ImageBufferSpec::isFullRange() const
+{
+    auto formatId = formatFromString(format);
+    return formatId == Format::YUVJ420P || formatId == Format::YUVJ422P;
+}
+
+/*************/
+bool ImageBufferSpec::isCompressed() const
+{
+    switch (formatFromString(format))
+    {
+    default:
+        return false;
+    case Format::RGB_DXT1:
+    case Format::RGBA_DXT5:
+    case Format::YCoCg_DXT5:
+    case Format::RGBA_BC7:
+        return true;
+    }
+}
+
+/*************/
+vector<ImageBufferSpec::Plane> ImageBufferSpec::getPlanes() const
+{
+    auto formatId = formatFromString(format);
+    if (!isPlanar())
+    {
+        Plane plane;
+        plane.width = width;
+        plane.height = height;
+        plane.channels = channels;
+        plane.size = static_cast<size_t>(width) * height * pixelBytes();
+        return {plane};
+    }
+
+    size_t sampleBytes = type == Type::UINT16 ? 2 : 1;
+    uint32_t chromaWidth = (width + 1) / 2;
+    uint32_t chromaHeight = (formatId == Format::YUV422P || formatId == Format::YUV422P10 || formatId == Format::YUVJ422P) ? height : (height + 1) / 2;
+
+    vector<Plane> planes;
+    auto addPlane = [&](uint32_t w, uint32_t h, uint32_t c) {
+        Plane plane;
+        plane.width = w;
+        plane.height = h;
+        plane.channels = c;
+        plane.offset = planes.empty() ? 0 : planes.back().offset + planes.back().size;
+        plane.size = static_cast<size_t>(w) * h * c * sampleBytes;
+        planes.push_back(plane);
+    };
+
+    addPlane(width, height, 1);
+    if (formatId == Format::NV12)
+    {
+        addPlane(chromaWidth, chromaHeight, 2);
+    }
+    else
+    {
+        addPlane(chromaWidth, chromaHeight, 1);
+        addPlane(chromaWidth, chromaHeight, 1);
+    }
+
+    return planes;
+}
+
+/*************/
+int ImageBufferSpec::rawSize() const
+{
+    if (!isPlanar())
+        return pixelBytes() * width * height;
+
+    auto planes = getPlanes();
+    return planes.back().offset + planes.back().size;
+}
+
 /*************/
 ImageBuffer::ImageBuffer()
 {
@@ -111,6 +350,13 @@ ImageBuffer::ImageBuffer(const ImageBufferSpec& spec)
     init(spec);
 }
 
+/*************/
+ImageBuffer::ImageBuffer(const ImageBufferSpec& spec, ResizableArray<char>&& buffer)
+    : _spec(spec)
+    , _buffer(std::move(buffer))
+{
+}
+
 /*************/
 ImageBuffer::~ImageBuffer()
 {
@@ -121,8 +367,7 @@ void ImageBuffer::init(const ImageBufferSpec& spec)
 {
     _spec = spec;
 
-    uint32_t size = spec.width * spec.height * spec.pixelBytes();
-    _buffer.resize(size);
+    _buffer.resize(spec.rawSize());
 }
 
 /*************/
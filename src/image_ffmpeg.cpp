@@ -1,7 +1,10 @@
 #include "image_ffmpeg.h"
 
+#include <algorithm>
 #include <chrono>
+#include <cstring>
 #include <functional>
+#include <limits>
 #include <numeric>
 #if HAVE_LINUX
 #include <fcntl.h>
@@ -10,8 +13,10 @@
 #include <hap.h>
 
 #include "./cgUtils.h"
+#include "./decodeScheduler.h"
 #include "./log.h"
 #include "./osUtils.h"
+#include "./threadPlacement.h"
 #include "./threadpool.h"
 #include "./timer.h"
 
@@ -56,8 +61,11 @@ void Image_FFmpeg::freeFFmpegObjects()
     if (_continueRead)
     {
         _continueRead = false;
-        _readLoopThread.join();
+        DecodeScheduler::get().removeSource(_decodeSourceId);
+        _decodeSourceId = 0;
         _videoDisplayThread.join();
+        if (_indexThread.joinable())
+            _indexThread.join();
 #if HAVE_PORTAUDIO
         _audioThread.join();
         if (_speaker)
@@ -65,6 +73,19 @@ void Image_FFmpeg::freeFFmpegObjects()
 #endif
     }
 
+    closeDecoders();
+
+    _index.reset();
+    _seekTarget = -1;
+    _seekPending = false;
+
+    abortRecording();
+    _cachedClip.reset();
+    _loopCacheFailed = false;
+    _cacheIndex = 0;
+    _cacheAudioIndex = 0;
+    _loopOffset = 0;
+
     if (_avContext)
     {
         avformat_close_input(&_avContext);
@@ -108,13 +129,45 @@ bool Image_FFmpeg::read(const string& filename)
     }
 #endif
 
-    // Launch the loops
+    if (!openDecoders())
+    {
+        closeDecoders();
+        avformat_close_input(&_avContext);
+        return false;
+    }
+
+    // Launch the loops, decoding being handled by the shared scheduler
     _continueRead = true;
-    _videoDisplayThread = thread([&]() { videoDisplayLoop(); });
+    _bufferFull = false;
+    _queuedFrames = 0;
+    _displayQueueSize = 0;
+    _videoDisplayThread = thread([&]() {
+        auto threadPlacement = ThreadPlacement::get().registerThread(ThreadPlacement::Class::decode);
+        videoDisplayLoop();
+    });
 #if HAVE_PORTAUDIO
-    _audioThread = thread([&]() { audioLoop(); });
+    _audioThread = thread([&]() {
+        auto threadPlacement = ThreadPlacement::get().registerThread(ThreadPlacement::Class::decode);
+        audioLoop();
+    });
 #endif
-    _readLoopThread = thread([&]() { readLoop(); });
+
+    // Frame-exact seeks rely on an index of the video stream, built in the background if it is not found next to the file
+    auto index = make_shared<VideoIndex>();
+    if (index->load(_filepath))
+    {
+        _index = index;
+    }
+    else
+    {
+        // The path and stream index are copied, as closing the file resets them while the index is being built
+        _indexThread = thread([this, filepath = _filepath, videoStreamIndex = _videoStreamIndex]() {
+            auto threadPlacement = ThreadPlacement::get().registerThread(ThreadPlacement::Class::background);
+            buildIndex(filepath, videoStreamIndex);
+        });
+    }
+
+    _decodeSourceId = DecodeScheduler::get().addSource([this]() { return decodeStep(); }, [this]() { return getDecodeSlack(); });
 
     return true;
 }
@@ -197,7 +250,110 @@ bool Image_FFmpeg::setupAudioOutput(AVCodecContext* audioCodecContext)
 #endif
 
 /*************/
-void Image_FFmpeg::readLoop()
+string Image_FFmpeg::getNativeFormat(int pixelFormat, bool fullRange)
+{
+    // Only 8 bits planar formats have a full range variant, other full range frames go through swscale
+    switch (pixelFormat)
+    {
+    default:
+        return "";
+    case AV_PIX_FMT_YUV420P:
+        return fullRange ? "YUVJ420P" : "YUV420P";
+    case AV_PIX_FMT_YUVJ420P:
+        return "YUVJ420P";
+    case AV_PIX_FMT_YUV422P:
+        return fullRange ? "YUVJ422P" : "YUV422P";
+    case AV_PIX_FMT_YUVJ422P:
+        return "YUVJ422P";
+    case AV_PIX_FMT_NV12:
+        return fullRange ? "" : "NV12";
+    case AV_PIX_FMT_YUV420P10LE:
+        return fullRange ? "" : "YUV420P10";
+    case AV_PIX_FMT_YUV422P10LE:
+        return fullRange ? "" : "YUV422P10";
+    }
+}
+
+/*************/
+unique_ptr<ImageBuffer> Image_FFmpeg::copyNativeFrame(const AVFrame* frame, const string& format)
+{
+    auto is10Bits = format == "YUV420P10" || format == "YUV422P10";
+    auto is422 = format == "YUV422P" || format == "YUV422P10" || format == "YUVJ422P";
+    // bpp is the average size of a pixel, all planes included
+    uint8_t bpp = (is422 ? 16 : 12) * (is10Bits ? 2 : 1);
+    ImageBufferSpec spec(frame->width, frame->height, 3, bpp, is10Bits ? ImageBufferSpec::Type::UINT16 : ImageBufferSpec::Type::UINT8, format);
+    auto img = unique_ptr<ImageBuffer>(new ImageBuffer(spec));
+
+    size_t sampleBytes = is10Bits ? 2 : 1;
+    auto planes = spec.getPlanes();
+    for (size_t p = 0; p < planes.size(); ++p)
+    {
+        const auto& plane = planes[p];
+        auto rowBytes = plane.width * plane.channels * sampleBytes;
+        auto dst = img->data() + plane.offset;
+        auto src = reinterpret_cast<const char*>(frame->data[p]);
+
+        if (static_cast<size_t>(frame->linesize[p]) == rowBytes)
+        {
+            SThread::pool.parallelCopy(dst, src, plane.size);
+        }
+        else
+        {
+            SThread::pool.parallelFor(0, plane.height, [&](size_t first, size_t last) {
+                for (auto y = first; y < last; ++y)
+                    memcpy(dst + y * rowBytes, src + y * frame->linesize[p], rowBytes);
+            }, 64);
+        }
+    }
+
+    return img;
+}
+
+/*************/
+void Image_FFmpeg::buildIndex(const string& filepath, int videoStreamIndex)
+{
+    // A separate demuxer is used, so as not to disturb the decoding
+    AVFormatContext* context = nullptr;
+    if (avformat_open_input(&context, filepath.c_str(), nullptr, nullptr) != 0)
+        return;
+    if (avformat_find_stream_info(context, nullptr) < 0 || videoStreamIndex < 0 || videoStreamIndex >= static_cast<int>(context->nb_streams))
+    {
+        avformat_close_input(&context);
+        return;
+    }
+
+    vector<VideoIndex::Entry> entries;
+    AVPacket packet;
+    av_init_packet(&packet);
+    while (_continueRead && av_read_frame(context, &packet) >= 0)
+    {
+        if (packet.stream_index == videoStreamIndex)
+        {
+            auto pts = packet.pts != AV_NOPTS_VALUE ? packet.pts : packet.dts;
+            if (pts != AV_NOPTS_VALUE)
+                entries.push_back({pts, (packet.flags & AV_PKT_FLAG_KEY) != 0});
+        }
+        av_packet_unref(&packet);
+    }
+    avformat_close_input(&context);
+
+    // Interrupted, the index is incomplete
+    if (!_continueRead)
+        return;
+
+    auto index = make_shared<VideoIndex>();
+    index->setEntries(std::move(entries));
+    if (index->save(filepath))
+        Log::get() << Log::MESSAGE << "Image_FFmpeg::" << __FUNCTION__ << " - Indexed " << index->size() << " frames of file " << filepath << Log::endl;
+    else
+        Log::get() << Log::MESSAGE << "Image_FFmpeg::" << __FUNCTION__ << " - Could not write the index of file " << filepath << ", it will be built again next time" << Log::endl;
+
+    lock_guard<mutex> lock(_videoSeekMutex);
+    _index = index;
+}
+
+/*************/
+bool Image_FFmpeg::openDecoders()
 {
     // Find the first video stream
     _videoStreamIndex = -1;
@@ -217,7 +373,7 @@ void Image_FFmpeg::readLoop()
     if (_videoStreamIndex == -1)
     {
         Log::get() << Log::WARNING << "Image_FFmpeg::" << __FUNCTION__ << " - No video stream found in file " << _filepath << Log::endl;
-        return;
+        return false;
     }
 
 #if HAVE_PORTAUDIO
@@ -230,81 +386,84 @@ void Image_FFmpeg::readLoop()
     // Find a video decoder
     auto videoStream = _avContext->streams[_videoStreamIndex];
     auto videoCodecParameters = _avContext->streams[_videoStreamIndex]->codecpar;
-    auto videoCodecContext = avcodec_alloc_context3(nullptr);
-    if (avcodec_parameters_to_context(videoCodecContext, videoCodecParameters) < 0)
+    _videoCodecContext = avcodec_alloc_context3(nullptr);
+    if (avcodec_parameters_to_context(_videoCodecContext, videoCodecParameters) < 0)
     {
         Log::get() << Log::WARNING << "Image_FFmpeg::" << __FUNCTION__ << " - Unable to create a video context from the codec parameters from file " << _filepath << Log::endl;
-        return;
+        return false;
     }
 
     // Set video format info
     _videoFormat.resize(1024);
-    avcodec_string(const_cast<char*>(_videoFormat.data()), _videoFormat.size(), videoCodecContext, 0);
+    avcodec_string(const_cast<char*>(_videoFormat.data()), _videoFormat.size(), _videoCodecContext, 0);
 
-    videoCodecContext->thread_count = min(Utils::getCoreCount(), 16);
-    auto videoCodec = avcodec_find_decoder(videoCodecContext->codec_id);
-    auto isHap = false;
+    auto videoCodec = avcodec_find_decoder(_videoCodecContext->codec_id);
+    _isHap = false;
 
     // Check whether the video codec only has intra frames
-    auto desc = avcodec_descriptor_get(videoCodecContext->codec_id);
+    auto desc = avcodec_descriptor_get(_videoCodecContext->codec_id);
     if (desc)
         _intraOnly = !!(desc->props & AV_CODEC_PROP_INTRA_ONLY);
     else
         _intraOnly = false; // We don't know, so we consider it's not
 
-    auto fourcc = tagToFourCC(videoCodecContext->codec_tag);
+    auto fourcc = tagToFourCC(_videoCodecContext->codec_tag);
     if (fourcc.find("Hap") != string::npos)
     {
-        isHap = true;
+        _isHap = true;
         _intraOnly = true; // Hap is necessarily intra only
     }
     else if (videoCodec == nullptr)
     {
         Log::get() << Log::WARNING << "Image_FFmpeg::" << __FUNCTION__ << " - Video codec not supported for file " << _filepath << Log::endl;
-        return;
+        return false;
     }
 
     if (videoCodec)
     {
+        // Frame threading is limited by the budget shared by all the codecs of the process
+        _codecThreads = DecodeScheduler::get().acquireCodecThreads(min(Utils::getCoreCount(), 16));
+        _videoCodecContext->thread_count = _codecThreads;
+
         AVDictionary* optionsDict = nullptr;
-        if (avcodec_open2(videoCodecContext, videoCodec, &optionsDict) < 0)
+        if (avcodec_open2(_videoCodecContext, videoCodec, &optionsDict) < 0)
         {
             Log::get() << Log::WARNING << "Image_FFmpeg::" << __FUNCTION__ << " - Could not open video codec for file " << _filepath << Log::endl;
-            return;
+            return false;
         }
     }
 
 #if HAVE_PORTAUDIO
     // Find an audio decoder
     AVCodec* audioCodec{nullptr};
-    auto audioCodecContext = avcodec_alloc_context3(nullptr);
     if (_audioStreamIndex >= 0)
     {
+        _audioCodecContext = avcodec_alloc_context3(nullptr);
         auto audioCodecParameters = _avContext->streams[_audioStreamIndex]->codecpar;
-        if (avcodec_parameters_to_context(audioCodecContext, audioCodecParameters) < 0)
+        if (avcodec_parameters_to_context(_audioCodecContext, audioCodecParameters) < 0)
         {
             Log::get() << Log::WARNING << "Image_FFmpeg::" << __FUNCTION__ << " - Unable to create an audio context from the codec parameters for file " << _filepath << Log::endl;
-            return;
+            return false;
         }
 
-        audioCodec = avcodec_find_decoder(audioCodecContext->codec_id);
+        audioCodec = avcodec_find_decoder(_audioCodecContext->codec_id);
 
         if (audioCodec == nullptr)
         {
             Log::get() << Log::WARNING << "Image_FFmpeg::" << __FUNCTION__ << " - Audio codec not supported for file " << _filepath << Log::endl;
-            audioCodecContext = nullptr;
+            avcodec_free_context(&_audioCodecContext);
         }
         else
         {
             AVDictionary* audioOptionsDict = nullptr;
-            if (avcodec_open2(audioCodecContext, audioCodec, &audioOptionsDict) < 0)
+            if (avcodec_open2(_audioCodecContext, audioCodec, &audioOptionsDict) < 0)
             {
                 Log::get() << Log::WARNING << "Image_FFmpeg::" << __FUNCTION__ << " - Could not open audio codec for file " << _filepath << Log::endl;
-                audioCodecContext = nullptr;
+                avcodec_free_context(&_audioCodecContext);
             }
         }
 
-        if (audioCodecContext)
+        if (_audioCodecContext)
             _audioDeviceOutputUpdated = true;
 
         auto audioStream = _avContext->streams[_audioStreamIndex];
@@ -312,230 +471,445 @@ void Image_FFmpeg::readLoop()
     }
 #endif
 
-    // Start reading frames
-    AVFrame *frame, *rgbFrame;
-    frame = av_frame_alloc();
-    rgbFrame = av_frame_alloc();
-
-    if (!frame || !rgbFrame)
+    // Allocate the frames, formats which are not handled natively being converted to YUYV.
+    // The conversion is set up on the first such frame
+    _frame = av_frame_alloc();
+    _rgbFrame = av_frame_alloc();
+    if (!_frame || !_rgbFrame)
     {
         Log::get() << Log::WARNING << "Image_FFmpeg::" << __FUNCTION__ << " - Error while allocating frame structures" << Log::endl;
-        return;
+        return false;
     }
 
-    int numBytes = av_image_get_buffer_size(AV_PIX_FMT_YUYV422, videoCodecContext->width, videoCodecContext->height, 1);
-    vector<unsigned char> buffer(numBytes);
+    av_init_packet(&_packet);
+
+    _videoTimeBase = (double)videoStream->time_base.num / (double)videoStream->time_base.den;
+    auto frameRate = av_guess_frame_rate(_avContext, videoStream, nullptr);
+    _frameDuration = frameRate.num > 0 ? static_cast<int64_t>(1e6 * av_q2d(av_inv_q(frameRate))) : 0;
+    _newPass = true;
+    _endOfFile = false;
+
+    return true;
+}
 
-    struct SwsContext* swsContext;
-    if (!isHap)
+/*************/
+void Image_FFmpeg::closeDecoders()
+{
+    if (_frame)
+        av_frame_free(&_frame);
+    if (_rgbFrame)
+        av_frame_free(&_rgbFrame);
+    if (_swsContext)
     {
-        swsContext = sws_getContext(videoCodecContext->width,
-            videoCodecContext->height,
-            videoCodecContext->pix_fmt,
-            videoCodecContext->width,
-            videoCodecContext->height,
-            AV_PIX_FMT_YUYV422,
-            SWS_BILINEAR,
-            nullptr,
-            nullptr,
-            nullptr);
+        sws_freeContext(_swsContext);
+        _swsContext = nullptr;
+    }
 
-        av_image_fill_arrays(rgbFrame->data, rgbFrame->linesize, buffer.data(), AV_PIX_FMT_YUYV422, videoCodecContext->width, videoCodecContext->height, 1);
+    if (_videoCodecContext)
+    {
+        avcodec_free_context(&_videoCodecContext);
+        DecodeScheduler::get().releaseCodecThreads(_codecThreads);
+        _codecThreads = 0;
     }
+    _videoStreamIndex = -1;
 
-    AVPacket packet;
-    av_init_packet(&packet);
+#if HAVE_PORTAUDIO
+    if (_audioCodecContext)
+        avcodec_free_context(&_audioCodecContext);
+    _audioStreamIndex = -1;
+#endif
+}
 
-    _videoTimeBase = (double)videoStream->time_base.num / (double)videoStream->time_base.den;
+/*************/
+int64_t Image_FFmpeg::getDecodeSlack() const
+{
+    // At the end of the file, wait for all frames to be displayed before looping
+    if (_endOfFile)
+        return (_loopOnVideo && _queuedFrames == 0 && _displayQueueSize == 0) ? 0 : DecodeScheduler::idle;
+
+    if (_bufferFull)
+        return DecodeScheduler::idle;
 
-    // This implements looping
-    do
+    // After a seek or a loop, nothing is buffered anymore
+    if (_startTime == -1 || _queuedFrames + _displayQueueSize == 0)
+        return 0;
+
+    return _queuedUntil - _currentTime;
+}
+
+/*************/
+bool Image_FFmpeg::decodeStep()
+{
+    //
+    // End of file, either loop or stop
+    if (_endOfFile)
     {
-        _startTime = Timer::getTime();
-        auto previousTime = 0ull;
+        if (!_continueRead)
+            return false;
+        // Without looping, the source stays idle until the next seek
+        if (!_loopOnVideo)
+            return true;
 
-        auto shouldContinueLoop = [&]() -> bool {
-            lock_guard<mutex> lock(_videoSeekMutex);
-            return _continueRead && av_read_frame(_avContext, &packet) >= 0;
-        };
+        // This prevents looping to happen before the queue has been consumed
+        lock_guard<mutex> lockEnd(_videoEndMutex);
+        seek(0.f);
+        _newPass = true;
+        _endOfFile = false;
+        return true;
+    }
+
+    {
+        lock_guard<mutex> lock(_videoSeekMutex);
+        if (!_continueRead)
+            return false;
 
-        while (shouldContinueLoop())
+        if (_newPass)
         {
-            // Reading the video
-            if (packet.stream_index == _videoStreamIndex && _videoSeekMutex.try_lock())
+            _startTime = Timer::getTime();
+            _newPass = false;
+
+            // Passes starting from the beginning of the file are recorded, until the clip is cached
+            if (_loopCache && !_cachedClip)
             {
-                auto img = unique_ptr<ImageBuffer>();
-                uint64_t timing;
-                bool hasFrame = false;
+                _cachedClip = LoopCache::get().find(_filepath);
+                if (!_cachedClip && !_loopCacheFailed && !_recording)
+                    _recording = make_shared<LoopCache::Clip>();
+            }
+        }
 
-                //
-                // If the codec is handled by FFmpeg
-                if (!isHap)
-                {
-                    auto frameFinished = false;
-                    if (avcodec_send_packet(videoCodecContext, &packet) < 0)
-                        Log::get() << Log::WARNING << "Image_FFmpeg::" << __FUNCTION__ << " - Error while decoding a frame in file " << _filepath << Log::endl;
-                    if (avcodec_receive_frame(videoCodecContext, frame) == 0)
-                        frameFinished = true;
+        if (_cachedClip && !_loopCache)
+        {
+            // Back to the decoder, from the beginning of the file
+            _cachedClip.reset();
+            _endOfFile = true;
+            return true;
+        }
 
-                    if (frameFinished)
-                    {
-                        sws_scale(swsContext, (const uint8_t* const*)frame->data, frame->linesize, 0, videoCodecContext->height, rgbFrame->data, rgbFrame->linesize);
+        if (_cachedClip)
+            return cachedStep();
 
-                        ImageBufferSpec spec(videoCodecContext->width, videoCodecContext->height, 3, 16, ImageBufferSpec::Type::UINT8, "YUYV");
-                        img.reset(new ImageBuffer(spec));
+        if (av_read_frame(_avContext, &_packet) < 0)
+        {
+            // Once cached, the clip goes on without going through the decoder nor waiting for the queue to be consumed
+            if (_recording && finishRecording() && _loopOnVideo)
+            {
+                _cacheIndex = 0;
+                _cacheAudioIndex = 0;
+                _loopOffset = _cachedClip->duration;
+                return true;
+            }
 
-                        unsigned char* pixels = reinterpret_cast<unsigned char*>(img->data());
-                        copy(buffer.begin(), buffer.end(), pixels);
+            _endOfFile = true;
+            return true;
+        }
+    }
 
-                        if (packet.pts != AV_NOPTS_VALUE)
-                            timing = static_cast<uint64_t>((double)av_frame_get_best_effort_timestamp(frame) * _videoTimeBase * 1e6);
-                        else
-                            timing = 0.0;
-                        // This handles repeated frames
-                        timing += frame->repeat_pict * _videoTimeBase * 0.5;
+    // Reading the video
+    if (_packet.stream_index == _videoStreamIndex && _videoSeekMutex.try_lock())
+    {
+        auto img = unique_ptr<ImageBuffer>();
+        uint64_t timing;
+        bool hasFrame = false;
 
-                        hasFrame = true;
-                    }
+        //
+        // If the codec is handled by FFmpeg
+        if (!_isHap)
+        {
+            auto frameFinished = false;
+            if (avcodec_send_packet(_videoCodecContext, &_packet) < 0)
+                Log::get() << Log::WARNING << "Image_FFmpeg::" << __FUNCTION__ << " - Error while decoding a frame in file " << _filepath << Log::endl;
+            if (avcodec_receive_frame(_videoCodecContext, _frame) == 0)
+                frameFinished = true;
 
-                    av_frame_unref(frame);
-                }
-                //
-                // If the codec is marked as Hap / Hap alpha / Hap Q
-                else if (isHap)
+            if (frameFinished)
+            {
+                if (_packet.pts != AV_NOPTS_VALUE)
+                    timing = static_cast<uint64_t>((double)av_frame_get_best_effort_timestamp(_frame) * _videoTimeBase * 1e6);
+                else
+                    timing = 0.0;
+                // This handles repeated frames
+                timing += _frame->repeat_pict * _videoTimeBase * 0.5;
+
+                // Frames before the target of a frame-exact seek are decoded but not converted nor shown
+                if (_seekTarget < 0 || static_cast<int64_t>(timing) >= _seekTarget)
                 {
-                    // We are using kind of a hack to store a DXT compressed image in an ImageBuffer
-                    // First, we check the texture format type
-                    std::string textureFormat;
-                    if (hapDecodeFrame(packet.data, packet.size, nullptr, 0, textureFormat))
+                    _seekTarget = -1;
+                    auto nativeFormat = getNativeFormat(_frame->format, _frame->color_range == AVCOL_RANGE_JPEG);
+                    if (!nativeFormat.empty())
                     {
-                        // Check if we need to resize the reader buffer
-                        // We set the size so as to have just enough place for the given texture format
-                        ImageBufferSpec spec;
-                        if (textureFormat == "RGB_DXT1")
-                            spec = ImageBufferSpec(videoCodecContext->width, (int)(ceil((float)videoCodecContext->height / 2.f)), 1, 8, ImageBufferSpec::Type::UINT8);
-                        if (textureFormat == "RGBA_DXT5")
-                            spec = ImageBufferSpec(videoCodecContext->width, videoCodecContext->height, 1, 8, ImageBufferSpec::Type::UINT8);
-                        if (textureFormat == "YCoCg_DXT5")
-                            spec = ImageBufferSpec(videoCodecContext->width, videoCodecContext->height, 1, 8, ImageBufferSpec::Type::UINT8);
-                        else
-                        {
-                            av_packet_unref(&packet);
-                            return;
-                        }
-
-                        spec.format = {textureFormat};
+                        // Planar YUV is sent as is, the conversion to RGB being done by the shaders
+                        img = copyNativeFrame(_frame, nativeFormat);
+                    }
+                    else
+                    {
+                        _swsContext = sws_getCachedContext(_swsContext,
+                            _frame->width,
+                            _frame->height,
+                            static_cast<AVPixelFormat>(_frame->format),
+                            _frame->width,
+                            _frame->height,
+                            AV_PIX_FMT_YUYV422,
+                            SWS_BILINEAR,
+                            nullptr,
+                            nullptr,
+                            nullptr);
+
+                        ImageBufferSpec spec(_frame->width, _frame->height, 3, 16, ImageBufferSpec::Type::UINT8, "YUYV");
                         img.reset(new ImageBuffer(spec));
 
-                        unsigned long outputBufferBytes = spec.width * spec.height * spec.channels;
-
-                        if (hapDecodeFrame(packet.data, packet.size, img->data(), outputBufferBytes, textureFormat))
-                        {
-                            if (packet.pts != AV_NOPTS_VALUE)
-                                timing = static_cast<uint64_t>((double)packet.pts * _videoTimeBase * 1e6);
-                            else
-                                timing = 0.0;
-
-                            hasFrame = true;
-                        }
+                        av_image_fill_arrays(_rgbFrame->data, _rgbFrame->linesize, reinterpret_cast<uint8_t*>(img->data()), AV_PIX_FMT_YUYV422, _frame->width, _frame->height, 1);
+                        sws_scale(_swsContext, (const uint8_t* const*)_frame->data, _frame->linesize, 0, _frame->height, _rgbFrame->data, _rgbFrame->linesize);
                     }
+
+                    hasFrame = true;
                 }
+            }
 
-                int64_t totalBufferSize = 0;
+            av_frame_unref(_frame);
+        }
+        //
+        // If the codec is marked as Hap / Hap alpha / Hap Q
+        else if (_isHap)
+        {
+            // We are using kind of a hack to store a DXT compressed image in an ImageBuffer
+            // First, we check the texture format type
+            std::string textureFormat;
+            // Frames before the target of a frame-exact seek are skipped without being decompressed
+            auto skipFrame = _seekTarget >= 0 && _packet.pts != AV_NOPTS_VALUE && static_cast<int64_t>((double)_packet.pts * _videoTimeBase * 1e6) < _seekTarget;
+            if (!skipFrame && hapDecodeFrame(_packet.data, _packet.size, nullptr, 0, textureFormat))
+            {
+                _seekTarget = -1;
+
+                // Check if we need to resize the reader buffer
+                // We set the size so as to have just enough place for the given texture format
+                ImageBufferSpec spec;
+                if (textureFormat == "RGB_DXT1")
+                    spec = ImageBufferSpec(_videoCodecContext->width, (int)(ceil((float)_videoCodecContext->height / 2.f)), 1, 8, ImageBufferSpec::Type::UINT8);
+                else if (textureFormat == "RGBA_DXT5")
+                    spec = ImageBufferSpec(_videoCodecContext->width, _videoCodecContext->height, 1, 8, ImageBufferSpec::Type::UINT8);
+                else if (textureFormat == "YCoCg_DXT5")
+                    spec = ImageBufferSpec(_videoCodecContext->width, _videoCodecContext->height, 1, 8, ImageBufferSpec::Type::UINT8);
+                else
                 {
-                    lock_guard<mutex> lockFrames(_videoQueueMutex);
-                    if (hasFrame)
-                    {
-
-                        // Add the frame size to the history
-                        _framesSize.push_back(img->getSize());
-
-                        _timedFrames.emplace_back();
-                        std::swap(_timedFrames[_timedFrames.size() - 1].frame, img);
-                        _timedFrames[_timedFrames.size() - 1].timing = timing;
-                    }
-
-                    // Check the current buffer size (sum of all frames in buffer)
-                    for (auto& f : _framesSize)
-                        totalBufferSize += f;
+                    _videoSeekMutex.unlock();
+                    av_packet_unref(&_packet);
+                    return false;
                 }
 
-                int timedFramesBuffered = _timedFrames.size();
+                spec.format = {textureFormat};
+                img.reset(new ImageBuffer(spec));
 
-                _videoSeekMutex.unlock();
-                av_packet_unref(&packet);
+                unsigned long outputBufferBytes = spec.width * spec.height * spec.channels;
 
-                // Do not store more than a few frames in memory
-                // _maximumBufferSize is divided by 2 as another frame queue is held by the display loop
-                while (timedFramesBuffered > 0 && totalBufferSize > _maximumBufferSize / 2 && _continueRead)
+                if (hapDecodeFrame(_packet.data, _packet.size, img->data(), outputBufferBytes, textureFormat))
                 {
-                    this_thread::sleep_for(chrono::milliseconds(5));
-                    lock_guard<mutex> lockSeek(_videoSeekMutex);
-                    lock_guard<mutex> lockQueue(_videoQueueMutex);
-                    timedFramesBuffered = _timedFrames.size();
+                    if (_packet.pts != AV_NOPTS_VALUE)
+                        timing = static_cast<uint64_t>((double)_packet.pts * _videoTimeBase * 1e6);
+                    else
+                        timing = 0.0;
+
+                    hasFrame = true;
                 }
             }
-#if HAVE_PORTAUDIO
-            // Reading the audio
-            else if (packet.stream_index == _audioStreamIndex && audioCodecContext)
-            {
-                auto hasFrame = false;
-                if (avcodec_send_packet(audioCodecContext, &packet) < 0)
-                    Log::get() << Log::WARNING << "Image_FFmpeg::" << __FUNCTION__ << " - Error while decoding an audio frame in file " << _filepath << Log::endl;
-                uint64_t timing = (double)packet.pts * _audioTimeBase * 1e6;
-                av_packet_unref(&packet);
-
-                while (avcodec_receive_frame(audioCodecContext, frame) == 0)
-                {
-                    // Check whether we were asked to connect to another output
-                    if (audioCodecContext && _audioDeviceOutputUpdated)
-                    {
-                        setupAudioOutput(audioCodecContext);
-                        _audioDeviceOutputUpdated = false;
-                    }
+        }
 
-                    size_t dataSize = av_samples_get_buffer_size(nullptr, audioCodecContext->channels, frame->nb_samples, audioCodecContext->sample_fmt, 1);
-                    auto buffer = ResizableArray<uint8_t>(dataSize);
-                    auto linesize = dataSize / audioCodecContext->channels;
-                    if (_planar)
-                        for (int c = 0; c < audioCodecContext->channels; ++c)
-                            copy(frame->extended_data[c], frame->extended_data[c] + linesize, buffer.data() + c * linesize);
-                    else
-                        copy(frame->extended_data[0], frame->extended_data[0] + dataSize, buffer.data());
+        if (hasFrame)
+        {
+            if (_recording)
+                recordFrame(*img, timing);
+            queueFrame(std::move(img), timing, 0);
+        }
 
-                    TimedAudioFrame timedFrame;
-                    timedFrame.frame = std::move(buffer);
-                    timedFrame.timing = timing;
-                    lock_guard<mutex> lockAudio(_audioMutex);
-                    _audioQueue.push_back(std::move(timedFrame));
+        _videoSeekMutex.unlock();
+        av_packet_unref(&_packet);
+    }
+#if HAVE_PORTAUDIO
+    // Reading the audio
+    else if (_packet.stream_index == _audioStreamIndex && _audioCodecContext)
+    {
+        if (avcodec_send_packet(_audioCodecContext, &_packet) < 0)
+            Log::get() << Log::WARNING << "Image_FFmpeg::" << __FUNCTION__ << " - Error while decoding an audio frame in file " << _filepath << Log::endl;
+        uint64_t timing = (double)_packet.pts * _audioTimeBase * 1e6;
+        av_packet_unref(&_packet);
 
-                    av_frame_unref(frame);
-                }
+        while (avcodec_receive_frame(_audioCodecContext, _frame) == 0)
+        {
+            // Check whether we were asked to connect to another output
+            if (_audioCodecContext && _audioDeviceOutputUpdated)
+            {
+                setupAudioOutput(_audioCodecContext);
+                _audioDeviceOutputUpdated = false;
             }
-#endif
+
+            size_t dataSize = av_samples_get_buffer_size(nullptr, _audioCodecContext->channels, _frame->nb_samples, _audioCodecContext->sample_fmt, 1);
+            auto buffer = ResizableArray<uint8_t>(dataSize);
+            auto linesize = dataSize / _audioCodecContext->channels;
+            if (_planar)
+                for (int c = 0; c < _audioCodecContext->channels; ++c)
+                    copy(_frame->extended_data[c], _frame->extended_data[c] + linesize, buffer.data() + c * linesize);
             else
+                copy(_frame->extended_data[0], _frame->extended_data[0] + dataSize, buffer.data());
+
             {
-                av_packet_unref(&packet);
+                // The recording is reset by seek, which holds this mutex
+                lock_guard<mutex> lockSeek(_videoSeekMutex);
+                if (_recording)
+                    recordAudioFrame(buffer, timing);
             }
+
+            TimedAudioFrame timedFrame;
+            timedFrame.frame = std::move(buffer);
+            timedFrame.timing = timing;
+            lock_guard<mutex> lockAudio(_audioMutex);
+            _audioQueue.push_back(std::move(timedFrame));
+
+            av_frame_unref(_frame);
         }
+    }
+#endif
+    else
+    {
+        av_packet_unref(&_packet);
+    }
 
-        // This prevents looping to happen before the queue has been consumed
-        lock_guard<mutex> lockEnd(_videoEndMutex);
-        seek(0.f);
-    } while (_loopOnVideo && _continueRead);
+    return true;
+}
 
-    av_frame_free(&rgbFrame);
-    av_frame_free(&frame);
-    if (!isHap)
-        sws_freeContext(swsContext);
-    avcodec_close(videoCodecContext);
-    _videoStreamIndex = -1;
+/*************/
+void Image_FFmpeg::queueFrame(unique_ptr<ImageBuffer>&& image, int64_t timing, int64_t offset)
+{
+    if (_seekPending.exchange(false))
+        Timer::get() >> "seek_" + _name;
+
+    lock_guard<mutex> lockFrames(_videoQueueMutex);
+
+    // Add the frame size to the history
+    _framesSize.push_back(image->getSize());
+
+    _timedFrames.emplace_back();
+    auto& timedFrame = _timedFrames.back();
+    std::swap(timedFrame.frame, image);
+    timedFrame.timing = timing + offset;
+    timedFrame.offset = offset;
+    _queuedUntil = timedFrame.timing;
+    _queuedFrames = _timedFrames.size();
+
+    // Check the current buffer size (sum of all frames in buffer)
+    int64_t totalBufferSize = 0;
+    for (auto& f : _framesSize)
+        totalBufferSize += f;
+
+    // Do not store more than a few frames in memory
+    // _maximumBufferSize is divided by 2 as another frame queue is held by the display loop
+    _bufferFull = totalBufferSize > _maximumBufferSize / 2;
+}
+
+/*************/
+bool Image_FFmpeg::cachedStep()
+{
+    const auto& frames = _cachedClip->frames;
+    if (_cacheIndex >= frames.size())
+    {
+        if (!_loopOnVideo)
+        {
+            _endOfFile = true;
+            return true;
+        }
+
+        // Gapless looping: the next pass is queued right after the current one
+        _cacheIndex = 0;
+        _cacheAudioIndex = 0;
+        _loopOffset += _cachedClip->duration;
+    }
+
+    const auto& cachedFrame = frames[_cacheIndex];
+    ++_cacheIndex;
 
 #if HAVE_PORTAUDIO
-    if (audioCodecContext)
-        avcodec_close(audioCodecContext);
-    _audioStreamIndex = -1;
+    // Queue the audio up to the next video frame
+    const auto& audioFrames = _cachedClip->audioFrames;
+    auto audioUntil = _cacheIndex < frames.size() ? frames[_cacheIndex].timing : numeric_limits<int64_t>::max();
+    if (_cacheAudioIndex < audioFrames.size() && audioFrames[_cacheAudioIndex].timing < audioUntil)
+    {
+        lock_guard<mutex> lockAudio(_audioMutex);
+        while (_cacheAudioIndex < audioFrames.size() && audioFrames[_cacheAudioIndex].timing < audioUntil)
+        {
+            TimedAudioFrame timedFrame;
+            timedFrame.frame = audioFrames[_cacheAudioIndex].samples;
+            timedFrame.timing = audioFrames[_cacheAudioIndex].timing + _loopOffset;
+            _audioQueue.push_back(std::move(timedFrame));
+            ++_cacheAudioIndex;
+        }
+    }
 #endif
+
+    // Cached frames are handed out without copying, each buffer keeping the clip alive until it is released
+    auto clip = _cachedClip;
+    auto buffer = ResizableArray<char>(cachedFrame.image.data(), cachedFrame.image.getSize(), [clip](char*) {});
+    queueFrame(unique_ptr<ImageBuffer>(new ImageBuffer(cachedFrame.image.getSpec(), std::move(buffer))), cachedFrame.timing, _loopOffset);
+    return true;
+}
+
+/*************/
+void Image_FFmpeg::recordFrame(const ImageBuffer& image, int64_t timing)
+{
+    if (!LoopCache::get().reserve(image.getSize()))
+    {
+        Log::get() << Log::WARNING << "Image_FFmpeg::" << __FUNCTION__ << " - Loop cache budget exceeded, file " << _filepath << " will not be cached" << Log::endl;
+        _loopCacheFailed = true;
+        abortRecording();
+        return;
+    }
+
+    _recording->size += image.getSize();
+    _recording->frames.push_back({image, timing});
+}
+
+#if HAVE_PORTAUDIO
+/*************/
+void Image_FFmpeg::recordAudioFrame(const ResizableArray<uint8_t>& samples, int64_t timing)
+{
+    if (!LoopCache::get().reserve(samples.size()))
+    {
+        _loopCacheFailed = true;
+        abortRecording();
+        return;
+    }
+
+    _recording->size += samples.size();
+    _recording->audioFrames.push_back({samples, timing});
+}
+#endif
+
+/*************/
+bool Image_FFmpeg::finishRecording()
+{
+    auto recording = std::move(_recording);
+    if (recording->frames.empty())
+    {
+        LoopCache::get().release(recording->size);
+        return false;
+    }
+
+    // A pass lasts until the last frame has been shown for a whole frame duration
+    const auto& frames = recording->frames;
+    auto frameDuration = _frameDuration;
+    if (frameDuration <= 0)
+        frameDuration = frames.size() > 1 ? frames[frames.size() - 1].timing - frames[frames.size() - 2].timing : static_cast<int64_t>(_videoTimeBase * 1e6);
+    recording->duration = frames.back().timing - frames.front().timing + frameDuration;
+
+    _cachedClip = LoopCache::get().insert(_filepath, recording);
+    return true;
+}
+
+/*************/
+void Image_FFmpeg::abortRecording()
+{
+    if (!_recording)
+        return;
+
+    LoopCache::get().release(_recording->size);
+    _recording.reset();
 }
 
 #if HAVE_PORTAUDIO
@@ -586,30 +960,90 @@ void Image_FFmpeg::seek(float seconds)
     if (_elapsedTime > seconds)
         seekFlag = AVSEEK_FLAG_BACKWARD;
 
-    // Prevent seeking outside of the file
+    // Prevent seeking outside of the file. Cached clips keep looping without resetting their clock, hence the modulo
     float duration = (float)_avContext->duration / (float)AV_TIME_BASE;
+    if (_cachedClip && _loopOnVideo && _cachedClip->duration > 0)
+        seconds = fmod(seconds, static_cast<float>(_cachedClip->duration) / 1e6f);
     if (seconds < 0)
         seconds = 0;
     else if (seconds > duration)
         seconds = duration;
 
-    int frame = static_cast<int>(floor(seconds / _videoTimeBase));
-    if (avformat_seek_file(_avContext, _videoStreamIndex, 0, frame, frame, seekFlag) < 0)
+    // A pass interrupted by a seek can not be cached
+    abortRecording();
+
+    auto seeked = true;
+    if (_cachedClip)
     {
-        Log::get() << Log::WARNING << "Image_FFmpeg::" << __FUNCTION__ << " - Could not seek to timestamp " << seconds << Log::endl;
+        // Cached clips are seeked without going through the decoder, to the first frame at or after the given time
+        const auto& frames = _cachedClip->frames;
+        auto timing = frames.front().timing + static_cast<int64_t>(seconds * 1e6);
+        auto frameIt = lower_bound(frames.begin(), frames.end(), timing, [](const LoopCache::Frame& f, int64_t t) { return f.timing < t; });
+        _cacheIndex = frameIt - frames.begin();
+        const auto& audioFrames = _cachedClip->audioFrames;
+        auto audioIt = lower_bound(audioFrames.begin(), audioFrames.end(), timing, [](const LoopCache::AudioFrame& f, int64_t t) { return f.timing < t; });
+        _cacheAudioIndex = audioIt - audioFrames.begin();
+        _loopOffset = 0;
     }
     else
     {
+        int64_t frame = static_cast<int64_t>(floor(seconds / _videoTimeBase));
+        int result;
+        if (_index && !_index->empty())
+        {
+            // Frame-exact seek: decoding starts from the closest keyframe, and the frames before the target are dropped by decodeStep
+            frame = _index->findFrame(frame);
+            result = av_seek_frame(_avContext, _videoStreamIndex, _index->findKeyframe(frame), AVSEEK_FLAG_BACKWARD);
+            _seekTarget = static_cast<int64_t>((double)frame * _videoTimeBase * 1e6);
+        }
+        else
+        {
+            result = avformat_seek_file(_avContext, _videoStreamIndex, 0, frame, frame, seekFlag);
+            _seekTarget = -1;
+        }
+
+        if (result < 0)
+        {
+            Log::get() << Log::WARNING << "Image_FFmpeg::" << __FUNCTION__ << " - Could not seek to timestamp " << seconds << Log::endl;
+            seeked = false;
+        }
+        else
+        {
+            // Frames decoded before the seek must not come out of the codecs
+            if (_videoCodecContext && !_isHap)
+                avcodec_flush_buffers(_videoCodecContext);
+#if HAVE_PORTAUDIO
+            if (_audioCodecContext)
+                avcodec_flush_buffers(_audioCodecContext);
+#endif
+        }
+    }
+
+    if (seeked)
+    {
+        // The latency is measured until the first frame is queued
+        if (Timer::get().isDebug())
+        {
+            Timer::get() << "seek_" + _name;
+            _seekPending = true;
+        }
+
         lock_guard<mutex> lockQueue(_videoQueueMutex);
         // As seeking will no necessarily go to the desired timestamp, but to the closest i-frame,
         // we will set _startTime at the next frame in the videoDisplayLoop
         _startTime = -1;
         _timedFrames.clear();
+        _framesSize.clear();
+        _queuedFrames = 0;
+        _bufferFull = false;
+        _endOfFile = false;
 #if HAVE_PORTAUDIO
         if (_speaker)
             _speaker->clearQueue();
 #endif
     }
+
+    DecodeScheduler::get().notify();
 }
 
 /*************/
@@ -625,6 +1059,10 @@ void Image_FFmpeg::videoDisplayLoop()
             lock_guard<mutex> lockFrames(_videoQueueMutex);
             std::swap(localQueue, _timedFrames);
             _framesSize.clear();
+            _queuedFrames = 0;
+            _displayQueueSize = localQueue.size();
+            _bufferFull = false;
+            DecodeScheduler::get().notify();
         }
 
         // This sets the start time after a seek
@@ -703,7 +1141,7 @@ void Image_FFmpeg::videoDisplayLoop()
                 if (waitTime > 2e3) // we don't wait if the frame is due for the next few ms
                     this_thread::sleep_for(chrono::microseconds(waitTime));
 
-                _elapsedTime = timedFrame.timing;
+                _elapsedTime = timedFrame.timing - timedFrame.offset;
 
                 lock_guard<Spinlock> lock(_writeMutex);
                 if (!_bufferImage)
@@ -714,7 +1152,9 @@ void Image_FFmpeg::videoDisplayLoop()
             }
 
             localQueue.pop_front();
+            _displayQueueSize = localQueue.size();
         }
+        _displayQueueSize = 0;
     }
 }
 
@@ -770,6 +1210,21 @@ void Image_FFmpeg::registerAttributes()
         {'n'});
     setAttributeParameter("loop", true, true);
 
+    addAttribute("loopCache",
+        [&](const Values& args) {
+            _loopCache = (bool)args[0].as<int>();
+            return true;
+        },
+        [&]() -> Values {
+            int loopCache = _loopCache;
+            return {loopCache};
+        },
+        {'n'});
+    setAttributeParameter("loopCache", true, true);
+    setAttributeDescription("loopCache",
+        "If set to 1, keep all the frames in memory after the first pass so as to loop without decoding, within the loopCacheSize budget of the World. Cached clips are shared "
+        "between the sources reading the same file");
+
     addAttribute("remaining",
         [&](const Values& args) { return false; },
         [&]() -> Values {
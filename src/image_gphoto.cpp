@@ -412,13 +412,13 @@ void Image_GPhoto::registerAttributes()
 
     // Actions
     addAttribute("capture", [&](const Values& args) {
-        SThread::pool.enqueue([&]() { capture(); });
+        SThread::pool.enqueueWithoutId([&]() { capture(); });
         return true;
     });
     setAttributeDescription("capture", "Ask for the camera to shoot");
 
     addAttribute("detect", [&](const Values& args) {
-        SThread::pool.enqueue([&]() { detectCameras(); });
+        SThread::pool.enqueueWithoutId([&]() { detectCameras(); });
         return true;
     });
     setAttributeDescription("detect", "Ask for camera detection");
@@ -7,6 +7,7 @@
 
 #include "cgUtils.h"
 #include "log.h"
+#include "threadPlacement.h"
 #include "threadpool.h"
 #include "timer.h"
 
@@ -53,7 +54,10 @@ bool Image_OpenCV::read(const string& filename)
         _readLoopThread.join();
 
     _continueReading = true;
-    _readLoopThread = thread([&]() { readLoop(); });
+    _readLoopThread = thread([&]() {
+        auto threadPlacement = ThreadPlacement::get().registerThread(ThreadPlacement::Class::decode);
+        readLoop();
+    });
 
     return true;
 }
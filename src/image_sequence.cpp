@@ -0,0 +1,570 @@
+#include "./image_sequence.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+
+#include <stb_image.h>
+
+#include "./log.h"
+#include "./osUtils.h"
+#include "./threadPlacement.h"
+#include "./threadpool.h"
+#include "./timer.h"
+
+#define SPLASH_SEQUENCE_MAX_WAIT_US 5000
+#define SPLASH_SEQUENCE_MIN_WAIT_US 500
+#define SPLASH_SEQUENCE_CLOCK_TOLERANCE_US 50000
+#define SPLASH_SEQUENCE_DPX_MAX_SIZE 32768
+
+using namespace std;
+
+namespace Splash
+{
+
+/*************/
+namespace
+{
+string getExtension(const string& filename)
+{
+    auto dotPos = filename.rfind('.');
+    if (dotPos == string::npos)
+        return {};
+    auto extension = filename.substr(dotPos + 1);
+    transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+    return extension;
+}
+
+bool isSupportedFile(const string& filename)
+{
+    auto extension = getExtension(filename);
+    return extension == "png" || extension == "tga" || extension == "dpx" || extension == "jpg" || extension == "jpeg" || extension == "bmp";
+}
+
+bool isNumber(const string& str)
+{
+    return !str.empty() && all_of(str.begin(), str.end(), ::isdigit);
+}
+} // end of anonymous namespace
+
+/*************/
+Image_Sequence::Image_Sequence(weak_ptr<RootObject> root)
+    : Image(root)
+{
+    init();
+}
+
+/*************/
+Image_Sequence::~Image_Sequence()
+{
+    stop();
+}
+
+/*************/
+void Image_Sequence::init()
+{
+    _type = "image_sequence";
+    registerAttributes();
+}
+
+/*************/
+void Image_Sequence::stop()
+{
+    if (_continuePlayback)
+    {
+        _continuePlayback = false;
+        _playbackThread.join();
+    }
+
+    // Pending decodes are not waited for, their result being dropped with the futures
+    _prefetched.clear();
+}
+
+/*************/
+bool Image_Sequence::read(const string& filename)
+{
+    stop();
+    _filepath = Utils::getFullPathFromFilePath(filename, _root.lock()->getConfigurationPath());
+
+    _frames = findFrames(_filepath);
+    if (_frames.empty())
+    {
+        Log::get() << Log::WARNING << "Image_Sequence::" << __FUNCTION__ << " - No image found for sequence " << _filepath << Log::endl;
+        return false;
+    }
+
+    Log::get() << Log::MESSAGE << "Image_Sequence::" << __FUNCTION__ << " - Found " << _frames.size() << " frames for sequence " << _filepath << Log::endl;
+
+    _stats = make_shared<DecodeStats>();
+    _underruns = 0;
+    _decodeRate = 0.f;
+    _decodeTime = 0.f;
+    _seekTime = 0.f;
+    _startTime = Timer::getTime();
+    _currentTime = 0;
+
+    _continuePlayback = true;
+    _playbackThread = thread([&]() {
+        auto threadPlacement = ThreadPlacement::get().registerThread(ThreadPlacement::Class::decode);
+        playbackLoop();
+    });
+
+    return true;
+}
+
+/*************/
+vector<string> Image_Sequence::findFrames(const string& filepath)
+{
+    vector<string> frames;
+
+    // A directory holds a single sequence, sorted by name
+    if (Utils::isDir(filepath))
+    {
+        auto directory = filepath.back() == '/' ? filepath : filepath + "/";
+        for (const auto& file : Utils::listDirContent(directory))
+            if (isSupportedFile(file))
+                frames.push_back(directory + file);
+        sort(frames.begin(), frames.end());
+        return frames;
+    }
+
+    auto slashPos = filepath.rfind('/');
+    auto directory = slashPos == string::npos ? string("./") : filepath.substr(0, slashPos + 1);
+    auto filename = slashPos == string::npos ? filepath : filepath.substr(slashPos + 1);
+
+    // Split the file name around the frame number, given either as a %0Nd pattern or as the last number of the name
+    string prefix, suffix;
+    auto percentPos = filename.find('%');
+    if (percentPos != string::npos)
+    {
+        auto dPos = filename.find('d', percentPos);
+        if (dPos == string::npos || (dPos > percentPos + 1 && !isNumber(filename.substr(percentPos + 1, dPos - percentPos - 1))))
+            return {};
+        prefix = filename.substr(0, percentPos);
+        suffix = filename.substr(dPos + 1);
+    }
+    else
+    {
+        auto lastDigit = filename.find_last_of("0123456789");
+        if (lastDigit == string::npos)
+        {
+            if (isSupportedFile(filename) && ifstream(filepath).is_open())
+                frames.push_back(filepath);
+            return frames;
+        }
+        auto firstDigit = filename.find_last_not_of("0123456789", lastDigit);
+        firstDigit = firstDigit == string::npos ? 0 : firstDigit + 1;
+        prefix = filename.substr(0, firstDigit);
+        suffix = filename.substr(lastDigit + 1);
+    }
+
+    if (!isSupportedFile(suffix))
+        return {};
+
+    vector<pair<int64_t, string>> numberedFiles;
+    for (const auto& file : Utils::listDirContent(directory))
+    {
+        if (file.size() <= prefix.size() + suffix.size())
+            continue;
+        if (file.compare(0, prefix.size(), prefix) != 0 || file.compare(file.size() - suffix.size(), suffix.size(), suffix) != 0)
+            continue;
+        auto number = file.substr(prefix.size(), file.size() - prefix.size() - suffix.size());
+        if (!isNumber(number))
+            continue;
+        numberedFiles.emplace_back(stoll(number), file);
+    }
+
+    sort(numberedFiles.begin(), numberedFiles.end());
+    for (const auto& file : numberedFiles)
+        frames.push_back(directory + file.second);
+
+    return frames;
+}
+
+/*************/
+unique_ptr<ImageBuffer> Image_Sequence::decodeFrame(const string& filepath)
+{
+    if (getExtension(filepath) == "dpx")
+        return readDPX(filepath);
+
+    int w, h, c;
+    // We force conversion to RGBA, as in Image::readFile
+    uint8_t* rawImage = stbi_load(filepath.c_str(), &w, &h, &c, 4);
+    if (!rawImage)
+    {
+        Log::get() << Log::WARNING << "Image_Sequence::" << __FUNCTION__ << " - Caught an error while opening image file " << filepath << Log::endl;
+        return {};
+    }
+
+    auto image = unique_ptr<ImageBuffer>(new ImageBuffer(ImageBufferSpec(w, h, 4, 32, ImageBufferSpec::Type::UINT8, "RGBA")));
+    memcpy(image->data(), rawImage, w * h * 4);
+    stbi_image_free(rawImage);
+
+    return image;
+}
+
+/*************/
+unique_ptr<ImageBuffer> Image_Sequence::readDPX(const string& filepath)
+{
+    ifstream file(filepath, ios::in | ios::binary);
+    if (!file.is_open())
+    {
+        Log::get() << Log::WARNING << "Image_Sequence::" << __FUNCTION__ << " - Unable to open file " << filepath << Log::endl;
+        return {};
+    }
+
+    vector<uint8_t> buffer((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+    if (buffer.size() < 812)
+    {
+        Log::get() << Log::WARNING << "Image_Sequence::" << __FUNCTION__ << " - File " << filepath << " is too small to be a DPX file" << Log::endl;
+        return {};
+    }
+
+    // The magic number gives the endianness of the whole file
+    bool bigEndian;
+    if (memcmp(buffer.data(), "SDPX", 4) == 0)
+        bigEndian = true;
+    else if (memcmp(buffer.data(), "XPDS", 4) == 0)
+        bigEndian = false;
+    else
+    {
+        Log::get() << Log::WARNING << "Image_Sequence::" << __FUNCTION__ << " - File " << filepath << " is not a DPX file" << Log::endl;
+        return {};
+    }
+
+    auto read16 = [&](size_t offset) -> uint32_t {
+        auto ptr = buffer.data() + offset;
+        return bigEndian ? (ptr[0] << 8) | ptr[1] : (ptr[1] << 8) | ptr[0];
+    };
+    auto read32 = [&](size_t offset) -> uint32_t {
+        auto ptr = buffer.data() + offset;
+        return bigEndian ? (ptr[0] << 24) | (ptr[1] << 16) | (ptr[2] << 8) | ptr[3] : (ptr[3] << 24) | (ptr[2] << 16) | (ptr[1] << 8) | ptr[0];
+    };
+
+    // Only the first image element is read
+    auto width = read32(772);
+    auto height = read32(776);
+    auto descriptor = buffer[800];
+    auto bitDepth = buffer[803];
+    auto packing = read16(804);
+    auto encoding = read16(806);
+    auto dataOffset = read32(808);
+    if (dataOffset == 0 || dataOffset == 0xFFFFFFFF)
+        dataOffset = read32(4);
+
+    uint32_t channels = 0;
+    if (descriptor == 6)
+        channels = 1;
+    else if (descriptor == 50)
+        channels = 3;
+    else if (descriptor == 51)
+        channels = 4;
+
+    if (channels == 0 || encoding != 0 || (bitDepth != 8 && bitDepth != 10 && bitDepth != 16) || (bitDepth == 10 && (channels != 3 || packing == 0)))
+    {
+        Log::get() << Log::WARNING << "Image_Sequence::" << __FUNCTION__ << " - Unsupported DPX format in file " << filepath << " (descriptor " << (int)descriptor << ", "
+                   << (int)bitDepth << " bits, packing " << packing << ", encoding " << encoding << ")" << Log::endl;
+        return {};
+    }
+
+    // Dimensions come straight from the file, they are bounded so that the sizes below can not overflow
+    if (width == 0 || height == 0 || width > SPLASH_SEQUENCE_DPX_MAX_SIZE || height > SPLASH_SEQUENCE_DPX_MAX_SIZE)
+    {
+        Log::get() << Log::WARNING << "Image_Sequence::" << __FUNCTION__ << " - Invalid DPX dimensions in file " << filepath << " (" << width << "x" << height << ")" << Log::endl;
+        return {};
+    }
+
+    // Lines are padded to 32 bits, and 10 bits RGB pixels are packed in a single 32 bits word
+    uint64_t lineSize = 0;
+    if (bitDepth == 10)
+        lineSize = static_cast<uint64_t>(width) * 4;
+    else
+        lineSize = ((static_cast<uint64_t>(width) * channels * (bitDepth / 8) + 3) / 4) * 4;
+
+    if (dataOffset > buffer.size() || lineSize * height > buffer.size() - dataOffset)
+    {
+        Log::get() << Log::WARNING << "Image_Sequence::" << __FUNCTION__ << " - File " << filepath << " is truncated" << Log::endl;
+        return {};
+    }
+
+    auto image = unique_ptr<ImageBuffer>(new ImageBuffer(ImageBufferSpec(width, height, 4, 32, ImageBufferSpec::Type::UINT8, "RGBA")));
+    auto pixels = reinterpret_cast<uint8_t*>(image->data());
+
+    // Components are reduced to 8 bits, luma being spread over RGB
+    for (uint32_t y = 0; y < height; ++y)
+    {
+        auto line = static_cast<size_t>(dataOffset + y * lineSize);
+        auto outLine = pixels + static_cast<size_t>(y) * width * 4;
+        for (uint32_t x = 0; x < width; ++x)
+        {
+            uint8_t components[4] = {0, 0, 0, 255};
+            if (bitDepth == 10)
+            {
+                auto word = read32(line + x * 4);
+                auto shift = packing == 1 ? 2 : 0; // Method A pads the least significant bits, method B the most significant ones
+                components[0] = ((word >> (20 + shift)) & 0x3FF) >> 2;
+                components[1] = ((word >> (10 + shift)) & 0x3FF) >> 2;
+                components[2] = ((word >> shift) & 0x3FF) >> 2;
+            }
+            else
+            {
+                for (uint32_t c = 0; c < channels; ++c)
+                {
+                    if (bitDepth == 8)
+                        components[c] = buffer[line + x * channels + c];
+                    else
+                        components[c] = read16(line + (x * channels + c) * 2) >> 8;
+                }
+                if (channels == 1)
+                    components[1] = components[2] = components[0];
+            }
+            memcpy(outLine + x * 4, components, 4);
+        }
+    }
+
+    return image;
+}
+
+/*************/
+void Image_Sequence::playbackLoop()
+{
+    int64_t shownFrame = -1;
+    int64_t underrunFrame = -1;
+    int64_t statsTime = Timer::getTime();
+    int64_t statsFrames = 0;
+
+    while (_continuePlayback)
+    {
+        auto frameCount = static_cast<int64_t>(_frames.size());
+        auto frameDuration = static_cast<int64_t>(1e6f / max(0.001f, _framerate.load()));
+
+        //
+        // Get the current master and local clocks, the same way Image_FFmpeg does
+        //
+        _currentTime = Timer::getTime() - _startTime;
+
+        int64_t clockAsMs;
+        bool clockIsPaused{false};
+        bool useClock = _useClock && Timer::get().getMasterClock<chrono::milliseconds>(clockAsMs, clockIsPaused);
+        if (_paused || (clockIsPaused && useClock))
+        {
+            _startTime = Timer::getTime() - _currentTime;
+        }
+        else if (useClock)
+        {
+            int64_t clockTime = ((float)clockAsMs / 1e3f + _shiftTime) * 1e6;
+            if (abs(_currentTime - clockTime) > SPLASH_SEQUENCE_CLOCK_TOLERANCE_US)
+            {
+                _startTime = Timer::getTime() - clockTime;
+                _currentTime = clockTime;
+            }
+        }
+
+        auto position = max<int64_t>(0, _currentTime) / frameDuration;
+        if (_loop)
+            position %= frameCount;
+        else
+            position = min(position, frameCount - 1);
+
+        //
+        // Keep the prefetch window filled, dropping the frames which went out of it after a seek
+        //
+        auto prefetchCount = min<int64_t>(max(1, _prefetchCount.load()), frameCount);
+        auto isInWindow = [&](int64_t index) {
+            auto distance = index - position;
+            if (distance < 0 && _loop)
+                distance += frameCount;
+            return distance >= 0 && distance < prefetchCount;
+        };
+
+        for (auto frameIt = _prefetched.begin(); frameIt != _prefetched.end();)
+        {
+            if (!isInWindow(frameIt->first))
+                frameIt = _prefetched.erase(frameIt);
+            else
+                ++frameIt;
+        }
+
+        for (int64_t i = 0; i < prefetchCount; ++i)
+        {
+            auto index = position + i;
+            if (index >= frameCount)
+            {
+                if (!_loop)
+                    break;
+                index -= frameCount;
+            }
+
+            if (index == shownFrame || _prefetched.find(index) != _prefetched.end())
+                continue;
+
+            auto path = _frames[index];
+            auto stats = _stats;
+            _prefetched[index] = SThread::pool.submit([path, stats]() {
+                auto start = Timer::getTime();
+                auto image = decodeFrame(path);
+                stats->time += Timer::getTime() - start;
+                ++stats->frames;
+                return image;
+            });
+        }
+
+        //
+        // Show the current frame if it is ready, otherwise keep the previous one
+        //
+        if (position != shownFrame)
+        {
+            auto frameIt = _prefetched.find(position);
+            if (frameIt != _prefetched.end() && frameIt->second.wait_for(chrono::seconds(0)) == future_status::ready)
+            {
+                auto image = frameIt->second.get();
+                _prefetched.erase(frameIt);
+                shownFrame = position;
+
+                if (image)
+                {
+                    lock_guard<Spinlock> lock(_writeMutex);
+                    if (!_bufferImage)
+                        _bufferImage = unique_ptr<ImageBuffer>(new ImageBuffer());
+                    std::swap(_bufferImage, image);
+                    _imageUpdated = true;
+                    updateTimestamp();
+                }
+            }
+            else if (underrunFrame != position)
+            {
+                underrunFrame = position;
+                ++_underruns;
+            }
+        }
+
+        //
+        // Update the decoding statistics every second
+        //
+        auto now = Timer::getTime();
+        if (now - statsTime >= 1000000)
+        {
+            int64_t frames = _stats->frames;
+            _decodeRate = static_cast<float>(frames - statsFrames) * 1e6f / static_cast<float>(now - statsTime);
+            _decodeTime = frames == 0 ? 0.f : static_cast<float>(_stats->time) / 1e3f / static_cast<float>(frames);
+            statsTime = now;
+            statsFrames = frames;
+        }
+
+        // Wait for the next frame, waking up regularly to follow attribute changes and pending frames
+        int64_t waitTime = frameDuration - max<int64_t>(0, _currentTime) % frameDuration;
+        if (position != shownFrame)
+            waitTime = SPLASH_SEQUENCE_MIN_WAIT_US;
+        waitTime = min<int64_t>(max<int64_t>(waitTime, SPLASH_SEQUENCE_MIN_WAIT_US), SPLASH_SEQUENCE_MAX_WAIT_US);
+        this_thread::sleep_for(chrono::microseconds(waitTime));
+    }
+}
+
+/*************/
+void Image_Sequence::registerAttributes()
+{
+    Image::registerAttributes();
+
+    addAttribute("framerate",
+        [&](const Values& args) {
+            auto framerate = args[0].as<float>();
+            if (framerate <= 0.f)
+                return false;
+            // Keep the current position when changing the framerate
+            auto position = static_cast<float>(_currentTime) * _framerate / framerate;
+            _framerate = framerate;
+            _startTime = Timer::getTime() - static_cast<int64_t>(position);
+            return true;
+        },
+        [&]() -> Values { return {_framerate.load()}; },
+        {'n'});
+    setAttributeParameter("framerate", true, true);
+    setAttributeDescription("framerate", "Playback framerate of the sequence, in frames per second");
+
+    addAttribute("prefetch",
+        [&](const Values& args) {
+            _prefetchCount = max(1, args[0].as<int>());
+            return true;
+        },
+        [&]() -> Values { return {_prefetchCount.load()}; },
+        {'n'});
+    setAttributeParameter("prefetch", true, true);
+    setAttributeDescription("prefetch", "Number of frames decoded ahead of the current one, on the thread pool");
+
+    addAttribute("duration",
+        [&](const Values& args) { return false; },
+        [&]() -> Values { return {static_cast<float>(_frames.size()) / _framerate}; });
+    setAttributeParameter("duration", false, true);
+
+    addAttribute("loop",
+        [&](const Values& args) {
+            _loop = (bool)args[0].as<int>();
+            return true;
+        },
+        [&]() -> Values {
+            int loop = _loop;
+            return {loop};
+        },
+        {'n'});
+    setAttributeParameter("loop", true, true);
+
+    addAttribute("pause",
+        [&](const Values& args) {
+            _paused = args[0].as<int>();
+            return true;
+        },
+        [&]() -> Values { return {(int)_paused}; },
+        {'n'});
+    setAttributeParameter("pause", false, true);
+
+    addAttribute("seek",
+        [&](const Values& args) {
+            _seekTime = max(0.f, args[0].as<float>());
+            _startTime = Timer::getTime() - static_cast<int64_t>(_seekTime * 1e6);
+            _currentTime = static_cast<int64_t>(_seekTime * 1e6);
+            return true;
+        },
+        [&]() -> Values { return {_seekTime}; },
+        {'n'});
+    setAttributeParameter("seek", false, true);
+    setAttributeDescription("seek", "Change the read position in the sequence");
+
+    addAttribute("useClock",
+        [&](const Values& args) {
+            _useClock = args[0].as<int>();
+            return true;
+        },
+        [&]() -> Values { return {(int)_useClock}; },
+        {'n'});
+    setAttributeParameter("useClock", true, true);
+
+    addAttribute("timeShift",
+        [&](const Values& args) {
+            _shiftTime = args[0].as<float>();
+            return true;
+        },
+        [&]() -> Values { return {_shiftTime}; },
+        {'n'});
+    setAttributeParameter("timeShift", true, true);
+
+    addAttribute("decodeRate",
+        [&](const Values& args) { return false; },
+        [&]() -> Values { return {_decodeRate.load()}; });
+    setAttributeParameter("decodeRate", false, true);
+    setAttributeDescription("decodeRate", "Number of frames decoded during the last second");
+
+    addAttribute("decodeTime",
+        [&](const Values& args) { return false; },
+        [&]() -> Values { return {_decodeTime.load()}; });
+    setAttributeParameter("decodeTime", false, true);
+    setAttributeDescription("decodeTime", "Mean decoding time of a frame, in ms");
+
+    addAttribute("underruns",
+        [&](const Values& args) { return false; },
+        [&]() -> Values { return {_underruns.load()}; });
+    setAttributeParameter("underruns", false, true);
+    setAttributeDescription("underruns", "Number of frames which were not decoded in time to be shown");
+}
+
+} // end of namespace
@@ -19,8 +19,7 @@
 #include "threadpool.h"
 #include "timer.h"
 
-#define SPLASH_SHMDATA_THREADS 2
-#define SPLASH_SHMDATA_WITH_POOL 0 // FIXME: there is an issue with the threadpool in the shmdata callback
+#define SPLASH_SHMDATA_ROWS_PER_TASK 64
 
 using namespace std;
 
@@ -294,23 +293,8 @@ void Image_Shmdata::readUncompressedFrame(void* data, int data_size)
     if (!_isYUV && (_channels == 3 || _channels == 4))
     {
         char* pixels = (char*)(_readerBuffer).data();
-        vector<thread> threads;
-        for (int block = 0; block < SPLASH_SHMDATA_THREADS; ++block)
-        {
-            int size = _width * _height * _channels * sizeof(char);
-            threads.push_back(thread([=]() {
-                int sizeOfBlock; // We compute the size of the block, to handle image size non divisible by SPLASH_SHMDATA_THREADS
-                if (size - size / SPLASH_SHMDATA_THREADS * block < 2 * size / SPLASH_SHMDATA_THREADS)
-                    sizeOfBlock = size - size / SPLASH_SHMDATA_THREADS * block;
-                else
-                    sizeOfBlock = size / SPLASH_SHMDATA_THREADS;
-
-                memcpy(pixels + size / SPLASH_SHMDATA_THREADS * block, (const char*)data + size / SPLASH_SHMDATA_THREADS * block, sizeOfBlock);
-            }));
-        }
-        for (auto& t : threads)
-            if (t.joinable())
-                t.join();
+        int size = _width * _height * _channels * sizeof(char);
+        SThread::pool.parallelCopy(pixels, data, size);
     }
     else if (_is420)
     {
@@ -319,22 +303,26 @@ void Image_Shmdata::readUncompressedFrame(void* data, int data_size)
         const unsigned char* V = (const unsigned char*)data + _width * _height * 5 / 4;
         char* pixels = (char*)(_readerBuffer).data();
 
-        for (int y = 0; y < _height; ++y)
-        {
-            for (int x = 0; x < _width; x += 2)
-            {
-                pixels[(x + y * _width) * 2 + 0] = U[(x / 2) + (y / 2) * (_width / 2)];
-                pixels[(x + y * _width) * 2 + 1] = Y[x + y * _width];
-                pixels[(x + y * _width) * 2 + 2] = V[(x / 2) + (y / 2) * (_width / 2)];
-                pixels[(x + y * _width) * 2 + 3] = Y[x + y * _width + 1];
-            }
-        }
+        size_t width = _width;
+        SThread::pool.parallelFor(0, _height,
+            [=](size_t firstRow, size_t lastRow) {
+                for (size_t y = firstRow; y < lastRow; ++y)
+                {
+                    for (size_t x = 0; x < width; x += 2)
+                    {
+                        pixels[(x + y * width) * 2 + 0] = U[(x / 2) + (y / 2) * (width / 2)];
+                        pixels[(x + y * width) * 2 + 1] = Y[x + y * width];
+                        pixels[(x + y * width) * 2 + 2] = V[(x / 2) + (y / 2) * (width / 2)];
+                        pixels[(x + y * width) * 2 + 3] = Y[x + y * width + 1];
+                    }
+                }
+            },
+            SPLASH_SHMDATA_ROWS_PER_TASK);
     }
     else if (_is422)
     {
-        const unsigned char* YUV = (const unsigned char*)data;
         char* pixels = (char*)(_readerBuffer).data();
-        copy(YUV, YUV + _width * _height * 2, pixels);
+        SThread::pool.parallelCopy(pixels, data, _width * _height * 2);
     }
     else
         return;
@@ -5,6 +5,8 @@
 #include <sys/ioctl.h>
 #include <unistd.h>
 
+#include "./threadPlacement.h"
+
 #if HAVE_DATAPATH
 #include "rgb133v4l2.h"
 #endif
@@ -68,6 +70,7 @@ bool Image_V4L2::doCapture()
         _capturing = initializeCapture();
     if (_capturing)
         _captureThread = thread([&]() {
+            auto threadPlacement = ThreadPlacement::get().registerThread(ThreadPlacement::Class::decode);
             _captureThreadRun = true;
             captureThreadFunc();
         });
@@ -1,28 +1,35 @@
 #include "link.h"
 
 #include <algorithm>
+#include <snappy.h>
+#include <unistd.h>
 
 #include "basetypes.h"
 #include "log.h"
+#include "threadPlacement.h"
 #include "timer.h"
 
+#define SPLASH_LINK_SHM_SLOT_COUNT 8
+#define SPLASH_LINK_SHM_RETIRE_DELAY 5000000 // in us
+#define SPLASH_LINK_SUBSCRIPTION_POLL_MS 50
+
 using namespace std;
 
 namespace Splash
 {
 
 /*************/
-Link::Link(weak_ptr<RootObject> root, string name)
+Link::Link(weak_ptr<RootObject> root, string name, int tcpPort)
 {
     try
     {
         _rootObject = root;
         _name = name;
+        _tcpPort = tcpPort;
         _context = make_shared<zmq::context_t>(2);
 
         _socketMessageOut = make_shared<zmq::socket_t>(*_context, ZMQ_PUB);
         _socketMessageIn = make_shared<zmq::socket_t>(*_context, ZMQ_SUB);
-        _socketBufferOut = make_shared<zmq::socket_t>(*_context, ZMQ_PUB);
         _socketBufferIn = make_shared<zmq::socket_t>(*_context, ZMQ_SUB);
     }
     catch (const zmq::error_t& e)
@@ -31,19 +38,35 @@ Link::Link(weak_ptr<RootObject> root, string name)
             Log::get() << Log::WARNING << "Link::" << __FUNCTION__ << " - Exception: " << e.what() << Log::endl;
     }
 
-    _bufferInThread = thread([&]() { handleInputBuffers(); });
-
-    _messageInThread = thread([&]() { handleInputMessages(); });
+    _bufferInThread = thread([&]() {
+        auto threadPlacement = ThreadPlacement::get().registerThread(ThreadPlacement::Class::upload);
+        handleInputBuffers();
+    });
+    _bufferOutThread = thread([&]() {
+        auto threadPlacement = ThreadPlacement::get().registerThread(ThreadPlacement::Class::upload);
+        handleOutputBuffers();
+    });
+
+    _messageInThread = thread([&]() {
+        auto threadPlacement = ThreadPlacement::get().registerThread(ThreadPlacement::Class::background);
+        handleInputMessages();
+    });
 }
 
 /*************/
 Link::~Link()
 {
+    _bufferOutRunning = false;
+    notifyBufferOutput();
+    _bufferOutThread.join();
+
     int lingerValue = 0;
     try
     {
         _socketMessageOut->setsockopt(ZMQ_LINGER, &lingerValue, sizeof(lingerValue));
-        _socketBufferOut->setsockopt(ZMQ_LINGER, &lingerValue, sizeof(lingerValue));
+        for (auto& peer : _bufferPeers)
+            if (peer.second->socket)
+                peer.second->socket->setsockopt(ZMQ_LINGER, &lingerValue, sizeof(lingerValue));
     }
     catch (zmq::error_t e)
     {
@@ -51,7 +74,8 @@ Link::~Link()
     }
 
     _socketMessageOut.reset();
-    _socketBufferOut.reset();
+    for (auto& peer : _bufferPeers)
+        peer.second->socket.reset();
 
     _context.reset();
     _bufferInThread.join();
@@ -60,6 +84,18 @@ Link::~Link()
 
 /*************/
 void Link::connectTo(const string& name)
+{
+    connectToEndpoints(name, "ipc:///tmp/splash_msg_" + name, "ipc:///tmp/splash_buf_" + name, false, BufferCompression::none);
+}
+
+/*************/
+void Link::connectTo(const string& name, const string& address, int port, BufferCompression compression)
+{
+    connectToEndpoints(name, "tcp://" + address + ":" + to_string(port), "tcp://" + address + ":" + to_string(port + 1), true, compression);
+}
+
+/*************/
+void Link::connectToEndpoints(const string& name, const string& messageEndpoint, const string& bufferEndpoint, bool remote, BufferCompression compression)
 {
     if (find(_connectedTargets.begin(), _connectedTargets.end(), name) == _connectedTargets.end())
         _connectedTargets.push_back(name);
@@ -71,11 +107,25 @@ void Link::connectTo(const string& name)
         // High water mark set to zero for the outputs
         int hwm = 0;
         _socketMessageOut->setsockopt(ZMQ_SNDHWM, &hwm, sizeof(hwm));
-        _socketBufferOut->setsockopt(ZMQ_SNDHWM, &hwm, sizeof(hwm));
-
-        // TODO: for now, all connections are through IPC.
-        _socketMessageOut->connect((string("ipc:///tmp/splash_msg_") + name).c_str());
-        _socketBufferOut->connect((string("ipc:///tmp/splash_buf_") + name).c_str());
+        _socketMessageOut->connect(messageEndpoint.c_str());
+
+        // Each peer has its own buffer socket, so that a slow peer does not hold back the others
+        lock_guard<mutex> lock(_bufferPeersMutex);
+        auto& peer = _bufferPeers[name];
+        if (!peer)
+            peer = unique_ptr<BufferPeer>(new BufferPeer());
+        peer->link = this;
+        peer->messageEndpoint = messageEndpoint;
+        peer->remote = remote;
+        peer->compression = compression;
+        peer->socket = make_shared<zmq::socket_t>(*_context, ZMQ_XPUB);
+        peer->socket->setsockopt(ZMQ_SNDHWM, &hwm, sizeof(hwm));
+
+        // All subscriptions are reported, so that buffers can be sent again to a new subscriber
+        int verbose = 1;
+        peer->socket->setsockopt(ZMQ_XPUB_VERBOSE, &verbose, sizeof(verbose));
+
+        peer->socket->connect(bufferEndpoint.c_str());
     }
     catch (const zmq::error_t& e)
     {
@@ -120,8 +170,23 @@ void Link::disconnectFrom(const std::string& name)
         try
         {
             _connectedTargets.erase(targetIt);
-            _socketMessageOut->disconnect((string("ipc:///tmp/splash_msg_") + name).c_str());
-            _socketBufferOut->disconnect((string("ipc:///tmp/splash_msg_") + name).c_str());
+
+            // The peer itself is kept, as ZMQ may still release buffers sent to it
+            lock_guard<mutex> lock(_bufferPeersMutex);
+            auto peerIt = _bufferPeers.find(name);
+            if (peerIt != _bufferPeers.end())
+            {
+                auto& peer = *peerIt->second;
+                _socketMessageOut->disconnect(peer.messageEndpoint.c_str());
+                int lingerValue = 0;
+                peer.socket->setsockopt(ZMQ_LINGER, &lingerValue, sizeof(lingerValue));
+                peer.socket.reset();
+                peer.stats.dropped += peer.mailbox.size();
+                _mailboxNumber -= peer.mailbox.size();
+                peer.mailbox.clear();
+                peer.subscriptions.clear();
+            }
+            notifyBufferOutput();
         }
         catch (const zmq::error_t& e)
         {
@@ -134,30 +199,32 @@ void Link::disconnectFrom(const std::string& name)
 /*************/
 bool Link::waitForBufferSending(chrono::milliseconds maximumWait)
 {
-    bool returnValue;
-    chrono::milliseconds totalWait{0};
+    unique_lock<mutex> lock(_otgMutex);
+    return _bufferSentCondition.wait_for(lock, maximumWait, [&]() { return _otgNumber == 0 && _mailboxNumber == 0; });
+}
 
-    while (true)
+/*************/
+void Link::notifyBufferOutput()
+{
     {
-        if (_otgNumber == 0)
-        {
-            returnValue = true;
-            break;
-        }
-        if (totalWait > maximumWait)
-        {
-            returnValue = false;
-            break;
-        }
-        totalWait = totalWait + chrono::milliseconds(1);
-        this_thread::sleep_for(chrono::milliseconds(1));
+        lock_guard<mutex> lock(_otgMutex);
+        _bufferOutWakeUp = true;
     }
+    _bufferSentCondition.notify_all();
+}
 
-    return returnValue;
+/*************/
+map<string, Link::BufferStats> Link::getBufferStats()
+{
+    map<string, BufferStats> stats;
+    lock_guard<mutex> lock(_bufferPeersMutex);
+    for (auto& peer : _bufferPeers)
+        stats[peer.first] = peer.second->stats;
+    return stats;
 }
 
 /*************/
-bool Link::sendBuffer(const string& name, shared_ptr<SerializedObject> buffer)
+bool Link::sendBuffer(const string& name, shared_ptr<SerializedObject> buffer, bool fitsLimitedBandwidth)
 {
     if (_connectedToInner)
     {
@@ -181,32 +248,205 @@ bool Link::sendBuffer(const string& name, shared_ptr<SerializedObject> buffer)
 
     if (_connectedToOuter)
     {
-        try
+        // The buffer is left in the mailbox of each subscribed peer, replacing any older one not sent yet.
+        // The actual sending is done by the output thread, so that a slow peer never blocks the caller.
+        lock_guard<mutex> lock(_bufferPeersMutex);
+        readBufferSubscribers();
+        for (auto& peerIt : _bufferPeers)
+        {
+            auto& peer = *peerIt.second;
+            if (!peer.socket || !isSubscribed(peer, name))
+                continue;
+            if (peer.compression == BufferCompression::hap && !fitsLimitedBandwidth)
+                continue;
+
+            auto& pendingBuffer = peer.mailbox[name];
+            if (pendingBuffer)
+                ++peer.stats.superseded;
+            else
+                ++_mailboxNumber;
+            pendingBuffer = buffer;
+        }
+    }
+
+    if (_connectedToOuter)
+        notifyBufferOutput();
+
+    return true;
+}
+
+/*************/
+bool Link::sendBufferToPeer(BufferPeer& peer, const string& name, const shared_ptr<SerializedObject>& buffer)
+{
+    // Remote peers may get compressed buffers. For peers on the same host, we try to write
+    // the buffer once in shared memory and only send its descriptor, which is kept for the other peers.
+    auto transport = BufferTransport::inline_data;
+    auto payload = buffer;
+    shared_ptr<SharedMemoryRing> ring;
+    if (peer.remote)
+    {
+        if (peer.compression != BufferCompression::none)
+        {
+            transport = BufferTransport::snappy;
+            payload = compressBuffer(name, buffer);
+        }
+    }
+    else if (_useSharedMemory)
+    {
+        auto descriptor = writeBufferToSharedMemory(name, buffer);
+        if (descriptor)
         {
-            lock_guard<Spinlock> lock(_bufferSendMutex);
-            auto bufferPtr = buffer.get();
+            transport = BufferTransport::shared_memory;
+            payload = descriptor;
+            ring = _sharedMemoryRingsOut[name];
+            ++_sharedMemorySent[name];
+        }
+    }
 
-            _otgMutex.lock();
-            _otgBuffers.push_back(buffer);
-            _otgMutex.unlock();
+    try
+    {
+        // The buffer name is followed by the transport used
+        zmq::message_t msg(name.size() + 2);
+        memcpy(msg.data(), (void*)name.c_str(), name.size() + 1);
+        static_cast<char*>(msg.data())[name.size() + 1] = static_cast<char>(transport);
+        peer.socket->send(msg, ZMQ_SNDMORE);
 
+        {
+            lock_guard<mutex> lock(_otgMutex);
+            ++peer.inFlight[name];
             _otgNumber += 1;
+        }
 
-            zmq::message_t msg(name.size() + 1);
-            memcpy(msg.data(), (void*)name.c_str(), name.size() + 1);
-            _socketBufferOut->send(msg, ZMQ_SNDMORE);
+        // The handle is given back by ZMQ once the buffer is released, and deleted then
+        auto handle = new OutgoingBuffer({&peer, name, payload, ring});
+        msg.rebuild(payload->data(), payload->size(), Link::freeOlderBuffer, handle);
+        peer.socket->send(msg);
+    }
+    catch (const zmq::error_t& e)
+    {
+        if (errno != ETERM)
+            Log::get() << Log::WARNING << "Link::" << __FUNCTION__ << " - Exception: " << e.what() << Log::endl;
+        ++peer.stats.dropped;
+        return false;
+    }
 
-            msg.rebuild(bufferPtr->data(), bufferPtr->size(), Link::freeOlderBuffer, this);
-            _socketBufferOut->send(msg);
+    ++peer.stats.sent;
+    return true;
+}
+
+/*************/
+shared_ptr<SerializedObject> Link::writeBufferToSharedMemory(const string& name, const shared_ptr<SerializedObject>& buffer)
+{
+    // If this buffer has already been written for another peer, its descriptor is reused
+    auto lastWriteIt = _sharedMemoryLastWrites.find(name);
+    if (lastWriteIt != _sharedMemoryLastWrites.end() && lastWriteIt->second.first == buffer)
+        return lastWriteIt->second.second;
+
+    // A new ring is created for this buffer if none exists, or if its slots are too small
+    auto ringIt = _sharedMemoryRingsOut.find(name);
+    if (ringIt == _sharedMemoryRingsOut.end() || ringIt->second->getSlotSize() < buffer->size())
+    {
+        auto segment = "/splash_" + to_string(getpid()) + "_" + to_string(hash<string>()(_name)) + "_" + to_string(_sharedMemoryRingIndex++);
+        auto ring = SharedMemoryRing::create(segment, SPLASH_LINK_SHM_SLOT_COUNT, buffer->size());
+        if (!ring)
+        {
+            Log::get() << Log::WARNING << "Link::" << __FUNCTION__ << " - Unable to create a shared memory ring, falling back to sending buffers through sockets" << Log::endl;
+            _useSharedMemory = false;
+            return {};
         }
-        catch (const zmq::error_t& e)
+
+        // The replaced ring is kept until the peers received all the descriptors sent from it
+        if (ringIt != _sharedMemoryRingsOut.end())
+            _sharedMemoryRingsRetired.push_back({ringIt->second, _sharedMemorySent[name], Timer::getTime()});
+
+        _sharedMemoryRingsOut[name] = std::move(ring);
+        _sharedMemorySent[name] = 0;
+        ringIt = _sharedMemoryRingsOut.find(name);
+    }
+
+    // If all slots are still held by the peers, the buffer is sent through the socket
+    SharedMemoryRing::Descriptor desc;
+    if (!ringIt->second->write(buffer->data(), buffer->size(), desc))
+        return {};
+
+    auto descriptor = make_shared<SerializedObject>(sizeof(desc));
+    memcpy(descriptor->data(), (void*)&desc, sizeof(desc));
+    _sharedMemoryLastWrites[name] = make_pair(buffer, descriptor);
+
+    return descriptor;
+}
+
+/*************/
+void Link::releaseLastWrites()
+{
+    // The last written buffers are only useful while some peer still has them in its mailbox
+    auto isWaiting = [&](const string& name, const shared_ptr<SerializedObject>& buffer) {
+        for (auto& peerIt : _bufferPeers)
         {
-            if (errno != ETERM)
-                Log::get() << Log::WARNING << "Link::" << __FUNCTION__ << " - Exception: " << e.what() << Log::endl;
+            auto bufferIt = peerIt.second->mailbox.find(name);
+            if (bufferIt != peerIt.second->mailbox.end() && bufferIt->second == buffer)
+                return true;
+        }
+        return false;
+    };
+
+    for (auto lastWrites : {&_sharedMemoryLastWrites, &_compressedLastWrites})
+    {
+        for (auto lastWriteIt = lastWrites->begin(); lastWriteIt != lastWrites->end();)
+        {
+            if (isWaiting(lastWriteIt->first, lastWriteIt->second.first))
+                ++lastWriteIt;
+            else
+                lastWriteIt = lastWrites->erase(lastWriteIt);
         }
     }
 
-    return true;
+    // A replaced ring is removed once ZMQ released all its descriptors and the peers acknowledged them.
+    // Descriptors dropped on the way are never acknowledged, so the ring is also removed after a delay.
+    auto now = Timer::getTime();
+    _sharedMemoryRingsRetired.erase(remove_if(_sharedMemoryRingsRetired.begin(),
+                                        _sharedMemoryRingsRetired.end(),
+                                        [&](const RetiredRing& retired) {
+                                            if (retired.ring.use_count() > 1)
+                                                return false;
+                                            return retired.ring->getAcknowledgements() >= retired.sent || now - retired.retireTime > SPLASH_LINK_SHM_RETIRE_DELAY;
+                                        }),
+        _sharedMemoryRingsRetired.end());
+}
+
+/*************/
+shared_ptr<SerializedObject> Link::compressBuffer(const string& name, const shared_ptr<SerializedObject>& buffer)
+{
+    // If this buffer has already been compressed for another peer, it is reused
+    auto lastWriteIt = _compressedLastWrites.find(name);
+    if (lastWriteIt != _compressedLastWrites.end() && lastWriteIt->second.first == buffer)
+        return lastWriteIt->second.second;
+
+    auto compressed = make_shared<SerializedObject>(static_cast<int>(snappy::MaxCompressedLength(buffer->size())));
+    size_t compressedSize = 0;
+    snappy::RawCompress(buffer->data(), buffer->size(), compressed->data(), &compressedSize);
+    compressed->resize(compressedSize);
+
+    _compressedLastWrites[name] = make_pair(buffer, compressed);
+    return compressed;
+}
+
+/*************/
+shared_ptr<SerializedObject> Link::uncompressBuffer(const zmq::message_t& msg)
+{
+    auto data = static_cast<const char*>(msg.data());
+    size_t size = 0;
+    if (!snappy::GetUncompressedLength(data, msg.size(), &size))
+        return {};
+
+    auto buffer = make_shared<SerializedObject>(static_cast<int>(size));
+    if (!snappy::RawUncompress(data, msg.size(), buffer->data()))
+    {
+        Log::get() << Log::WARNING << "Link::" << __FUNCTION__ << " - Unable to uncompress received buffer" << Log::endl;
+        return {};
+    }
+
+    return buffer;
 }
 
 /*************/
@@ -217,75 +457,85 @@ bool Link::sendBuffer(const string& name, const shared_ptr<BufferObject>& object
 }
 
 /*************/
-bool Link::sendMessage(const string& name, const string& attribute, const Values& message)
+void Link::setBufferSubscriptions(const set<string>& names)
+{
+    lock_guard<mutex> lock(_requestedSubscriptionsMutex);
+    _requestedSubscriptions = names;
+    _subscriptionsRequested = true;
+}
+
+/*************/
+bool Link::isBufferNeeded(const string& name)
 {
     if (_connectedToInner)
-    {
-        for (auto& rootObjectIt : _connectedTargetPointers)
-        {
-            auto rootObject = rootObjectIt.second.lock();
-            if (rootObject)
-                rootObject->set(name, attribute, message);
-        }
-    }
+        return true;
 
-    if (_connectedToOuter)
+    if (!_connectedToOuter)
+        return false;
+
+    lock_guard<mutex> lock(_bufferPeersMutex);
+    readBufferSubscribers();
+    for (auto& peer : _bufferPeers)
+        if (peer.second->socket && isSubscribed(*peer.second, name))
+            return true;
+
+    return false;
+}
+
+/*************/
+bool Link::isSubscribed(const BufferPeer& peer, const string& name)
+{
+    return peer.subscriptions.find("") != peer.subscriptions.end() || peer.subscriptions.find(name) != peer.subscriptions.end();
+}
+
+/*************/
+vector<string> Link::getNewBufferSubscriptions()
+{
+    lock_guard<mutex> lock(_bufferPeersMutex);
+    readBufferSubscribers();
+
+    auto names = vector<string>();
+    swap(names, _newBufferSubscribers);
+    return names;
+}
+
+/*************/
+void Link::readBufferSubscribers()
+{
+    for (auto& peerIt : _bufferPeers)
     {
+        auto& peer = *peerIt.second;
+        if (!peer.socket)
+            continue;
+
         try
         {
-            lock_guard<Spinlock> lock(_msgSendMutex);
-
-            // First we send the name of the target
-            zmq::message_t msg(name.size() + 1);
-            memcpy(msg.data(), (void*)name.c_str(), name.size() + 1);
-            _socketMessageOut->send(msg, ZMQ_SNDMORE);
-
-            // And the target's attribute
-            msg.rebuild(attribute.size() + 1);
-            memcpy(msg.data(), (void*)attribute.c_str(), attribute.size() + 1);
-            _socketMessageOut->send(msg, ZMQ_SNDMORE);
-
-            // Helper function to send messages
-            std::function<void(const Values& message)> sendMessage;
-            sendMessage = [&](const Values& message) {
-                // Size of the message
-                int size = message.size();
-                msg.rebuild(sizeof(size));
-                memcpy(msg.data(), (void*)&size, sizeof(size));
-
-                if (message.size() == 0)
-                    _socketMessageOut->send(msg);
-                else
-                    _socketMessageOut->send(msg, ZMQ_SNDMORE);
-
-                for (int i = 0; i < message.size(); ++i)
-                {
-                    auto v = message[i];
-                    Value::Type valueType = v.getType();
+            zmq::message_t msg;
+            while (peer.socket->recv(&msg, ZMQ_DONTWAIT))
+            {
+                if (msg.size() == 0)
+                    continue;
 
-                    msg.rebuild(sizeof(valueType));
-                    memcpy(msg.data(), (void*)&valueType, sizeof(valueType));
-                    _socketMessageOut->send(msg, ZMQ_SNDMORE);
+                // Subscriptions are a byte set to 1 (subscribe) or 0 (unsubscribe), followed by the topic.
+                // Topics are buffer names with their null terminator, or empty to receive everything.
+                auto data = static_cast<char*>(msg.data());
+                auto name = string(data + 1, strnlen(data + 1, msg.size() - 1));
 
-                    if (valueType == Value::Type::v)
-                        sendMessage(v.as<Values>());
-                    else
+                if (data[0] == 1)
+                {
+                    peer.subscriptions.insert(name);
+                    _newBufferSubscribers.push_back(name);
+                }
+                else if (data[0] == 0)
+                {
+                    peer.subscriptions.erase(name);
+                    if (peer.mailbox.erase(name) != 0)
                     {
-                        int valueSize = (valueType == Value::Type::s) ? v.size() + 1 : v.size();
-                        void* value = v.data();
-                        msg.rebuild(valueSize);
-                        memcpy(msg.data(), value, valueSize);
-
-                        if (i != message.size() - 1)
-                            _socketMessageOut->send(msg, ZMQ_SNDMORE);
-                        else
-                            _socketMessageOut->send(msg);
+                        ++peer.stats.dropped;
+                        --_mailboxNumber;
                     }
                 }
-            };
-
-            // Send the message
-            sendMessage(message);
+            }
         }
         catch (const zmq::error_t& e)
         {
@@ -293,6 +543,71 @@ bool Link::sendMessage(const string& name, const string& attribute, const Values
                 Log::get() << Log::WARNING << "Link::" << __FUNCTION__ << " - Exception: " << e.what() << Log::endl;
         }
     }
+}
+
+/*************/
+void Link::applyBufferSubscriptions()
+{
+    set<string> names;
+    {
+        lock_guard<mutex> lock(_requestedSubscriptionsMutex);
+        if (!_subscriptionsRequested)
+            return;
+        names = _requestedSubscriptions;
+        _subscriptionsRequested = false;
+    }
+
+    // Topics are matched as prefixes, the null terminator is included so that only full names match
+    for (auto& name : _bufferSubscriptions)
+        if (names.find(name) == names.end())
+            _socketBufferIn->setsockopt(ZMQ_UNSUBSCRIBE, name.c_str(), name.size() + 1);
+    for (auto& name : names)
+        if (_bufferSubscriptions.find(name) == _bufferSubscriptions.end())
+            _socketBufferIn->setsockopt(ZMQ_SUBSCRIBE, name.c_str(), name.size() + 1);
+
+    if (_subscribedToAllBuffers)
+    {
+        _socketBufferIn->setsockopt(ZMQ_UNSUBSCRIBE, NULL, 0);
+        _subscribedToAllBuffers = false;
+    }
+
+    _bufferSubscriptions = names;
+}
+
+/*************/
+bool Link::sendMessage(const string& name, const string& attribute, const Values& message)
+{
+    if (_connectedToInner)
+    {
+        for (auto& rootObjectIt : _connectedTargetPointers)
+        {
+            auto rootObject = rootObjectIt.second.lock();
+            if (rootObject)
+                rootObject->set(name, attribute, message);
+        }
+    }
+
+    if (_connectedToOuter)
+    {
+        lock_guard<Spinlock> lock(_msgSendMutex);
+        encodeMessage(_messageBatch, name, attribute, message);
+
+        if (!_batchMessages)
+        {
+            try
+            {
+                zmq::message_t msg(_messageBatch.size());
+                memcpy(msg.data(), _messageBatch.data(), _messageBatch.size());
+                _messageBatch.clear();
+                _socketMessageOut->send(msg);
+            }
+            catch (const zmq::error_t& e)
+            {
+                if (errno != ETERM)
+                    Log::get() << Log::WARNING << "Link::" << __FUNCTION__ << " - Exception: " << e.what() << Log::endl;
+            }
+        }
+    }
 
 // We don't display broadcast messages, for visibility
 #ifdef DEBUG
@@ -304,22 +619,221 @@ bool Link::sendMessage(const string& name, const string& attribute, const Values
 }
 
 /*************/
-void Link::freeOlderBuffer(void* data, void* hint)
+void Link::startMessageBatch()
+{
+    lock_guard<Spinlock> lock(_msgSendMutex);
+    _batchMessages = true;
+}
+
+/*************/
+bool Link::stopMessageBatch()
+{
+    {
+        lock_guard<Spinlock> lock(_msgSendMutex);
+        _batchMessages = false;
+    }
+
+    return flushMessageBatch();
+}
+
+/*************/
+bool Link::flushMessageBatch()
+{
+    lock_guard<Spinlock> lock(_msgSendMutex);
+
+    if (!_connectedToOuter || _messageBatch.empty())
+        return true;
+
+    try
+    {
+        zmq::message_t msg(_messageBatch.size());
+        memcpy(msg.data(), _messageBatch.data(), _messageBatch.size());
+        _messageBatch.clear();
+        _socketMessageOut->send(msg);
+    }
+    catch (const zmq::error_t& e)
+    {
+        if (errno != ETERM)
+            Log::get() << Log::WARNING << "Link::" << __FUNCTION__ << " - Exception: " << e.what() << Log::endl;
+        return false;
+    }
+
+    return true;
+}
+
+/*************/
+void Link::encodeMessage(vector<char>& buffer, const string& name, const string& attribute, const Values& message)
 {
-    Link* ctx = (Link*)hint;
-    lock_guard<Spinlock> lock(ctx->_otgMutex);
-    int index = 0;
-    for (; index < ctx->_otgBuffers.size(); ++index)
-        if (ctx->_otgBuffers[index]->data() == data)
+    buffer.insert(buffer.end(), name.c_str(), name.c_str() + name.size() + 1);
+    buffer.insert(buffer.end(), attribute.c_str(), attribute.c_str() + attribute.size() + 1);
+    encodeValues(buffer, message);
+}
+
+/*************/
+void Link::encodeValues(vector<char>& buffer, const Values& values)
+{
+    auto append = [&](const void* data, size_t size) { buffer.insert(buffer.end(), static_cast<const char*>(data), static_cast<const char*>(data) + size); };
+
+    uint32_t count = values.size();
+    append(&count, sizeof(count));
+
+    for (auto& v : values)
+    {
+        uint8_t valueType = v.getType();
+        append(&valueType, sizeof(valueType));
+
+        switch (v.getType())
+        {
+        case Value::Type::i:
+        {
+            auto value = v.as<int64_t>();
+            append(&value, sizeof(value));
+            break;
+        }
+        case Value::Type::f:
+        {
+            auto value = v.as<double>();
+            append(&value, sizeof(value));
+            break;
+        }
+        case Value::Type::s:
+        {
+            auto value = v.as<string>();
+            uint32_t size = value.size();
+            append(&size, sizeof(size));
+            append(value.c_str(), size);
             break;
+        }
+        case Value::Type::v:
+            encodeValues(buffer, v.as<Values>());
+            break;
+        }
+    }
+}
 
-    if (index >= ctx->_otgBuffers.size())
+/*************/
+bool Link::decodeValues(const char*& ptr, const char* end, Values& values)
+{
+    auto read = [&](void* data, size_t size) {
+        if (static_cast<size_t>(end - ptr) < size)
+            return false;
+        memcpy(data, ptr, size);
+        ptr += size;
+        return true;
+    };
+
+    uint32_t count;
+    if (!read(&count, sizeof(count)))
+        return false;
+
+    for (uint32_t i = 0; i < count; ++i)
     {
-        Log::get() << Log::WARNING << "Link::" << __FUNCTION__ << " - Buffer to free not found in currently sent buffers list" << Log::endl;
-        return;
+        uint8_t valueType;
+        if (!read(&valueType, sizeof(valueType)))
+            return false;
+
+        switch (valueType)
+        {
+        default:
+            return false;
+        case Value::Type::i:
+        {
+            int64_t value;
+            if (!read(&value, sizeof(value)))
+                return false;
+            values.push_back(value);
+            break;
+        }
+        case Value::Type::f:
+        {
+            double value;
+            if (!read(&value, sizeof(value)))
+                return false;
+            values.push_back(value);
+            break;
+        }
+        case Value::Type::s:
+        {
+            uint32_t size;
+            if (!read(&size, sizeof(size)) || static_cast<size_t>(end - ptr) < size)
+                return false;
+            values.push_back(string(ptr, size));
+            ptr += size;
+            break;
+        }
+        case Value::Type::v:
+        {
+            Values nested;
+            if (!decodeValues(ptr, end, nested))
+                return false;
+            values.push_back(nested);
+            break;
+        }
+        }
+    }
+
+    return true;
+}
+
+/*************/
+void Link::freeOlderBuffer(void* data, void* hint)
+{
+    auto handle = static_cast<OutgoingBuffer*>(hint);
+    auto peer = handle->peer;
+    auto ctx = peer->link;
+
+    {
+        lock_guard<mutex> lock(ctx->_otgMutex);
+        --peer->inFlight[handle->name];
+        ctx->_otgNumber -= 1;
+        ctx->_bufferOutWakeUp = true;
+    }
+    ctx->_bufferSentCondition.notify_all();
+
+    delete handle;
+}
+
+/*************/
+void Link::handleOutputBuffers()
+{
+    while (_bufferOutRunning)
+    {
+        {
+            lock_guard<mutex> lock(_bufferPeersMutex);
+            readBufferSubscribers();
+
+            // Only the latest buffer for each name is sent to a peer, once the previous one has been released
+            for (auto& peerIt : _bufferPeers)
+            {
+                auto& peer = *peerIt.second;
+                if (!peer.socket)
+                    continue;
+
+                for (auto bufferIt = peer.mailbox.begin(); bufferIt != peer.mailbox.end();)
+                {
+                    {
+                        lock_guard<mutex> lockOtg(_otgMutex);
+                        if (peer.inFlight[bufferIt->first] > 0)
+                        {
+                            ++bufferIt;
+                            continue;
+                        }
+                    }
+
+                    sendBufferToPeer(peer, bufferIt->first, bufferIt->second);
+                    bufferIt = peer.mailbox.erase(bufferIt);
+                    --_mailboxNumber;
+                }
+            }
+
+            releaseLastWrites();
+        }
+
+        // Wake up as soon as a buffer is queued or released, and regularly to read subscriptions
+        unique_lock<mutex> lock(_otgMutex);
+        _bufferSentCondition.wait_for(lock, chrono::milliseconds(SPLASH_LINK_SUBSCRIPTION_POLL_MS), [&]() { return _bufferOutWakeUp || !_bufferOutRunning; });
+        _bufferOutWakeUp = false;
     }
-    ctx->_otgBuffers.erase(ctx->_otgBuffers.begin() + index);
-    ctx->_otgNumber -= 1;
 }
 
 /*************/
@@ -332,54 +846,49 @@ void Link::handleInputMessages()
         _socketMessageIn->setsockopt(ZMQ_RCVHWM, &hwm, sizeof(hwm));
 
         _socketMessageIn->bind((string("ipc:///tmp/splash_msg_") + _name).c_str());
+        if (_tcpPort != 0)
+            _socketMessageIn->bind(("tcp://*:" + to_string(_tcpPort)).c_str());
         _socketMessageIn->setsockopt(ZMQ_SUBSCRIBE, NULL, 0); // We subscribe to all incoming messages
 
-        // Helper function to receive messages
-        zmq::message_t msg;
-        std::function<Values(void)> recvMessage;
-        recvMessage = [&]() -> Values {
-            _socketMessageIn->recv(&msg); // size of the message
-            int size = *(int*)msg.data();
-
-            Values values;
-            for (int i = 0; i < size; ++i)
-            {
-                _socketMessageIn->recv(&msg);
-                Value::Type valueType = *(Value::Type*)msg.data();
-                if (valueType == Value::Type::v)
-                    values.push_back(recvMessage());
-                else
-                {
-                    _socketMessageIn->recv(&msg);
-                    if (valueType == Value::Type::i)
-                        values.push_back(*(int64_t*)msg.data());
-                    else if (valueType == Value::Type::f)
-                        values.push_back(*(double*)msg.data());
-                    else if (valueType == Value::Type::s)
-                        values.push_back(string((char*)msg.data()));
-                }
-            }
-            return values;
-        };
-
         while (true)
         {
-            _socketMessageIn->recv(&msg); // name of the target
-            string name((char*)msg.data());
-            _socketMessageIn->recv(&msg); // target's attribute
-            string attribute((char*)msg.data());
-
-            Values values = recvMessage();
+            // Each ZMQ message holds a batch of one or more encoded messages
+            zmq::message_t msg;
+            _socketMessageIn->recv(&msg);
 
-            auto root = _rootObject.lock();
-            if (root)
-                root->set(name, attribute, values);
+            auto ptr = static_cast<const char*>(msg.data());
+            auto end = ptr + msg.size();
+            while (ptr < end)
+            {
+                auto nameSize = strnlen(ptr, end - ptr);
+                if (ptr + nameSize == end)
+                    break;
+                string name(ptr, nameSize);
+                ptr += nameSize + 1;
+
+                auto attributeSize = strnlen(ptr, end - ptr);
+                if (ptr + attributeSize == end)
+                    break;
+                string attribute(ptr, attributeSize);
+                ptr += attributeSize + 1;
+
+                Values values;
+                if (!decodeValues(ptr, end, values))
+                    break;
+
+                auto root = _rootObject.lock();
+                if (root)
+                    root->set(name, attribute, values);
 // We don't display broadcast messages, for visibility
 #ifdef DEBUG
-            if (name != SPLASH_ALL_PEERS)
-                Log::get() << Log::DEBUGGING << "Link::" << __FUNCTION__ << " (" << root->getName() << ")"
-                           << " - Receiving message for " << name << "::" << attribute << Log::endl;
+                if (name != SPLASH_ALL_PEERS)
+                    Log::get() << Log::DEBUGGING << "Link::" << __FUNCTION__ << " (" << root->getName() << ")"
+                               << " - Receiving message for " << name << "::" << attribute << Log::endl;
 #endif
+            }
+
+            if (ptr != end)
+                Log::get() << Log::WARNING << "Link::" << __FUNCTION__ << " - Received a malformed message batch, dropping the remaining messages" << Log::endl;
         }
     }
     catch (const zmq::error_t& e)
@@ -391,6 +900,35 @@ void Link::handleInputMessages()
     _socketMessageIn.reset();
 }
 
+/*************/
+shared_ptr<SerializedObject> Link::receiveBufferFromSharedMemory(const string& name, const zmq::message_t& msg)
+{
+    SharedMemoryRing::Descriptor desc;
+    if (msg.size() != sizeof(desc))
+        return {};
+    memcpy((void*)&desc, msg.data(), sizeof(desc));
+
+    // If the sender created a new ring for this buffer, the previous mapping stays alive as long as its slots are held
+    auto& ring = _sharedMemoryRingsIn[name];
+    if (!ring || !ring->matches(desc))
+        ring = SharedMemoryRing::open(desc);
+
+    // Tell the sender that this descriptor arrived, even if its slot has been rewritten since
+    if (ring)
+        ring->acknowledge();
+
+    auto data = SharedMemoryRing::acquire(ring, desc);
+    if (data.size() == 0)
+    {
+#ifdef DEBUG
+        Log::get() << Log::DEBUGGING << "Link::" << __FUNCTION__ << " - Buffer " << name << " was overwritten before being received, dropping it" << Log::endl;
+#endif
+        return {};
+    }
+
+    return make_shared<SerializedObject>(std::move(data));
+}
+
 /*************/
 void Link::handleInputBuffers()
 {
@@ -400,18 +938,38 @@ void Link::handleInputBuffers()
         int hwm = 1;
         _socketBufferIn->setsockopt(ZMQ_RCVHWM, &hwm, sizeof(hwm));
 
+        // Receiving times out regularly to apply subscription changes
+        int timeout = SPLASH_LINK_SUBSCRIPTION_POLL_MS;
+        _socketBufferIn->setsockopt(ZMQ_RCVTIMEO, &timeout, sizeof(timeout));
+
         _socketBufferIn->bind((string("ipc:///tmp/splash_buf_") + _name).c_str());
-        _socketBufferIn->setsockopt(ZMQ_SUBSCRIBE, NULL, 0); // We subscribe to all incoming messages
+        if (_tcpPort != 0)
+            _socketBufferIn->bind(("tcp://*:" + to_string(_tcpPort + 1)).c_str());
+        _socketBufferIn->setsockopt(ZMQ_SUBSCRIBE, NULL, 0); // We subscribe to all incoming messages, until told otherwise
 
         while (true)
         {
-            zmq::message_t msg;
+            applyBufferSubscriptions();
 
-            _socketBufferIn->recv(&msg);
+            zmq::message_t msg;
+            if (!_socketBufferIn->recv(&msg))
+                continue;
             string name((char*)msg.data());
+            auto transport = BufferTransport::inline_data;
+            if (msg.size() > name.size() + 1)
+                transport = static_cast<BufferTransport>(static_cast<char*>(msg.data())[name.size() + 1]);
 
             _socketBufferIn->recv(&msg);
-            shared_ptr<SerializedObject> buffer = make_shared<SerializedObject>((char*)msg.data(), (char*)msg.data() + msg.size());
+            shared_ptr<SerializedObject> buffer;
+            if (transport == BufferTransport::shared_memory)
+                buffer = receiveBufferFromSharedMemory(name, msg);
+            else if (transport == BufferTransport::snappy)
+                buffer = uncompressBuffer(msg);
+            else
+                buffer = make_shared<SerializedObject>((char*)msg.data(), (char*)msg.data() + msg.size());
+
+            if (!buffer)
+                continue;
 
             auto root = _rootObject.lock();
             if (root)
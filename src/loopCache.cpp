@@ -0,0 +1,116 @@
+#include "./loopCache.h"
+
+#include "./log.h"
+
+#define SPLASH_LOOP_CACHE_DEFAULT_BUDGET_MB 1024
+
+using namespace std;
+
+namespace Splash
+{
+
+/*************/
+LoopCache::LoopCache()
+    : _budget(static_cast<uint64_t>(SPLASH_LOOP_CACHE_DEFAULT_BUDGET_MB) * 1048576)
+{
+}
+
+/*************/
+shared_ptr<const LoopCache::Clip> LoopCache::find(const string& path)
+{
+    lock_guard<mutex> lock(_mutex);
+    auto entryIt = _clips.find(path);
+    if (entryIt == _clips.end())
+        return {};
+
+    entryIt->second.lastUse = ++_useCounter;
+    return entryIt->second.clip;
+}
+
+/*************/
+shared_ptr<const LoopCache::Clip> LoopCache::insert(const string& path, const shared_ptr<Clip>& clip)
+{
+    lock_guard<mutex> lock(_mutex);
+    auto entryIt = _clips.find(path);
+    if (entryIt != _clips.end())
+    {
+        // Another source recorded the same file first
+        _usedSize -= min(_usedSize, clip->size);
+        entryIt->second.lastUse = ++_useCounter;
+        return entryIt->second.clip;
+    }
+
+    auto& entry = _clips[path];
+    entry.clip = clip;
+    entry.lastUse = ++_useCounter;
+
+    Log::get() << Log::MESSAGE << "LoopCache::" << __FUNCTION__ << " - Cached " << clip->frames.size() << " frames (" << clip->size / 1048576 << "MB) from file " << path
+               << Log::endl;
+    return entry.clip;
+}
+
+/*************/
+bool LoopCache::reserve(uint64_t size)
+{
+    lock_guard<mutex> lock(_mutex);
+    if (!makeRoom(size))
+        return false;
+    _usedSize += size;
+    return true;
+}
+
+/*************/
+void LoopCache::release(uint64_t size)
+{
+    lock_guard<mutex> lock(_mutex);
+    _usedSize -= min(_usedSize, size);
+}
+
+/*************/
+void LoopCache::setBudget(uint64_t size)
+{
+    lock_guard<mutex> lock(_mutex);
+    _budget = size;
+    makeRoom(0);
+}
+
+/*************/
+uint64_t LoopCache::getBudget() const
+{
+    lock_guard<mutex> lock(_mutex);
+    return _budget;
+}
+
+/*************/
+uint64_t LoopCache::getUsedSize() const
+{
+    lock_guard<mutex> lock(_mutex);
+    return _usedSize;
+}
+
+/*************/
+bool LoopCache::makeRoom(uint64_t size)
+{
+    while (_usedSize + size > _budget)
+    {
+        // Only clips held by the cache alone can be evicted
+        auto oldest = _clips.end();
+        for (auto entryIt = _clips.begin(); entryIt != _clips.end(); ++entryIt)
+        {
+            if (entryIt->second.clip.use_count() > 1)
+                continue;
+            if (oldest == _clips.end() || entryIt->second.lastUse < oldest->second.lastUse)
+                oldest = entryIt;
+        }
+
+        if (oldest == _clips.end())
+            return false;
+
+        _usedSize -= min(_usedSize, oldest->second.clip->size);
+        _clips.erase(oldest);
+    }
+
+    return true;
+}
+
+} // end of namespace
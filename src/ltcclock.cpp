@@ -4,6 +4,7 @@
 #include <iostream>
 
 #include "log.h"
+#include "threadPlacement.h"
 #include "timer.h"
 
 using namespace std;
@@ -30,6 +31,7 @@ LtcClock::LtcClock(bool masterClock, const string& deviceName)
     Log::get() << Log::MESSAGE << "LtcClock::" << __FUNCTION__ << " - Input clock enabled" << Log::endl;
 
     _ltcThread = thread([&]() {
+        auto threadPlacement = ThreadPlacement::get().registerThread(ThreadPlacement::Class::background);
         LTCDecoder* ltcDecoder = ltc_decoder_create(1920, 32);
         LTCFrameExt ltcFrame;
 
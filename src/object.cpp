@@ -90,6 +90,8 @@ void Object::activate()
             shaderParameters.push_back("VERTEXBLENDING");
         if (_textures.size() > 0 && _textures[0]->getType() == "texture_syphon")
             shaderParameters.push_back("TEXTURE_RECT");
+        else if (_textures.size() > 0 && _textures[0]->getType() == "texture_array")
+            shaderParameters.push_back("TEXTURE_ARRAY");
 
         shaderParameters.push_front("texture");
         _shader->setAttribute("fill", shaderParameters);
@@ -117,6 +119,8 @@ void Object::activate()
     // Set some uniforms
     _shader->setAttribute("sideness", {_sideness});
     _shader->setAttribute("uniform", {"_normalExp", _normalExponent});
+    if (_textures.size() > 0 && _textures[0]->getType() == "texture_array")
+        _shader->setAttribute("uniform", {"_tex0_layer", _textureLayer});
 
     if (_geometries.size() > 0)
     {
@@ -221,7 +225,14 @@ bool Object::linkTo(shared_ptr<BaseObject> obj)
     if (!BaseObject::linkTo(obj))
         return false;
 
-    if (obj->getType().find("texture") != string::npos)
+    // Texture arrays are sampled directly, each object selecting its layer
+    if (obj->getType() == "texture_array")
+    {
+        auto tex = dynamic_pointer_cast<Texture>(obj);
+        addTexture(tex);
+        return true;
+    }
+    else if (obj->getType().find("texture") != string::npos)
     {
         auto filter = make_shared<Filter>(_root);
         filter->setName(getName() + "_" + obj->getName() + "_filter");
@@ -289,7 +300,12 @@ bool Object::linkTo(shared_ptr<BaseObject> obj)
 void Object::unlinkFrom(shared_ptr<BaseObject> obj)
 {
     auto type = obj->getType();
-    if (type.find("texture") != string::npos)
+    if (type == "texture_array")
+    {
+        auto tex = dynamic_pointer_cast<Texture>(obj);
+        removeTexture(tex);
+    }
+    else if (type.find("texture") != string::npos)
     {
         auto filterName = getName() + "_" + obj->getName() + "_filter";
         auto filter = _root.lock()->unregisterObject(filterName);
@@ -627,6 +643,15 @@ void Object::registerAttributes()
         {'n'});
     setAttributeDescription("sideness", "If set to 0 or 1, the object is single-sided. If set to 2, it is double-sided");
 
+    addAttribute("textureLayer",
+        [&](const Values& args) {
+            _textureLayer = max(0, args[0].as<int>());
+            return true;
+        },
+        [&]() -> Values { return {_textureLayer}; },
+        {'n'});
+    setAttributeDescription("textureLayer", "Layer to sample when the object is linked to a texture array");
+
     addAttribute("fill",
         [&](const Values& args) {
             _fill = args[0].as<string>();
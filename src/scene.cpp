@@ -1,5 +1,7 @@
 #include "scene.h"
 
+#include <algorithm>
+#include <functional>
 #include <utility>
 
 #include "./camera.h"
@@ -15,7 +17,9 @@
 #include "./osUtils.h"
 #include "./queue.h"
 #include "./texture.h"
+#include "./texture_array.h"
 #include "./texture_image.h"
+#include "./threadPlacement.h"
 #include "./threadpool.h"
 #include "./timer.h"
 #include "./userInput_dragndrop.h"
@@ -40,6 +44,9 @@
 // clang-format on
 #endif
 
+#define SPLASH_REGION_UPDATE_PERIOD 500000
+#define SPLASH_REGION_REFRESH_PERIOD 2000000
+
 using namespace std;
 
 namespace Splash
@@ -48,7 +55,7 @@ namespace Splash
 bool Scene::_isGlfwInitialized{false};
 
 /*************/
-Scene::Scene(const std::string& name)
+Scene::Scene(const std::string& name, const std::string& worldAddress, int tcpPort)
 {
     _self = std::shared_ptr<Scene>(this, [](Scene*) {}); // A shared pointer with no deleter, how convenient
 
@@ -57,6 +64,8 @@ Scene::Scene(const std::string& name)
     _type = "scene";
     _isRunning = true;
     _name = name;
+    _worldAddress = worldAddress;
+    _tcpPort = tcpPort;
     _factory = unique_ptr<Factory>(new Factory(_self));
 
     _blender = make_shared<Blender>(_self);
@@ -74,9 +83,7 @@ Scene::Scene(const std::string& name)
 /*************/
 Scene::~Scene()
 {
-    unique_lock<mutex> lockTexture(_textureUploadMutex);
-    _textureUploadCondition.notify_all();
-    lockTexture.unlock();
+    requestTextureUpload();
     _textureUploadFuture.get();
 
     // Cleanup every object
@@ -421,8 +428,12 @@ void Scene::render()
             // We wait for textures to be uploaded, and we prevent any upload while rendering
             // cameras to prevent tearing
             textureLock.lock();
-            glWaitSync(_textureUploadFence, 0, GL_TIMEOUT_IGNORED);
-            glDeleteSync(_textureUploadFence);
+            if (_textureUploadFence)
+            {
+                glWaitSync(_textureUploadFence, 0, GL_TIMEOUT_IGNORED);
+                glDeleteSync(_textureUploadFence);
+                _textureUploadFence = nullptr;
+            }
             firstTextureSync = false;
         }
 
@@ -457,6 +468,10 @@ void Scene::render()
             if (textureLock.owns_lock())
                 textureLock.unlock();
             firstWindowSync = false;
+
+            // Textures deferred by the upload budget get their turn once per frame
+            if (_textureUploadDeferred.exchange(false))
+                requestTextureUpload();
         }
     }
 
@@ -471,12 +486,15 @@ void Scene::render()
 /*************/
 void Scene::run()
 {
+    auto threadPlacement = ThreadPlacement::get().registerThread(ThreadPlacement::Class::render);
     _textureUploadFuture = async(std::launch::async, [&]() { textureUploadRun(); });
 
     while (_isRunning)
     {
         // Execute waiting tasks
         runTasks();
+        updateBufferSubscriptions();
+        updateRegionsOfInterest();
 
         if (!_started)
         {
@@ -518,9 +536,168 @@ void Scene::updateInputs()
         sendMessageToWorld("quit");
 }
 
+/*************/
+void Scene::updateBufferSubscriptions()
+{
+    set<string> names;
+    {
+        lock_guard<recursive_mutex> lockObjects(_objectsMutex);
+        for (auto& obj : _objects)
+            if (dynamic_pointer_cast<BufferObject>(obj.second))
+                names.insert(obj.first);
+    }
+
+    if (names == _bufferSubscriptions)
+        return;
+
+    _bufferSubscriptions = names;
+    _link->setBufferSubscriptions(_bufferSubscriptions);
+}
+
+/*************/
+void Scene::updateRegionsOfInterest()
+{
+    auto now = Timer::getTime();
+    if (now - _regionsOfInterestTime < SPLASH_REGION_UPDATE_PERIOD)
+        return;
+    _regionsOfInterestTime = now;
+
+    map<string, array<float, 4>> regions;
+    set<string> fullFrames;
+    {
+        lock_guard<recursive_mutex> lockObjects(_objectsMutex);
+
+        // Images sampled by anything else than the meshes of the objects, i.e. windows and warps, are needed whole
+        function<void(const shared_ptr<BaseObject>&, int)> collectFullFrames = [&](const shared_ptr<BaseObject>& parent, int depth) {
+            for (auto& linked : parent->getLinkedObjects())
+            {
+                if (dynamic_pointer_cast<Image>(linked))
+                    fullFrames.insert(linked->getName());
+                else if (depth > 0 && !dynamic_pointer_cast<Object>(linked))
+                    collectFullFrames(linked, depth - 1);
+            }
+        };
+
+        for (auto& obj : _objects)
+        {
+            auto consumer = obj.second;
+            if (dynamic_pointer_cast<Object>(consumer) || dynamic_pointer_cast<BufferObject>(consumer))
+                continue;
+            // Textures and filters are only intermediates, except for warps which are shown as is
+            if (dynamic_pointer_cast<Texture>(consumer) && !dynamic_pointer_cast<Warp>(consumer))
+                continue;
+            collectFullFrames(consumer, 2);
+        }
+
+        // The GUI shows the output of the filters, which has to hold the whole image
+        if (_gui && _guiLinkedToWindow)
+            for (auto& obj : _objects)
+                if (dynamic_pointer_cast<Filter>(obj.second))
+                    collectFullFrames(obj.second, 1);
+
+        for (auto& obj : _objects)
+        {
+            auto object = dynamic_pointer_cast<Object>(obj.second);
+            if (!object)
+                continue;
+
+            // Images are linked to the object directly, or through filters and textures
+            array<float, 4> bounds{1.f, 1.f, 0.f, 0.f};
+            set<shared_ptr<Image>> images;
+            function<void(const shared_ptr<BaseObject>&, int)> collect = [&](const shared_ptr<BaseObject>& parent, int depth) {
+                for (auto& linked : parent->getLinkedObjects())
+                {
+                    // Layers of a texture array must keep the same size, so their images are never cropped
+                    if (dynamic_pointer_cast<Texture_Array>(linked))
+                    {
+                        for (auto& layer : linked->getLinkedObjects())
+                            if (auto image = dynamic_pointer_cast<Image>(layer))
+                                regions[image->getName()] = {0.f, 0.f, 1.f, 1.f};
+                    }
+                    else if (auto mesh = dynamic_pointer_cast<Mesh>(linked))
+                    {
+                        auto uvs = mesh->getUVCoords();
+                        for (size_t i = 0; i + 1 < uvs.size(); i += 2)
+                        {
+                            bounds[0] = min(bounds[0], uvs[i]);
+                            bounds[1] = min(bounds[1], uvs[i + 1]);
+                            bounds[2] = max(bounds[2], uvs[i]);
+                            bounds[3] = max(bounds[3], uvs[i + 1]);
+                        }
+                    }
+                    else if (auto image = dynamic_pointer_cast<Image>(linked))
+                    {
+                        images.insert(image);
+                    }
+                    else if (depth > 0)
+                    {
+                        collect(linked, depth - 1);
+                    }
+                }
+            };
+            collect(object, 2);
+
+            if (images.empty() || bounds[2] <= bounds[0] || bounds[3] <= bounds[1])
+                continue;
+
+            // Repeated textures are sampled everywhere
+            if (bounds[0] < 0.f || bounds[1] < 0.f || bounds[2] > 1.f || bounds[3] > 1.f)
+                bounds = {0.f, 0.f, 1.f, 1.f};
+
+            for (auto& image : images)
+            {
+                // The region is expressed in the image data, which is mirrored by flip and flop
+                Values flip, flop;
+                image->getAttribute("flip", flip);
+                image->getAttribute("flop", flop);
+                auto imageBounds = bounds;
+                if (!flop.empty() && flop[0].as<int>() > 0)
+                    imageBounds = {1.f - bounds[2], imageBounds[1], 1.f - bounds[0], imageBounds[3]};
+                if (!flip.empty() && flip[0].as<int>() > 0)
+                    imageBounds = {imageBounds[0], 1.f - bounds[3], imageBounds[2], 1.f - bounds[1]};
+
+                auto regionIt = regions.find(image->getName());
+                if (regionIt == regions.end())
+                {
+                    regions[image->getName()] = imageBounds;
+                }
+                else
+                {
+                    auto& region = regionIt->second;
+                    region = {min(region[0], imageBounds[0]), min(region[1], imageBounds[1]), max(region[2], imageBounds[2]), max(region[3], imageBounds[3])};
+                }
+            }
+        }
+    }
+
+    for (const auto& name : fullFrames)
+        regions[name] = {0.f, 0.f, 1.f, 1.f};
+
+    // All regions are sent again from time to time, as the World forgets the ones which are not refreshed
+    auto refresh = now - _regionsOfInterestRefreshTime >= SPLASH_REGION_REFRESH_PERIOD;
+    if (refresh)
+        _regionsOfInterestRefreshTime = now;
+
+    for (const auto& region : regions)
+    {
+        auto previousIt = _regionsOfInterest.find(region.first);
+        if (!refresh && previousIt != _regionsOfInterest.end() && previousIt->second == region.second)
+            continue;
+        sendMessageToWorld("regionOfInterest", {_name, region.first, region.second[0], region.second[1], region.second[2], region.second[3]});
+    }
+
+    // Images which are not sampled anymore are removed by sending an empty region
+    for (const auto& region : _regionsOfInterest)
+        if (regions.find(region.first) == regions.end())
+            sendMessageToWorld("regionOfInterest", {_name, region.first, 0.f, 0.f, 0.f, 0.f});
+
+    _regionsOfInterest = regions;
+}
+
 /*************/
 void Scene::textureUploadRun()
 {
+    auto threadPlacement = ThreadPlacement::get().registerThread(ThreadPlacement::Class::upload);
     while (_isRunning)
     {
         if (!_started)
@@ -529,34 +706,60 @@ void Scene::textureUploadRun()
             continue;
         }
 
-        unique_lock<mutex> lockUploadTexture(_textureUploadMutex);
-        _textureUploadCondition.wait(lockUploadTexture);
+        {
+            unique_lock<mutex> lockRequest(_textureUploadRequestMutex);
+            _textureUploadCondition.wait(lockRequest, [&]() { return _textureUploadRequested; });
+            _textureUploadRequested = false;
+        }
 
         if (!_isRunning)
             break;
 
+        unique_lock<mutex> lockUploadTexture(_textureUploadMutex);
+
         unique_lock<Spinlock> lockTexture(_textureMutex);
 
         _textureUploadWindow->setAsCurrentContext();
         glFlush();
-        glWaitSync(_cameraDrawnFence, 0, GL_TIMEOUT_IGNORED);
-        glDeleteSync(_cameraDrawnFence);
+        // Several buffers may be delivered during a single frame, the fence is only waited for once
+        if (_cameraDrawnFence)
+        {
+            glWaitSync(_cameraDrawnFence, 0, GL_TIMEOUT_IGNORED);
+            glDeleteSync(_cameraDrawnFence);
+            _cameraDrawnFence = nullptr;
+        }
 
         Timer::get() << "textureUpload";
 
         vector<shared_ptr<Texture>> textures;
+        set<BaseObject*> visible;
         bool expectedAtomicValue = false;
         if (!_objectsCurrentlyUpdated.compare_exchange_strong(expectedAtomicValue, true))
         {
+            // Cameras see their objects, which see their textures through filters
+            function<void(const shared_ptr<BaseObject>&, int)> collect = [&](const shared_ptr<BaseObject>& parent, int depth) {
+                for (auto& linked : parent->getLinkedObjects())
+                {
+                    visible.insert(linked.get());
+                    if (depth > 0)
+                        collect(linked, depth - 1);
+                }
+            };
+
             for (auto& obj : _objects)
+            {
                 if (obj.second->getType().find("texture") != string::npos)
                     textures.emplace_back(dynamic_pointer_cast<Texture>(obj.second));
+                else if (obj.second->getType() == "camera")
+                    collect(obj.second, 3);
+            }
             _objectsCurrentlyUpdated = false;
         }
 
-        for (auto& texture : textures)
-            texture->update();
+        _textureUploadDeferred = uploadTextures(textures, visible);
 
+        if (_textureUploadFence)
+            glDeleteSync(_textureUploadFence);
         _textureUploadFence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
         lockTexture.unlock();
 
@@ -572,6 +775,83 @@ void Scene::textureUploadRun()
     }
 }
 
+/*************/
+void Scene::requestTextureUpload()
+{
+    lock_guard<mutex> lockRequest(_textureUploadRequestMutex);
+    _textureUploadRequested = true;
+    _textureUploadCondition.notify_all();
+}
+
+/*************/
+void Scene::signalBufferObjectUpdated()
+{
+    RootObject::signalBufferObjectUpdated();
+    requestTextureUpload();
+}
+
+/*************/
+bool Scene::uploadTextures(const vector<shared_ptr<Texture>>& textures, const set<BaseObject*>& visible)
+{
+    struct Upload
+    {
+        shared_ptr<Texture_Image> texture;
+        int64_t size;
+        int64_t deadline;
+        bool visible;
+    };
+
+    vector<Upload> uploads;
+    for (auto& texture : textures)
+    {
+        // Only textures holding an image are scheduled, the others do not upload anything heavy
+        auto texImage = dynamic_pointer_cast<Texture_Image>(texture);
+        if (!texImage)
+        {
+            texture->update();
+            continue;
+        }
+
+        if (!texImage->hasPendingUpdate())
+            continue;
+
+        uploads.push_back({texImage, texImage->getPendingUploadSize(), texImage->getPendingDeadline(), visible.find(texture.get()) != visible.end()});
+    }
+
+    // Visible textures go first, then the closest deadlines. A deferred image stays due by its deadline,
+    // so it gets ahead of the images which arrived after it
+    sort(uploads.begin(), uploads.end(), [](const Upload& a, const Upload& b) {
+        if (a.visible != b.visible)
+            return a.visible;
+        if (a.deadline != b.deadline)
+            return a.deadline < b.deadline;
+        return a.texture->getConsecutiveDeferrals() > b.texture->getConsecutiveDeferrals();
+    });
+
+    int64_t budgetBytes = _uploadBudgetBytes;
+    int64_t budgetTime = _uploadBudgetTime;
+    int64_t uploadedBytes = 0;
+    auto startTime = Timer::getTime();
+    bool first = true;
+    bool deferred = false;
+    for (auto& upload : uploads)
+    {
+        // The texture with the highest priority is always updated, so that every frame makes some progress
+        if (!first && ((budgetBytes > 0 && uploadedBytes + upload.size > budgetBytes) || (budgetTime > 0 && Timer::getTime() - startTime > budgetTime)))
+        {
+            upload.texture->deferUpdate();
+            deferred = true;
+            continue;
+        }
+
+        upload.texture->update();
+        uploadedBytes += upload.size;
+        first = false;
+    }
+
+    return deferred;
+}
+
 /*************/
 void Scene::setAsMaster(const string& configFilePath)
 {
@@ -643,7 +923,8 @@ Values Scene::sendMessageToWorldWithAnswer(const string& message, const Values&
 void Scene::waitTextureUpload()
 {
     lock_guard<mutex> lockTexture(_textureUploadMutex);
-    glWaitSync(_textureUploadFence, 0, GL_TIMEOUT_IGNORED);
+    if (_textureUploadFence)
+        glWaitSync(_textureUploadFence, 0, GL_TIMEOUT_IGNORED);
 }
 
 /*************/
@@ -828,8 +1109,23 @@ void Scene::init(const string& name)
     _textureUploadWindow = getNewSharedWindow();
 
     // Create the link and connect to the World
-    _link = make_shared<Link>(weak_ptr<Scene>(_self), name);
-    _link->connectTo("world");
+    _link = make_shared<Link>(weak_ptr<Scene>(_self), name, _tcpPort);
+    auto portPosition = _worldAddress.rfind(':');
+    if (portPosition != string::npos)
+    {
+        try
+        {
+            _link->connectTo("world", _worldAddress.substr(0, portPosition), stoi(_worldAddress.substr(portPosition + 1)));
+        }
+        catch (...)
+        {
+            Log::get() << Log::ERROR << "Scene::" << __FUNCTION__ << " - Invalid World address " << _worldAddress << ", expected address:port" << Log::endl;
+        }
+    }
+    else
+    {
+        _link->connectTo("world");
+    }
     sendMessageToWorld("sceneLaunched", {});
 }
 
@@ -911,12 +1207,6 @@ void Scene::registerAttributes()
         {'s', 's'});
     setAttributeDescription("addGhost", "Add a ghost object of the given name and type. Only useful in the master Scene");
 
-    addAttribute("bufferUploaded", [&](const Values& args) {
-        _textureUploadCondition.notify_all();
-        return true;
-    });
-    setAttributeDescription("bufferUploaded", "Message sent by the World to notify that new textures have been sent");
-
     addAttribute("config", [&](const Values& args) {
         addTask([&]() -> void {
             setlocale(LC_NUMERIC, "C"); // Needed to make sure numbers are written with commas
@@ -1049,7 +1339,7 @@ void Scene::registerAttributes()
     setAttributeDescription("logToFile", "If set to 1, the process holding the Scene will try to write log to file");
 
     addAttribute("ping", [&](const Values& args) {
-        _textureUploadCondition.notify_all();
+        requestTextureUpload();
         sendMessageToWorld("pong", {_name});
         return true;
     });
@@ -1138,6 +1428,17 @@ void Scene::registerAttributes()
         {'n'});
     setAttributeDescription("swapInterval", "Set the interval between two video frames. 1 is synced, 0 is not");
 
+    addAttribute("textureUploadBudget",
+        [&](const Values& args) {
+            _uploadBudgetBytes = static_cast<int64_t>(max(0.f, args[0].as<float>()) * 1048576.f);
+            _uploadBudgetTime = static_cast<int64_t>(max(0.f, args[1].as<float>()) * 1000.f);
+            return true;
+        },
+        [&]() -> Values { return {(float)_uploadBudgetBytes / 1048576.f, (float)_uploadBudgetTime / 1000.f}; },
+        {'n', 'n'});
+    setAttributeDescription("textureUploadBudget",
+        "Maximum amount of data (in MB) and time (in ms) spent uploading textures for each frame, 0 meaning no limit. Textures over budget are deferred to the next frame");
+
     addAttribute("swapTest", [&](const Values& args) {
         addTask([=]() {
             lock_guard<recursive_mutex> lock(_objectsMutex);
@@ -1221,7 +1522,7 @@ void Scene::registerAttributes()
             return false;
         // This needs to be launched in another thread, as the set mutex is already locked
         // (and we will need it later)
-        SThread::pool.enqueue([&]() { _colorCalibrator->update(); });
+        SThread::pool.enqueueWithoutId([&]() { _colorCalibrator->update(); });
         return true;
     });
     setAttributeDescription("calibrateColor", "Launch projectors color calibration");
@@ -1231,7 +1532,7 @@ void Scene::registerAttributes()
             return false;
         // This needs to be launched in another thread, as the set mutex is already locked
         // (and we will need it later)
-        SThread::pool.enqueue([&]() { _colorCalibrator->updateCRF(); });
+        SThread::pool.enqueueWithoutId([&]() { _colorCalibrator->updateCRF(); });
         return true;
     });
     setAttributeDescription("calibrateColorResponseFunction", "Launch the camera color calibration");
@@ -1264,6 +1565,22 @@ void Scene::registerAttributes()
         },
         {'n', 'n'});
     setAttributeDescription("sceneAffinity", "Set the core for the main loop, as well as the number of root objects. The thread pool will use the remaining cores.");
+
+    addAttribute("threadPlacement",
+        [&](const Values& args) {
+            ThreadPlacement::Assignment assignment;
+            assignment.realtime = args[0].as<int>();
+            for (int i = 0; i < ThreadPlacement::classCount && i + 1 < static_cast<int>(args.size()); ++i)
+                for (const auto& core : args[i + 1].as<Values>())
+                    assignment.cores[i].push_back(core.as<int>());
+
+            ThreadPlacement::get().setAssignment(assignment);
+            Log::get() << Log::MESSAGE << "Scene::" << __FUNCTION__ << " - " << _name << ": " << ThreadPlacement::describe(assignment) << Log::endl;
+
+            return true;
+        },
+        {'n'});
+    setAttributeDescription("threadPlacement", "Set the cores of each thread class (render, upload, decode and background), as computed by the World from the CPU topology");
 #endif
 
     addAttribute("configurationPath",
@@ -1288,6 +1605,13 @@ void Scene::registerAttributes()
             return true;
         },
         {'n'});
+
+    addAttribute("hugePages",
+        [&](const Values& args) {
+            return BufferPool::get().setHugePages(args[0].as<string>());
+        },
+        {'s'});
+    setAttributeDescription("hugePages", "Set the huge pages policy for the biggest buffers, either none, transparent or reserved");
 }
 
 } // end of namespace
@@ -457,7 +457,7 @@ void Shader::parseUniforms(const std::string& src)
                 _uniforms[name].values = {0, 0, 0, 0, 0, 0, 0, 0, 0};
             else if (type == "mat4")
                 _uniforms[name].values = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
-            else if (type == "sampler2D" || type == "sampler2DRect")
+            else if (type == "sampler2D" || type == "sampler2DRect" || type == "sampler2DArray")
                 _uniforms[name].values = {};
             else
             {
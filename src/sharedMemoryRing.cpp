@@ -0,0 +1,221 @@
+#include "./sharedMemoryRing.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "./log.h"
+
+#define SPLASH_SHM_RING_MAGIC 0x53504c52 // "SPLR"
+
+using namespace std;
+
+namespace Splash
+{
+
+/*************/
+SharedMemoryRing::~SharedMemoryRing()
+{
+    if (_slots != nullptr)
+        munmap(_slots, _slotSize * _slotCount);
+    if (_header != nullptr)
+        munmap(_header, _headerSize);
+
+    if (_isWriter)
+        shm_unlink(_segment.c_str());
+}
+
+/*************/
+unique_ptr<SharedMemoryRing> SharedMemoryRing::create(const string& segment, uint32_t slotCount, uint64_t slotSize)
+{
+    if (segment.size() >= sizeof(Descriptor::segment) || slotCount == 0 || slotSize == 0)
+        return {nullptr};
+
+    auto ring = unique_ptr<SharedMemoryRing>(new SharedMemoryRing());
+    ring->_segment = segment;
+    ring->_isWriter = true;
+    ring->_slotCount = slotCount;
+    ring->_slotSize = alignOnPage(slotSize);
+    ring->_headerSize = getHeaderSize(slotCount);
+
+    shm_unlink(segment.c_str()); // In case a previous instance crashed
+    int fd = shm_open(segment.c_str(), O_CREAT | O_EXCL | O_RDWR, S_IRUSR | S_IWUSR);
+    if (fd == -1)
+    {
+        Log::get() << Log::WARNING << "SharedMemoryRing::" << __FUNCTION__ << " - Unable to create shared memory segment " << segment << Log::endl;
+        return {nullptr};
+    }
+    OnScopeExit { close(fd); };
+
+    auto totalSize = ring->_headerSize + ring->_slotSize * slotCount;
+    if (ftruncate(fd, totalSize) != 0)
+    {
+        Log::get() << Log::WARNING << "SharedMemoryRing::" << __FUNCTION__ << " - Unable to allocate " << totalSize << " bytes for segment " << segment << Log::endl;
+        ring->_isWriter = false;
+        shm_unlink(segment.c_str());
+        return {nullptr};
+    }
+
+    auto header = mmap(nullptr, ring->_headerSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    auto slots = mmap(nullptr, ring->_slotSize * slotCount, PROT_READ | PROT_WRITE, MAP_SHARED, fd, ring->_headerSize);
+    if (header == MAP_FAILED || slots == MAP_FAILED)
+    {
+        Log::get() << Log::WARNING << "SharedMemoryRing::" << __FUNCTION__ << " - Unable to map segment " << segment << Log::endl;
+        if (header != MAP_FAILED)
+            munmap(header, ring->_headerSize);
+        if (slots != MAP_FAILED)
+            munmap(slots, ring->_slotSize * slotCount);
+        shm_unlink(segment.c_str());
+        ring->_isWriter = false;
+        return {nullptr};
+    }
+
+    ring->_header = reinterpret_cast<char*>(header);
+    ring->_slots = reinterpret_cast<char*>(slots);
+
+    *reinterpret_cast<uint32_t*>(ring->_header) = SPLASH_SHM_RING_MAGIC;
+    ring->_acknowledgements = reinterpret_cast<atomic<uint64_t>*>(ring->_header + sizeof(uint64_t));
+    new (ring->_acknowledgements) atomic<uint64_t>(0);
+    ring->_slotStates = ring->_acknowledgements + 1;
+    for (uint32_t i = 0; i < slotCount; ++i)
+        new (&ring->_slotStates[i]) atomic<uint64_t>(0);
+
+    return ring;
+}
+
+/*************/
+shared_ptr<SharedMemoryRing> SharedMemoryRing::open(const Descriptor& desc)
+{
+    if (desc.magic != SPLASH_SHM_RING_MAGIC || desc.slotCount == 0 || desc.slotSize == 0)
+        return {nullptr};
+
+    auto segment = string(desc.segment, strnlen(desc.segment, sizeof(desc.segment)));
+    int fd = shm_open(segment.c_str(), O_RDWR, 0);
+    if (fd == -1)
+    {
+        Log::get() << Log::WARNING << "SharedMemoryRing::" << __FUNCTION__ << " - Unable to open shared memory segment " << segment << Log::endl;
+        return {nullptr};
+    }
+    OnScopeExit { close(fd); };
+
+    auto ring = shared_ptr<SharedMemoryRing>(new SharedMemoryRing());
+    ring->_segment = segment;
+    ring->_slotCount = desc.slotCount;
+    ring->_slotSize = desc.slotSize;
+    ring->_headerSize = getHeaderSize(desc.slotCount);
+
+    // Only the header is writable, to update the reader counts
+    auto header = mmap(nullptr, ring->_headerSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (header == MAP_FAILED)
+    {
+        Log::get() << Log::WARNING << "SharedMemoryRing::" << __FUNCTION__ << " - Unable to map segment " << segment << Log::endl;
+        return {nullptr};
+    }
+    ring->_header = reinterpret_cast<char*>(header);
+
+    auto slots = mmap(nullptr, ring->_slotSize * ring->_slotCount, PROT_READ, MAP_SHARED, fd, ring->_headerSize);
+    if (slots == MAP_FAILED)
+    {
+        Log::get() << Log::WARNING << "SharedMemoryRing::" << __FUNCTION__ << " - Unable to map segment " << segment << Log::endl;
+        return {nullptr};
+    }
+    ring->_slots = reinterpret_cast<char*>(slots);
+
+    if (*reinterpret_cast<uint32_t*>(ring->_header) != SPLASH_SHM_RING_MAGIC)
+        return {nullptr};
+    ring->_acknowledgements = reinterpret_cast<atomic<uint64_t>*>(ring->_header + sizeof(uint64_t));
+    ring->_slotStates = ring->_acknowledgements + 1;
+
+    return ring;
+}
+
+/*************/
+void SharedMemoryRing::acknowledge()
+{
+    if (_acknowledgements != nullptr)
+        _acknowledgements->fetch_add(1, memory_order_release);
+}
+
+/*************/
+uint64_t SharedMemoryRing::getAcknowledgements() const
+{
+    if (_acknowledgements == nullptr)
+        return 0;
+    return _acknowledgements->load(memory_order_acquire);
+}
+
+/*************/
+ResizableArray<char> SharedMemoryRing::acquire(const shared_ptr<SharedMemoryRing>& ring, const Descriptor& desc)
+{
+    if (!ring || !ring->matches(desc) || desc.slotIndex >= ring->_slotCount || desc.size > ring->_slotSize)
+        return {};
+
+    // Register as a reader, only if the slot still holds the generation we were told about
+    auto& state = ring->_slotStates[desc.slotIndex];
+    auto value = state.load(memory_order_acquire);
+    do
+    {
+        if ((value >> 32) != desc.generation)
+            return {};
+    } while (!state.compare_exchange_weak(value, value + 1, memory_order_acq_rel));
+
+    auto slotIndex = desc.slotIndex;
+    auto data = ring->_slots + ring->_slotSize * slotIndex;
+    return ResizableArray<char>(data, desc.size, [ring, slotIndex](char*) { ring->_slotStates[slotIndex].fetch_sub(1, memory_order_release); });
+}
+
+/*************/
+bool SharedMemoryRing::write(const char* data, uint64_t size, Descriptor& desc)
+{
+    if (!_isWriter || size > _slotSize)
+        return false;
+
+    for (uint32_t i = 0; i < _slotCount; ++i)
+    {
+        auto slotIndex = (_nextSlot + i) % _slotCount;
+        auto& state = _slotStates[slotIndex];
+
+        // A slot can be taken only if no reader holds it. An odd generation marks it as being written to
+        auto value = state.load(memory_order_acquire);
+        if ((value & 0xFFFFFFFF) != 0)
+            continue;
+        uint32_t generation = value >> 32;
+        if (!state.compare_exchange_strong(value, static_cast<uint64_t>(generation + 1) << 32, memory_order_acq_rel))
+            continue;
+
+        memcpy(_slots + _slotSize * slotIndex, data, size);
+        generation += 2;
+        state.store(static_cast<uint64_t>(generation) << 32, memory_order_release);
+
+        desc.magic = SPLASH_SHM_RING_MAGIC;
+        desc.slotIndex = slotIndex;
+        desc.generation = generation;
+        desc.slotCount = _slotCount;
+        desc.slotSize = _slotSize;
+        desc.size = size;
+        memset(desc.segment, 0, sizeof(desc.segment));
+        memcpy(desc.segment, _segment.c_str(), _segment.size());
+
+        _nextSlot = (slotIndex + 1) % _slotCount;
+        return true;
+    }
+
+    return false;
+}
+
+/*************/
+size_t SharedMemoryRing::getHeaderSize(uint32_t slotCount)
+{
+    // Magic number, acknowledgement count, then the slot states
+    return alignOnPage(sizeof(uint64_t) + sizeof(atomic<uint64_t>) * (slotCount + 1));
+}
+
+/*************/
+uint64_t SharedMemoryRing::alignOnPage(uint64_t size)
+{
+    uint64_t pageSize = sysconf(_SC_PAGESIZE);
+    return ((size + pageSize - 1) / pageSize) * pageSize;
+}
+
+} // end of namespace
@@ -31,6 +31,8 @@ using namespace std;
 int main(int argc, char** argv)
 {
     string name = "scene";
+    string worldAddress = "";
+    int port = 0;
     int idx = 0;
     while (idx < argc)
     {
@@ -44,6 +46,16 @@ int main(int argc, char** argv)
             Timer::get().setDebug(true);
             idx++;
         }
+        else if ((string(argv[idx]) == "-w" || string(argv[idx]) == "--world") && idx + 1 < argc)
+        {
+            worldAddress = argv[idx + 1];
+            idx += 2;
+        }
+        else if ((string(argv[idx]) == "-p" || string(argv[idx]) == "--port") && idx + 1 < argc)
+        {
+            port = atoi(argv[idx + 1]);
+            idx += 2;
+        }
         else
         {
             name = argv[idx];
@@ -53,7 +65,7 @@ int main(int argc, char** argv)
 
     Log::get() << "splashScene::main - Creating Scene with name " << name << Log::endl;
 
-    Scene scene(name);
+    Scene scene(name, worldAddress, port);
     scene.run();
 
     return 0;
@@ -0,0 +1,324 @@
+#include "texture_array.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "image.h"
+#include "log.h"
+#include "threadpool.h"
+#include "timer.h"
+
+using namespace std;
+
+namespace Splash
+{
+
+/*************/
+Texture_Array::Texture_Array(const weak_ptr<RootObject>& root)
+    : Texture(root)
+{
+    init();
+}
+
+/*************/
+Texture_Array::~Texture_Array()
+{
+    if (_root.expired())
+        return;
+
+#ifdef DEBUG
+    Log::get() << Log::DEBUGGING << "Texture_Array::~Texture_Array - Destructor" << Log::endl;
+#endif
+
+    glDeleteTextures(1, &_glTex);
+    glDeleteBuffers(1, &_pbo);
+}
+
+/*************/
+void Texture_Array::bind()
+{
+    glGetIntegerv(GL_ACTIVE_TEXTURE, &_activeTexture);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, _glTex);
+}
+
+/*************/
+void Texture_Array::unbind()
+{
+#ifdef DEBUG
+    glActiveTexture((GLenum)_activeTexture);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+#endif
+}
+
+/*************/
+bool Texture_Array::linkTo(shared_ptr<BaseObject> obj)
+{
+    // Mandatory before trying to link
+    if (!Texture::linkTo(obj))
+        return false;
+
+    auto img = dynamic_pointer_cast<Image>(obj);
+    if (!img)
+        return false;
+
+    lock_guard<mutex> lock(_mutex);
+    for (auto& layer : _layers)
+        if (layer.image.lock() == img)
+            return false;
+
+    Layer layer;
+    layer.image = img;
+    _layers.push_back(layer);
+    _shaderUniforms["layers"] = {static_cast<int>(_layers.size())};
+
+    return true;
+}
+
+/*************/
+void Texture_Array::unlinkFrom(shared_ptr<BaseObject> obj)
+{
+    auto img = dynamic_pointer_cast<Image>(obj);
+    if (img)
+    {
+        lock_guard<mutex> lock(_mutex);
+        _layers.erase(remove_if(_layers.begin(), _layers.end(), [&](const Layer& layer) { return layer.image.lock() == img; }), _layers.end());
+        _shaderUniforms["layers"] = {static_cast<int>(_layers.size())};
+    }
+
+    Texture::unlinkFrom(obj);
+}
+
+/*************/
+bool Texture_Array::allocate(const ImageBufferSpec& spec, bool srgb)
+{
+    if (spec.isPlanar() || spec.format == "YUYV" || spec.format == "UYVY" || spec.isCompressed())
+    {
+        Log::get() << Log::WARNING << "Texture_Array::" << __FUNCTION__ << " - Format " << spec.format << " is not supported in texture arrays" << Log::endl;
+        return false;
+    }
+
+    if (spec.type == ImageBufferSpec::Type::UINT8 && (spec.channels == 3 || spec.channels == 4))
+    {
+        if (spec.channels == 4)
+            _texFormat = spec.format == "BGRA" ? GL_BGRA : GL_RGBA;
+        else
+            _texFormat = spec.format == "BGR" ? GL_BGR : GL_RGB;
+        _texType = GL_UNSIGNED_BYTE;
+        _texInternalFormat = srgb ? GL_SRGB8_ALPHA8 : GL_RGBA8;
+    }
+    else if (spec.type == ImageBufferSpec::Type::UINT8 && spec.channels == 1)
+    {
+        _texFormat = GL_RED;
+        _texType = GL_UNSIGNED_BYTE;
+        _texInternalFormat = GL_R8;
+    }
+    else if (spec.type == ImageBufferSpec::Type::UINT16 && spec.channels == 1)
+    {
+        _texFormat = GL_RED;
+        _texType = GL_UNSIGNED_SHORT;
+        _texInternalFormat = GL_R16;
+    }
+    else if (spec.type == ImageBufferSpec::Type::UINT16 && spec.channels == 4)
+    {
+        _texFormat = GL_RGBA;
+        _texType = GL_UNSIGNED_SHORT;
+        _texInternalFormat = GL_RGBA16;
+    }
+    else
+    {
+        Log::get() << Log::WARNING << "Texture_Array::" << __FUNCTION__ << " - Unknown uncompressed format" << Log::endl;
+        return false;
+    }
+
+    // glTexStorage3D is immutable, so we have to delete the texture first
+    glDeleteTextures(1, &_glTex);
+    glGenTextures(1, &_glTex);
+
+    int levels = 1;
+    if (_filtering)
+        levels = static_cast<int>(floor(log2(max(spec.width, spec.height)))) + 1;
+
+    glBindTexture(GL_TEXTURE_2D_ARRAY, _glTex);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, _filtering ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexStorage3D(GL_TEXTURE_2D_ARRAY, levels, _texInternalFormat, spec.width, spec.height, max<int>(_layers.size(), 1));
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+    _spec = spec;
+    _srgb = srgb;
+    _allocatedLayers = _layers.size();
+
+    _shaderUniforms["size"] = {(float)_spec.width, (float)_spec.height};
+    _shaderUniforms["layers"] = {_allocatedLayers};
+
+#ifdef DEBUG
+    Log::get() << Log::DEBUGGING << "Texture_Array::" << __FUNCTION__ << " - Allocated " << _allocatedLayers << " layers of " << spec.width << "x" << spec.height << Log::endl;
+#endif
+
+    return true;
+}
+
+/*************/
+void Texture_Array::update()
+{
+    lock_guard<mutex> lock(_mutex);
+
+    // Look for the layers holding a new image
+    vector<shared_ptr<Image>> images(_layers.size());
+    vector<int> updatedLayers;
+    for (size_t i = 0; i < _layers.size(); ++i)
+    {
+        images[i] = _layers[i].image.lock();
+        if (!images[i] || images[i]->getTimestamp() == _layers[i].timestamp)
+            continue;
+
+        images[i]->update();
+        _layers[i].timestamp = images[i]->getTimestamp();
+        updatedLayers.push_back(i);
+    }
+
+    if (updatedLayers.empty() && _allocatedLayers == static_cast<int>(_layers.size()))
+        return;
+
+    // The first layer gives the format of the whole array, which is reallocated and fully uploaded when it changes
+    if (images.empty() || !images[0])
+        return;
+    auto spec = images[0]->getSpec();
+    if (spec.width == 0 || spec.height == 0)
+        return;
+
+    Values srgb;
+    images[0]->getAttribute("srgb", srgb);
+    bool isSrgb = !srgb.empty() && srgb[0].as<int>() > 0;
+
+    if (spec != _spec || isSrgb != _srgb || _allocatedLayers != static_cast<int>(_layers.size()))
+    {
+        if (!allocate(spec, isSrgb))
+            return;
+
+        updatedLayers.clear();
+        for (size_t i = 0; i < _layers.size(); ++i)
+            if (images[i])
+                updatedLayers.push_back(i);
+    }
+
+    // Layers which do not match the format of the array are left untouched
+    vector<int> uploads;
+    for (auto layer : updatedLayers)
+    {
+        if (images[layer]->getSpec() == _spec)
+        {
+            uploads.push_back(layer);
+            _layers[layer].mismatch = false;
+            continue;
+        }
+
+        if (!_layers[layer].mismatch)
+            Log::get() << Log::WARNING << "Texture_Array::" << __FUNCTION__ << " - Image " << images[layer]->getName() << " does not match the size or format of the first layer" << Log::endl;
+        _layers[layer].mismatch = true;
+    }
+
+    if (uploads.empty())
+        return;
+
+    // All the layers are copied side by side in a single buffer, in parallel, then uploaded from it
+    int64_t layerSize = _spec.rawSize();
+    int64_t uploadSize = layerSize * uploads.size();
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, _pbo);
+    if (uploadSize > _pboSize)
+    {
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, uploadSize, nullptr, GL_STREAM_DRAW);
+        _pboSize = uploadSize;
+    }
+
+    auto pboData = static_cast<char*>(glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, uploadSize, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT));
+    if (!pboData)
+    {
+        Log::get() << Log::WARNING << "Texture_Array::" << __FUNCTION__ << " - Unable to map the upload buffer" << Log::endl;
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        return;
+    }
+
+    SThread::pool.parallelFor(0, uploads.size(), [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i)
+        {
+            auto& image = images[uploads[i]];
+            image->lock();
+            memcpy(pboData + i * layerSize, image->data(), layerSize);
+            image->unlock();
+        }
+    });
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+    glBindTexture(GL_TEXTURE_2D_ARRAY, _glTex);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for (size_t i = 0; i < uploads.size(); ++i)
+        glTexSubImage3D(
+            GL_TEXTURE_2D_ARRAY, 0, 0, 0, uploads[i], _spec.width, _spec.height, 1, _texFormat, _texType, reinterpret_cast<const GLvoid*>(static_cast<uintptr_t>(i * layerSize)));
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+    if (_filtering)
+        glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    _timestamp = Timer::getTime();
+}
+
+/*************/
+void Texture_Array::init()
+{
+    _type = "texture_array";
+    registerAttributes();
+
+    // If the root object weak_ptr is expired, this means that
+    // this object has been created outside of a World or Scene.
+    // This is used for getting documentation "offline"
+    if (_root.expired())
+        return;
+
+    _timestamp = Timer::getTime();
+    _shaderUniforms["layers"] = {0};
+
+    glGenBuffers(1, &_pbo);
+}
+
+/*************/
+void Texture_Array::registerAttributes()
+{
+    Texture::registerAttributes();
+
+    addAttribute("filtering",
+        [&](const Values& args) {
+            lock_guard<mutex> lock(_mutex);
+            _filtering = args[0].as<int>() > 0 ? true : false;
+            // Mipmaps need a new storage
+            _allocatedLayers = 0;
+            return true;
+        },
+        [&]() -> Values { return {_filtering}; },
+        {'n'});
+    setAttributeDescription("filtering", "Activate the mipmaps for this texture");
+
+    addAttribute("layers",
+        [&](const Values& args) { return false; },
+        [&]() -> Values {
+            Values layers;
+            lock_guard<mutex> lock(_mutex);
+            for (auto& layer : _layers)
+            {
+                auto image = layer.image.lock();
+                layers.push_back(image ? image->getName() : "");
+            }
+            return layers;
+        });
+    setAttributeParameter("layers", false, false);
+    setAttributeDescription("layers", "Names of the images held by each layer, in order");
+}
+
+} // end of namespace
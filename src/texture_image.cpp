@@ -7,7 +7,10 @@
 
 #include <string>
 
-#define SPLASH_TEXTURE_COPY_THREADS 2
+#define SPLASH_TEXTURE_PLANE_UNIT_OFFSET 8
+#define SPLASH_TEXTURE_RING_SLOTS 3
+#define SPLASH_TEXTURE_RING_ALIGNMENT 256
+#define SPLASH_TEXTURE_RING_WAIT_NS 1000000
 
 using namespace std;
 
@@ -38,8 +41,13 @@ Texture_Image::~Texture_Image()
 #ifdef DEBUG
     Log::get() << Log::DEBUGGING << "Texture_Image::~Texture_Image - Destructor" << Log::endl;
 #endif
+    // Copy tasks may still be writing to the ring
+    _pboCopyTasks.wait();
+
     glDeleteTextures(1, &_glTex);
+    glDeleteTextures(2, _glPlaneTex);
     glDeleteBuffers(2, _pbos);
+    deleteRing();
 }
 
 /*************/
@@ -54,6 +62,30 @@ void Texture_Image::bind()
 {
     glGetIntegerv(GL_ACTIVE_TEXTURE, &_activeTexture);
     glBindTexture(GL_TEXTURE_2D, _glTex);
+
+    // Chroma planes are bound to units further away, so as not to collide with the other textures of the object.
+    // Each texture unit gets its own pair of plane units, so that planar textures of the same object do not overlap
+    if (_spec.isPlanar())
+    {
+        auto unit = _activeTexture - GL_TEXTURE0;
+        if (SPLASH_TEXTURE_PLANE_UNIT_OFFSET + unit * 2 + 1 >= _glMaxTextureUnits)
+        {
+            if (!_planeUnitsExceeded)
+                Log::get() << Log::ERROR << "Texture_Image::" << __FUNCTION__ << " - Not enough texture units to bind the chroma planes of texture " << _name << " to unit "
+                           << unit << ", the maximum being " << _glMaxTextureUnits << Log::endl;
+            _planeUnitsExceeded = true;
+            return;
+        }
+
+        for (int i = 0; i < 2; ++i)
+        {
+            auto planeUnit = SPLASH_TEXTURE_PLANE_UNIT_OFFSET + unit * 2 + i;
+            glActiveTexture(GL_TEXTURE0 + planeUnit);
+            glBindTexture(GL_TEXTURE_2D, _glPlaneTex[i]);
+            _shaderUniforms["chroma" + to_string(i)] = {planeUnit};
+        }
+        glActiveTexture((GLenum)_activeTexture);
+    }
 }
 
 /*************/
@@ -242,10 +274,12 @@ GLenum Texture_Image::getChannelOrder(const ImageBufferSpec& spec)
         glChannelOrder = GL_RGBA;
     else if (spec.format == "RGB" || spec.format == "RGB_DXT1")
         glChannelOrder = GL_RGB;
-    else if (spec.format == "RGBA" || spec.format == "RGBA_DXT5")
+    else if (spec.format == "RGBA" || spec.format == "RGBA_DXT5" || spec.format == "RGBA_BC7")
         glChannelOrder = GL_RGBA;
     else if (spec.format == "YUYV" || spec.format == "UYVY")
         glChannelOrder = GL_RG;
+    else if (spec.isPlanar())
+        glChannelOrder = GL_RED;
     else if (spec.channels == 1)
         glChannelOrder = GL_RED;
     else if (spec.channels == 3)
@@ -268,7 +302,13 @@ void Texture_Image::update()
 
     if (img->getTimestamp() == _timestamp)
         return;
+
+    // The copy to the ring started by the previous update has to be done before the image is updated again
+    if (_useRing && _pboMapped)
+        finishRingCopy();
+
     img->update();
+    _consecutiveDeferrals = 0;
 
     auto spec = img->getSpec();
     Values srgb, flip, flop;
@@ -300,13 +340,26 @@ void Texture_Image::update()
     {
         isCompressed = true;
     }
+    else if (spec.format == "RGBA_BC7")
+    {
+        isCompressed = true;
+        spec.channels = 4;
+    }
+
+    // Planar images are uploaded as one texture per plane, the luma plane going to the main texture
+    bool isPlanar = spec.isPlanar();
 
     // Get GL parameters
     GLenum internalFormat;
     GLenum dataFormat;
     if (!isCompressed)
     {
-        if (spec.channels == 4 && spec.type == ImageBufferSpec::Type::UINT8)
+        if (isPlanar)
+        {
+            dataFormat = spec.type == ImageBufferSpec::Type::UINT16 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_BYTE;
+            internalFormat = spec.type == ImageBufferSpec::Type::UINT16 ? GL_R16 : GL_R8;
+        }
+        else if (spec.channels == 4 && spec.type == ImageBufferSpec::Type::UINT8)
         {
             dataFormat = GL_UNSIGNED_INT_8_8_8_8_REV;
             if (srgb[0].as<int>() > 0)
@@ -358,6 +411,13 @@ void Texture_Image::update()
         {
             internalFormat = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
         }
+        else if (spec.format == "RGBA_BC7")
+        {
+            if (srgb[0].as<int>() > 0)
+                internalFormat = GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM;
+            else
+                internalFormat = GL_COMPRESSED_RGBA_BPTC_UNORM;
+        }
         else
         {
             Log::get() << Log::WARNING << "Texture_Image::" << __FUNCTION__ << " - Unknown compressed format" << Log::endl;
@@ -397,8 +457,16 @@ void Texture_Image::update()
             Log::get() << Log::DEBUGGING << "Texture_Image::" << __FUNCTION__ << " - Creating a new texture" << Log::endl;
 #endif
             img->lock();
+            if (isPlanar)
+                glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
             glTexStorage2D(GL_TEXTURE_2D, 3, internalFormat, spec.width, spec.height);
             glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, spec.width, spec.height, glChannelOrder, dataFormat, img->data());
+            if (isPlanar)
+            {
+                createPlaneTextures(spec);
+                uploadPlaneTextures(spec, reinterpret_cast<const char*>(img->data()));
+                glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+            }
             img->unlock();
         }
         else if (isCompressed)
@@ -411,26 +479,32 @@ void Texture_Image::update()
             glCompressedTexImage2D(GL_TEXTURE_2D, 0, internalFormat, spec.width, spec.height, 0, imageDataSize, img->data());
             img->unlock();
         }
-        updatePbos(spec.width, spec.height, spec.pixelBytes());
+        if (_useRing)
+            updateRing(imageDataSize);
 
-        // Fill one of the PBOs right now
-        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, _pbos[0]);
-        GLubyte* pixels = (GLubyte*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, imageDataSize, GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
-        if (pixels != NULL)
+        if (!_useRing)
         {
-            img->lock();
-            memcpy((void*)pixels, img->data(), imageDataSize);
-            glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
-            img->unlock();
-        }
-        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            updatePbos(imageDataSize);
 
-        // And copy it to the second PBO
-        glBindBuffer(GL_COPY_READ_BUFFER, _pbos[0]);
-        glBindBuffer(GL_COPY_WRITE_BUFFER, _pbos[1]);
-        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, imageDataSize);
-        glBindBuffer(GL_COPY_READ_BUFFER, 0);
-        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+            // Fill one of the PBOs right now
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, _pbos[0]);
+            GLubyte* pixels = (GLubyte*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, imageDataSize, GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+            if (pixels != NULL)
+            {
+                img->lock();
+                memcpy((void*)pixels, img->data(), imageDataSize);
+                glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+                img->unlock();
+            }
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+            // And copy it to the second PBO
+            glBindBuffer(GL_COPY_READ_BUFFER, _pbos[0]);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, _pbos[1]);
+            glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, imageDataSize);
+            glBindBuffer(GL_COPY_READ_BUFFER, 0);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        }
 
 #ifdef DEBUG
         glBindTexture(GL_TEXTURE_2D, 0);
@@ -438,6 +512,35 @@ void Texture_Image::update()
 
         _spec = spec;
     }
+    // Update the content of the texture from the streaming ring. The image copied during the previous update is
+    // uploaded from its slot, and the new one is copied by the thread pool straight to the GPU-visible memory
+    else if (_useRing)
+    {
+        glBindTexture(GL_TEXTURE_2D, _glTex);
+
+        if (_ringReadySlot != -1)
+        {
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, _ringBuffer);
+            uploadFromUnpackBuffer(spec, glChannelOrder, dataFormat, internalFormat, isCompressed, imageDataSize, static_cast<uintptr_t>(_ringReadySlot) * _ringSlotSize);
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            _ringFences[_ringReadySlot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            _ringReadySlot = -1;
+        }
+#ifdef DEBUG
+        glBindTexture(GL_TEXTURE_2D, 0);
+#endif
+
+        _ringWriteSlot = acquireRingSlot();
+        auto pixels = _ringData + static_cast<size_t>(_ringWriteSlot) * _ringSlotSize;
+        img->lock();
+        _pboMapped = true;
+        int size = imageDataSize;
+        // The image is released as soon as it is copied, without waiting for the upload thread
+        _pboCopyTasks.run([=]() {
+            SThread::pool.parallelCopy(pixels, img->data(), size);
+            img->unlock();
+        });
+    }
     // Update the content of the texture, i.e the image
     else
     {
@@ -445,10 +548,7 @@ void Texture_Image::update()
 
         // Copy the pixels from the current PBO to the texture
         glBindBuffer(GL_PIXEL_UNPACK_BUFFER, _pbos[_pboReadIndex]);
-        if (!isCompressed)
-            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, spec.width, spec.height, glChannelOrder, dataFormat, 0);
-        else
-            glCompressedTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, spec.width, spec.height, internalFormat, imageDataSize, 0);
+        uploadFromUnpackBuffer(spec, glChannelOrder, dataFormat, internalFormat, isCompressed, imageDataSize, 0);
         glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
 #ifdef DEBUG
         glBindTexture(GL_TEXTURE_2D, 0);
@@ -463,16 +563,9 @@ void Texture_Image::update()
         {
             img->lock();
 
-            _pboCopyThreadIds.clear();
-            int stride = SPLASH_TEXTURE_COPY_THREADS;
+            _pboMapped = true;
             int size = imageDataSize;
-            for (int i = 0; i < stride - 1; ++i)
-            {
-                _pboCopyThreadIds.push_back(SThread::pool.enqueue(
-                    [=]() { copy((char*)img->data() + size / stride * i, (char*)img->data() + size / stride * (i + 1), (char*)pixels + size / stride * i); }));
-            }
-            _pboCopyThreadIds.push_back(
-                SThread::pool.enqueue([=]() { copy((char*)img->data() + size / stride * (stride - 1), (char*)img->data() + size, (char*)pixels + size / stride * (stride - 1)); }));
+            _pboCopyTasks.run([=]() { SThread::pool.parallelCopy(pixels, img->data(), size); });
         }
         glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
     }
@@ -488,26 +581,91 @@ void Texture_Image::update()
         _shaderUniforms["YUV"] = {1};
     else if (spec.format == "YUYV")
         _shaderUniforms["YUV"] = {2};
+    else if (spec.format == "NV12")
+        _shaderUniforms["YUV"] = {4};
+    else if (isPlanar)
+        _shaderUniforms["YUV"] = {3};
     else
         _shaderUniforms["YUV"] = {0};
 
+    // 10 bits samples are stored in 16 bits, and have to be scaled back to [0, 1]
+    if (isPlanar && spec.type == ImageBufferSpec::Type::UINT16)
+        _shaderUniforms["YUVScale"] = {65535.f / 1023.f};
+    else
+        _shaderUniforms["YUVScale"] = {1.f};
+
+    // Full range samples, as from MJPEG, have their black level at 0
+    _shaderUniforms["YUVFullRange"] = {spec.isFullRange() ? 1 : 0};
+
     _shaderUniforms["flip"] = flip;
     _shaderUniforms["flop"] = flop;
     _shaderUniforms["size"] = {(float)_spec.width, (float)_spec.height};
 
+    // If only a region of the image has been received, give its offset and scale in the whole image
+    if (_spec.hasRegion())
+        _shaderUniforms["region"] = {(float)_spec.regionX / (float)_spec.fullWidth,
+            (float)_spec.regionY / (float)_spec.fullHeight,
+            (float)_spec.width / (float)_spec.fullWidth,
+            (float)_spec.height / (float)_spec.fullHeight};
+    else
+        _shaderUniforms["region"] = {0.f, 0.f, 1.f, 1.f};
+
+    // Estimate the period of the source from the frame indices, as some images may not have been uploaded
+    auto frameId = img->getFrameId();
+    if (_frameId != 0 && frameId > _frameId)
+    {
+        auto period = (img->getTimestamp() - _timestamp) / static_cast<int64_t>(frameId - _frameId);
+        _framePeriod = _framePeriod == 0 ? period : (_framePeriod * 7 + period) / 8;
+    }
+    _frameId = frameId;
+
     _timestamp = img->getTimestamp();
 
     if (_filtering && !isCompressed)
         generateMipmap();
 }
 
+/*************/
+bool Texture_Image::hasPendingUpdate() const
+{
+    auto img = _img.lock();
+    return img && img->getTimestamp() != _timestamp;
+}
+
+/*************/
+int64_t Texture_Image::getPendingUploadSize() const
+{
+    auto img = _img.lock();
+    if (!img || img->getTimestamp() == _timestamp)
+        return 0;
+    return img->getSpec().rawSize();
+}
+
+/*************/
+int64_t Texture_Image::getPendingDeadline() const
+{
+    auto img = _img.lock();
+    if (!img || img->getTimestamp() == _timestamp)
+        return 0;
+    // Sources without a known period, like still images, are due right away
+    return img->getTimestamp() + _framePeriod;
+}
+
 /*************/
 void Texture_Image::flushPbo()
 {
-    if (_pboCopyThreadIds.size() != 0)
+    if (_pboMapped)
     {
-        SThread::pool.waitThreads(_pboCopyThreadIds);
-        _pboCopyThreadIds.clear();
+        // The ring is mapped persistently and coherently, so the copy does not have to be waited for here
+        if (_useRing)
+        {
+            if (!_pboCopyTasks.isPending())
+                finishRingCopy();
+            return;
+        }
+
+        _pboCopyTasks.wait();
+        _pboMapped = false;
 
         glBindBuffer(GL_PIXEL_UNPACK_BUFFER, _pbos[_pboReadIndex]);
         glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
@@ -532,20 +690,166 @@ void Texture_Image::init()
 
     glGetIntegerv(GL_MAJOR_VERSION, &_glVersionMajor);
     glGetIntegerv(GL_MINOR_VERSION, &_glVersionMinor);
+    glGetIntegerv(GL_MAX_TEXTURE_IMAGE_UNITS, &_glMaxTextureUnits);
 
     _timestamp = Timer::getTime();
 
     glGenBuffers(2, _pbos);
+
+    _useRing = _glVersionMajor > 4 || (_glVersionMajor == 4 && _glVersionMinor >= 4) || GLAD_GL_ARB_buffer_storage;
 }
 
 /*************/
-void Texture_Image::updatePbos(int width, int height, int bytes)
+void Texture_Image::updatePbos(int size)
 {
     glBindBuffer(GL_PIXEL_UNPACK_BUFFER, _pbos[0]);
-    glBufferData(GL_PIXEL_UNPACK_BUFFER, width * height * bytes, 0, GL_STREAM_DRAW);
+    glBufferData(GL_PIXEL_UNPACK_BUFFER, size, 0, GL_STREAM_DRAW);
     glBindBuffer(GL_PIXEL_UNPACK_BUFFER, _pbos[1]);
-    glBufferData(GL_PIXEL_UNPACK_BUFFER, width * height * bytes, 0, GL_STREAM_DRAW);
+    glBufferData(GL_PIXEL_UNPACK_BUFFER, size, 0, GL_STREAM_DRAW);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+/*************/
+void Texture_Image::updateRing(int size)
+{
+    deleteRing();
+
+    // Slots are aligned so that uploads start on a well aligned offset
+    _ringSlotSize = ((size + SPLASH_TEXTURE_RING_ALIGNMENT - 1) / SPLASH_TEXTURE_RING_ALIGNMENT) * SPLASH_TEXTURE_RING_ALIGNMENT;
+    auto ringSize = static_cast<GLsizeiptr>(_ringSlotSize) * SPLASH_TEXTURE_RING_SLOTS;
+    GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+    glGenBuffers(1, &_ringBuffer);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, _ringBuffer);
+    glBufferStorage(GL_PIXEL_UNPACK_BUFFER, ringSize, nullptr, flags);
+    _ringData = static_cast<GLubyte*>(glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, ringSize, flags));
     glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    if (_ringData == nullptr)
+    {
+        Log::get() << Log::WARNING << "Texture_Image::" << __FUNCTION__ << " - Unable to map the streaming ring, falling back to PBOs" << Log::endl;
+        deleteRing();
+        _useRing = false;
+        return;
+    }
+
+    _ringFences.assign(SPLASH_TEXTURE_RING_SLOTS, nullptr);
+    _ringWriteSlot = 0;
+    _ringReadySlot = -1;
+}
+
+/*************/
+void Texture_Image::deleteRing()
+{
+    for (auto& fence : _ringFences)
+        if (fence)
+            glDeleteSync(fence);
+    _ringFences.clear();
+
+    if (_ringBuffer != 0)
+    {
+        if (_ringData)
+        {
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, _ringBuffer);
+            glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        }
+        glDeleteBuffers(1, &_ringBuffer);
+    }
+
+    _ringBuffer = 0;
+    _ringData = nullptr;
+    _ringReadySlot = -1;
+}
+
+/*************/
+int Texture_Image::acquireRingSlot()
+{
+    auto slot = (_ringWriteSlot + 1) % SPLASH_TEXTURE_RING_SLOTS;
+    auto& fence = _ringFences[slot];
+    if (fence)
+    {
+        // With enough slots the GPU is long done with this one, so this should not wait
+        GLenum status = GL_TIMEOUT_EXPIRED;
+        while (status == GL_TIMEOUT_EXPIRED)
+            status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, SPLASH_TEXTURE_RING_WAIT_NS);
+        if (status == GL_WAIT_FAILED)
+            Log::get() << Log::WARNING << "Texture_Image::" << __FUNCTION__ << " - Failed to wait for the streaming ring slot " << slot << Log::endl;
+        glDeleteSync(fence);
+        fence = nullptr;
+    }
+    return slot;
+}
+
+/*************/
+void Texture_Image::finishRingCopy()
+{
+    _pboCopyTasks.wait();
+    _pboMapped = false;
+    _ringReadySlot = _ringWriteSlot;
+}
+
+/*************/
+void Texture_Image::uploadFromUnpackBuffer(const ImageBufferSpec& spec, GLenum channelOrder, GLenum dataFormat, GLenum internalFormat, bool isCompressed, int dataSize, uintptr_t offset)
+{
+    // With a buffer bound to GL_PIXEL_UNPACK_BUFFER, the data pointer is an offset in this buffer
+    auto data = reinterpret_cast<const GLvoid*>(offset);
+    if (spec.isPlanar())
+    {
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, spec.width, spec.height, channelOrder, dataFormat, data);
+        uploadPlaneTextures(spec, reinterpret_cast<const char*>(data));
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    }
+    else if (!isCompressed)
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, spec.width, spec.height, channelOrder, dataFormat, data);
+    else
+        glCompressedTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, spec.width, spec.height, internalFormat, dataSize, data);
+}
+
+/*************/
+void Texture_Image::createPlaneTextures(const ImageBufferSpec& spec)
+{
+    glDeleteTextures(2, _glPlaneTex);
+    glGenTextures(2, _glPlaneTex);
+
+    auto planes = spec.getPlanes();
+    auto is16Bits = spec.type == ImageBufferSpec::Type::UINT16;
+    for (size_t i = 1; i < planes.size(); ++i)
+    {
+        const auto& plane = planes[i];
+        GLenum internalFormat;
+        if (plane.channels == 2)
+            internalFormat = is16Bits ? GL_RG16 : GL_RG8;
+        else
+            internalFormat = is16Bits ? GL_R16 : GL_R8;
+
+        glBindTexture(GL_TEXTURE_2D, _glPlaneTex[i - 1]);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, _glTextureWrap);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, _glTextureWrap);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexStorage2D(GL_TEXTURE_2D, 1, internalFormat, plane.width, plane.height);
+    }
+
+    glBindTexture(GL_TEXTURE_2D, _glTex);
+}
+
+/*************/
+void Texture_Image::uploadPlaneTextures(const ImageBufferSpec& spec, const char* data)
+{
+    auto planes = spec.getPlanes();
+    auto dataFormat = spec.type == ImageBufferSpec::Type::UINT16 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_BYTE;
+    for (size_t i = 1; i < planes.size(); ++i)
+    {
+        const auto& plane = planes[i];
+        glBindTexture(GL_TEXTURE_2D, _glPlaneTex[i - 1]);
+        // With a PBO bound, the data pointer is an offset in the PBO
+        auto planeData = reinterpret_cast<const GLvoid*>(reinterpret_cast<uintptr_t>(data) + plane.offset);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, plane.width, plane.height, plane.channels == 2 ? GL_RG : GL_RED, dataFormat, planeData);
+    }
+
+    glBindTexture(GL_TEXTURE_2D, _glTex);
 }
 
 /*************/
@@ -577,6 +881,12 @@ void Texture_Image::registerAttributes()
         },
         {'n', 'n'});
     setAttributeDescription("size", "Change the texture size");
+
+    addAttribute("deferredUploads",
+        [&](const Values& args) { return false; },
+        [&]() -> Values { return {_deferredUploads.load()}; });
+    setAttributeParameter("deferredUploads", false, true);
+    setAttributeDescription("deferredUploads", "Number of updates deferred to a later frame by the upload budget of the Scene");
 }
 
 } // end of namespace
@@ -0,0 +1,327 @@
+#include "./threadPlacement.h"
+
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <tuple>
+
+#include "./log.h"
+#include "./osUtils.h"
+
+#define SPLASH_SYSFS_CPU_PATH "/sys/devices/system/cpu/"
+#define SPLASH_BACKGROUND_NICE 10
+
+using namespace std;
+
+namespace Splash
+{
+
+/*************/
+namespace
+{
+string readSysfsFile(const string& path)
+{
+    ifstream file(path);
+    if (!file.is_open())
+        return {};
+    string content;
+    getline(file, content);
+    return content;
+}
+} // end of anonymous namespace
+
+/*************/
+ThreadPlacement::Registration::~Registration()
+{
+    if (_threadId != 0)
+        ThreadPlacement::get().unregisterThread(_threadId);
+}
+
+/*************/
+string ThreadPlacement::getClassName(Class threadClass)
+{
+    switch (threadClass)
+    {
+    case Class::render:
+        return "render";
+    case Class::upload:
+        return "upload";
+    case Class::decode:
+        return "decode";
+    case Class::background:
+        return "background";
+    }
+    return "unknown";
+}
+
+/*************/
+vector<int> ThreadPlacement::parseCpuList(const string& list)
+{
+    vector<int> cpus;
+    stringstream stream(list);
+    string range;
+    while (getline(stream, range, ','))
+    {
+        if (range.empty() || !isdigit(range[0]))
+            continue;
+
+        auto dash = range.find('-');
+        try
+        {
+            if (dash == string::npos)
+            {
+                cpus.push_back(stoi(range));
+            }
+            else
+            {
+                auto first = stoi(range.substr(0, dash));
+                auto last = stoi(range.substr(dash + 1));
+                for (int cpu = first; cpu <= last; ++cpu)
+                    cpus.push_back(cpu);
+            }
+        }
+        catch (...)
+        {
+            return {};
+        }
+    }
+
+    sort(cpus.begin(), cpus.end());
+    cpus.erase(unique(cpus.begin(), cpus.end()), cpus.end());
+    return cpus;
+}
+
+/*************/
+vector<ThreadPlacement::Cpu> ThreadPlacement::readTopology()
+{
+    vector<Cpu> cpus;
+#if HAVE_LINUX
+    auto online = parseCpuList(readSysfsFile(SPLASH_SYSFS_CPU_PATH "online"));
+    for (auto id : online)
+    {
+        auto cpuPath = string(SPLASH_SYSFS_CPU_PATH "cpu") + to_string(id) + "/";
+
+        Cpu cpu;
+        cpu.id = id;
+
+        auto siblings = parseCpuList(readSysfsFile(cpuPath + "topology/thread_siblings_list"));
+        cpu.core = siblings.empty() ? id : siblings[0];
+
+        // The L3 domain is not always the package (i.e. CCX on AMD CPUs). Without L3 information, fall back to the package,
+        // with a negative id so as not to collide with CPU indices
+        cpu.l3 = -1;
+        for (int index = 0; index < 8; ++index)
+        {
+            auto cachePath = cpuPath + "cache/index" + to_string(index) + "/";
+            auto level = readSysfsFile(cachePath + "level");
+            if (level.empty())
+                break;
+            if (level != "3")
+                continue;
+            auto shared = parseCpuList(readSysfsFile(cachePath + "shared_cpu_list"));
+            if (!shared.empty())
+                cpu.l3 = shared[0];
+            break;
+        }
+        if (cpu.l3 == -1)
+        {
+            auto package = readSysfsFile(cpuPath + "topology/physical_package_id");
+            cpu.l3 = package.empty() ? 0 : -1 - atoi(package.c_str());
+        }
+
+        cpu.node = 0;
+        auto files = Utils::listDirContent(cpuPath);
+        for (const auto& file : files)
+        {
+            if (file.size() > 4 && file.substr(0, 4) == "node" && isdigit(file[4]))
+            {
+                cpu.node = atoi(file.substr(4).c_str());
+                break;
+            }
+        }
+
+        cpus.push_back(cpu);
+    }
+#endif
+    return cpus;
+}
+
+/*************/
+vector<ThreadPlacement::Assignment> ThreadPlacement::computeAssignments(const vector<Cpu>& cpus, int processCount)
+{
+    if (processCount <= 0)
+        return {};
+
+    // Group the logical CPUs in physical cores, sorted so that neighbouring cores share their L3 cache and NUMA node
+    map<tuple<int, int, int>, vector<int>> coresMap;
+    for (const auto& cpu : cpus)
+        coresMap[make_tuple(cpu.node, cpu.l3, cpu.core)].push_back(cpu.id);
+    vector<vector<int>> cores;
+    for (auto& core : coresMap)
+    {
+        sort(core.second.begin(), core.second.end());
+        cores.push_back(core.second);
+    }
+
+    auto coreCount = static_cast<int>(cores.size());
+    auto render = static_cast<int>(Class::render);
+    auto upload = static_cast<int>(Class::upload);
+    auto decode = static_cast<int>(Class::decode);
+    auto background = static_cast<int>(Class::background);
+
+    vector<Assignment> assignments(processCount);
+    int firstShared = 0;
+    if (coreCount >= 2 * processCount + 2)
+    {
+        // Dedicated physical cores for render and upload
+        for (int i = 0; i < processCount; ++i)
+        {
+            assignments[i].cores[render] = cores[2 * i];
+            assignments[i].cores[upload] = cores[2 * i + 1];
+        }
+        firstShared = 2 * processCount;
+    }
+    else if (coreCount >= processCount + 2)
+    {
+        // One physical core per process, upload going to the SMT sibling of the render thread if any
+        for (int i = 0; i < processCount; ++i)
+        {
+            const auto& core = cores[i];
+            assignments[i].cores[render] = {core[0]};
+            assignments[i].cores[upload] = {core.size() > 1 ? core[1] : core[0]};
+        }
+        firstShared = processCount;
+    }
+    else
+    {
+        return {};
+    }
+
+    // Decode threads share the remaining cores but the last one, which is left to background threads
+    vector<int> decodeCores;
+    for (int i = firstShared; i < coreCount - 1; ++i)
+        decodeCores.insert(decodeCores.end(), cores[i].begin(), cores[i].end());
+    auto backgroundCores = cores[coreCount - 1];
+
+    for (auto& assignment : assignments)
+    {
+        assignment.cores[decode] = decodeCores;
+        assignment.cores[background] = backgroundCores;
+    }
+
+    return assignments;
+}
+
+/*************/
+string ThreadPlacement::describe(const Assignment& assignment)
+{
+    if (assignment.empty())
+        return "no placement";
+
+    string description;
+    for (int i = 0; i < classCount; ++i)
+    {
+        if (i != 0)
+            description += ", ";
+        description += getClassName(static_cast<Class>(i)) + " {";
+        for (size_t c = 0; c < assignment.cores[i].size(); ++c)
+            description += (c != 0 ? "," : "") + to_string(assignment.cores[i][c]);
+        description += "}";
+    }
+    if (assignment.realtime)
+        description += ", realtime";
+    return description;
+}
+
+/*************/
+ThreadPlacement::Registration ThreadPlacement::registerThread(Class threadClass)
+{
+#if HAVE_LINUX
+    auto threadId = Utils::getThreadId();
+    lock_guard<mutex> lock(_mutex);
+    auto& thread = _threads[threadId];
+    thread = Thread();
+    thread.threadClass = threadClass;
+    if (!_assignment.empty())
+        applyToThread(threadId, thread, Assignment());
+    return Registration(threadId);
+#else
+    return Registration();
+#endif
+}
+
+/*************/
+void ThreadPlacement::unregisterThread(int threadId)
+{
+    lock_guard<mutex> lock(_mutex);
+    _threads.erase(threadId);
+}
+
+/*************/
+void ThreadPlacement::setAssignment(const Assignment& assignment)
+{
+    lock_guard<mutex> lock(_mutex);
+    auto previous = _assignment;
+    _assignment = assignment;
+    if (_assignment.empty() && previous.empty())
+        return;
+
+    for (auto& thread : _threads)
+        applyToThread(thread.first, thread.second, previous);
+}
+
+/*************/
+ThreadPlacement::Assignment ThreadPlacement::getAssignment() const
+{
+    lock_guard<mutex> lock(_mutex);
+    return _assignment;
+}
+
+/*************/
+void ThreadPlacement::applyToThread(int threadId, Thread& thread, const Assignment& previous)
+{
+    auto threadClass = thread.threadClass;
+    if (_assignment.empty())
+    {
+        // Back to the scheduling the thread had before the placement, i.e. SCHED_RR for the thread pool workers
+        if (!thread.saved)
+            return;
+        if (!Utils::setAffinity(thread.cores, threadId) || !Utils::setScheduling(thread.scheduling, threadId))
+            Log::get() << Log::WARNING << "ThreadPlacement::" << __FUNCTION__ << " - Unable to restore the scheduling of a " << getClassName(threadClass) << " thread" << Log::endl;
+        thread.saved = false;
+        return;
+    }
+
+    if (!thread.saved)
+        thread.saved = Utils::getAffinity(thread.cores, threadId) && Utils::getScheduling(thread.scheduling, threadId);
+
+    const auto& cores = _assignment.cores[static_cast<int>(threadClass)];
+    if (!Utils::setAffinity(cores, threadId))
+        Log::get() << Log::WARNING << "ThreadPlacement::" << __FUNCTION__ << " - Unable to set the affinity of a " << getClassName(threadClass) << " thread" << Log::endl;
+
+    switch (threadClass)
+    {
+    case Class::render:
+    case Class::upload:
+        if (_assignment.realtime)
+        {
+            if (!Utils::setRealTime(true, threadId))
+                Log::get() << Log::WARNING << "ThreadPlacement::" << __FUNCTION__ << " - Unable to set a " << getClassName(threadClass) << " thread to SCHED_FIFO" << Log::endl;
+        }
+        else if (previous.realtime && thread.saved)
+        {
+            Utils::setScheduling(thread.scheduling, threadId);
+        }
+        break;
+    case Class::decode:
+        // Decode threads must not preempt the render and upload threads, whatever their previous scheduling
+        Utils::setNormalScheduling(0, threadId);
+        break;
+    case Class::background:
+        Utils::setNormalScheduling(SPLASH_BACKGROUND_NICE, threadId);
+        break;
+    }
+}
+
+} // end of namespace
@@ -1,149 +1,318 @@
 #include "./threadpool.h"
 
 #include <algorithm>
+#include <cstring>
 #include <unistd.h>
 
 #include "./log.h"
 #include "./osUtils.h"
+#include "./threadPlacement.h"
+
+#define SPLASH_PARALLEL_COPY_PAGE_SIZE 4096
+#define SPLASH_PARALLEL_COPY_GRAIN (1 << 20)
+#define SPLASH_PARALLEL_COPY_MAX_CHUNKS 4
 
 using namespace std;
 using namespace Splash;
 
+namespace
+{
+thread_local ThreadPool* currentPool{nullptr}; //!< Pool the current thread is a worker of
+thread_local unsigned int currentWorker{0};    //!< Index of the current thread in its pool
+}
+
 /*************/
-void Worker::operator()()
+ThreadPool::ThreadPool(int threads)
 {
-    shared_ptr<function<void()>> task;
-    Utils::setRealTime();
+    int nprocessors = threads;
+    if (threads == -1)
+        nprocessors = std::min(std::max(thread::hardware_concurrency(), 2u), 32u);
+    addWorkers(nprocessors);
+}
 
-    while (true)
+/*************/
+ThreadPool::~ThreadPool()
+{
+    // Stop all threads
     {
-        if (!affinitySet && pool.cores.size() > 0)
-        {
-            Utils::setAffinity(pool.cores);
-            affinitySet = true;
-        }
+        lock_guard<mutex> lock(_sleepMutex);
+        _stop = true;
+    }
+    _sleepCondition.notify_all();
 
-        unsigned int id;
-        {
-            // Acquire locklock
-            unique_lock<mutex> lock(pool.queue_mutex);
+    // join them
+    for (auto& worker : _workers)
+        worker.join();
+}
+
+/*************/
+void ThreadPool::addWorkers(unsigned int nbr)
+{
+    for (unsigned int i = 0; i < nbr && _workersNumber < SPLASH_THREADPOOL_MAX_WORKERS; ++i)
+    {
+        auto index = _workersNumber.load();
+        _workers.emplace_back(thread([=]() { workerLoop(index); }));
+        ++_workersNumber;
+    }
+}
 
-            // look for a work item
-            while (!pool.stop && pool.tasks.empty())
-                pool.condition.wait(lock);
+/*************/
+void ThreadPool::setAffinity(const vector<int>& cores)
+{
+    lock_guard<mutex> lock(_coresMutex);
+    _cores = cores;
+    ++_coresVersion;
+}
 
-            // exit the pool if stopped
-            if (pool.stop)
-                return;
+/*************/
+void ThreadPool::waitAllThreads()
+{
+    unique_lock<mutex> lock(_doneMutex);
+    _doneCondition.wait(lock, [&]() { return _stop || (_queuedTasks == 0 && _runningTasks == 0); });
+}
+
+/*************/
+void ThreadPool::waitThreads(vector<unsigned int>& list)
+{
+    unique_lock<mutex> lock(_doneMutex);
+    _doneCondition.wait(lock, [&]() {
+        if (_stop)
+            return true;
+        for (auto id : list)
+            if (_pendingIds.find(id) != _pendingIds.end())
+                return false;
+        return true;
+    });
+    list.clear();
+}
 
-            task.swap(pool.tasks.front());
-            pool.tasks.pop_front();
+/*************/
+void ThreadPool::parallelCopy(void* dst, const void* src, size_t size)
+{
+    auto dstPtr = static_cast<char*>(dst);
+    auto srcPtr = static_cast<const char*>(src);
+    if (size < 2 * SPLASH_PARALLEL_COPY_GRAIN)
+    {
+        memcpy(dstPtr, srcPtr, size);
+        return;
+    }
 
-            id = pool.tasksId.front();
-            pool.tasksId.pop_front();
-        }
+    auto pages = (size + SPLASH_PARALLEL_COPY_PAGE_SIZE - 1) / SPLASH_PARALLEL_COPY_PAGE_SIZE;
+    parallelFor(0, pages,
+        [&](size_t first, size_t last) {
+            auto offset = first * SPLASH_PARALLEL_COPY_PAGE_SIZE;
+            auto chunkSize = std::min(last * SPLASH_PARALLEL_COPY_PAGE_SIZE, size) - offset;
+            memcpy(dstPtr + offset, srcPtr + offset, chunkSize);
+        },
+        SPLASH_PARALLEL_COPY_GRAIN / SPLASH_PARALLEL_COPY_PAGE_SIZE,
+        SPLASH_PARALLEL_COPY_MAX_CHUNKS);
+}
 
-        // Execute the task
-        pool.workingThreads++;
-        (*task)();
-        pool.workingThreads--;
+/*************/
+void ThreadPool::push(Task&& task)
+{
+    // Tasks submitted by a worker stay on its own queue, others are spread over all queues
+    unsigned int index;
+    if (currentPool == this)
+        index = currentWorker;
+    else
+        index = _nextQueue.fetch_add(1) % max(_workersNumber.load(), 1u);
 
-        {
-            lock_guard<mutex> lock(pool.queue_mutex);
-            if (id != 0)
-                pool.tasksFinished.push_back(id);
-        }
+    {
+        lock_guard<mutex> lock(_queues[index].mutex);
+        _queues[index].tasks.push_back(std::move(task));
+        ++_queuedTasks;
+    }
+
+    // Locking ensures that a worker about to sleep sees the new task
+    {
+        lock_guard<mutex> lock(_sleepMutex);
     }
+    _sleepCondition.notify_one();
 }
 
 /*************/
-ThreadPool::ThreadPool(int threads)
+bool ThreadPool::pop(unsigned int index, Task& task)
 {
-    int nprocessors = threads;
-    if (threads == -1)
-        nprocessors = std::min(std::max(thread::hardware_concurrency(), 2u), 32u);
-    for (size_t i = 0; i < nprocessors; ++i)
-        workers.emplace_back(thread(Worker(*this)));
+    {
+        auto& queue = _queues[index];
+        lock_guard<mutex> lock(queue.mutex);
+        if (!queue.tasks.empty())
+        {
+            task = std::move(queue.tasks.back());
+            queue.tasks.pop_back();
+            ++_runningTasks; // Incremented first, so that no task seems left in between
+            --_queuedTasks;
+            return true;
+        }
+    }
+
+    // Steal the oldest task of another queue
+    auto workersNumber = _workersNumber.load();
+    for (unsigned int i = 1; i < workersNumber; ++i)
+    {
+        auto& queue = _queues[(index + i) % workersNumber];
+        lock_guard<mutex> lock(queue.mutex);
+        if (!queue.tasks.empty())
+        {
+            task = std::move(queue.tasks.front());
+            queue.tasks.pop_front();
+            ++_runningTasks;
+            --_queuedTasks;
+            return true;
+        }
+    }
+
+    return false;
 }
 
 /*************/
-ThreadPool::~ThreadPool()
+bool ThreadPool::popFromGroup(const TaskGroup* group, Task& task)
 {
-    // Stop all threads
-    stop = true;
-    condition.notify_all();
+    auto workersNumber = _workersNumber.load();
+    for (unsigned int i = 0; i < workersNumber; ++i)
+    {
+        auto& queue = _queues[i];
+        lock_guard<mutex> lock(queue.mutex);
+        auto taskIt = find_if(queue.tasks.rbegin(), queue.tasks.rend(), [&](const Task& t) { return t.group == group; });
+        if (taskIt != queue.tasks.rend())
+        {
+            task = std::move(*taskIt);
+            queue.tasks.erase(std::next(taskIt).base());
+            ++_runningTasks;
+            --_queuedTasks;
+            return true;
+        }
+    }
 
-    // join them
-    for (size_t i = 0; i < workers.size(); ++i)
-        workers[i].join();
+    return false;
 }
 
 /*************/
-void ThreadPool::setAffinity(const vector<int>& cores)
+void ThreadPool::run(Task& task)
 {
-    this->cores = cores;
+    task.function();
+
+    if (task.group != nullptr)
+        task.group->taskDone();
+
+    lock_guard<mutex> lock(_doneMutex);
+    if (task.id != 0)
+        _pendingIds.erase(task.id);
+    --_runningTasks;
+    if (task.id != 0 || (_queuedTasks == 0 && _runningTasks == 0))
+        _doneCondition.notify_all();
 }
 
 /*************/
-void ThreadPool::waitAllThreads()
+void ThreadPool::workerLoop(unsigned int index)
 {
+    currentPool = this;
+    currentWorker = index;
+    Utils::setRealTime();
+    auto threadPlacement = ThreadPlacement::get().registerThread(ThreadPlacement::Class::decode);
+
+    unsigned int coresVersion = 0;
     while (true)
     {
-        this_thread::sleep_for(chrono::nanoseconds((unsigned long)1e5));
-        if (workingThreads == 0 && tasks.size() == 0)
+        if (coresVersion != _coresVersion)
         {
-            lock_guard<mutex> lock(queue_mutex);
-            tasksFinished.clear();
-            break;
+            lock_guard<mutex> lock(_coresMutex);
+            if (_cores.size() > 0)
+                Utils::setAffinity(_cores);
+            coresVersion = _coresVersion;
         }
+
+        Task task;
+        if (pop(index, task))
+        {
+            run(task);
+            continue;
+        }
+
+        unique_lock<mutex> lock(_sleepMutex);
+        _sleepCondition.wait(lock, [&]() { return _stop || _queuedTasks != 0; });
+        if (_stop)
+            return;
     }
 }
 
 /*************/
-void ThreadPool::waitThreads(vector<unsigned int>& list)
+void TaskGroup::wait()
 {
     while (true)
     {
-        this_thread::sleep_for(chrono::microseconds(100));
-
-        lock_guard<mutex> lock(queue_mutex);
-        if (list.size() == 0 || stop == true)
         {
-            break;
+            lock_guard<mutex> lock(_mutex);
+            if (_pendingTasks == 0)
+                return;
         }
 
-        while (true)
+        // Run the tasks of the group which have not been started yet
+        ThreadPool::Task task;
+        if (_pool.popFromGroup(this, task))
         {
-            auto task = find(tasksFinished.begin(), tasksFinished.end(), list[0]);
-            if (task != tasksFinished.end())
-            {
-                list.erase(list.begin());
-                tasksFinished.erase(task);
-            }
-            else
-            {
-                break;
-            }
+            _pool.run(task);
+            continue;
         }
+
+        // All remaining tasks are being run by workers
+        unique_lock<mutex> lock(_mutex);
+        _condition.wait(lock, [&]() { return _pendingTasks == 0; });
+        return;
     }
 }
 
 /*************/
-unsigned int ThreadPool::getTasksNumber()
+void TaskGroup::taskDone()
 {
-    int size;
+    lock_guard<mutex> lock(_mutex);
+    if (--_pendingTasks == 0)
+        _condition.notify_all();
+}
+
+/*************/
+TaskGraph::NodeId TaskGraph::addNode(const function<void()>& f, const vector<NodeId>& dependencies)
+{
+    auto id = _nodes.size();
+    _nodes.emplace_back(new Node());
+    auto& node = *_nodes.back();
+    node.function = f;
+
+    for (auto dependency : dependencies)
     {
-        lock_guard<mutex> lock(queue_mutex);
-        size = tasks.size();
+        if (dependency >= id)
+            continue;
+        _nodes[dependency]->successors.push_back(id);
+        ++node.remainingDependencies;
     }
-    return size;
+
+    return id;
 }
 
 /*************/
-void ThreadPool::addWorkers(unsigned int nbr)
+void TaskGraph::run()
 {
-    for (unsigned int i = 0; i < nbr; ++i)
-        workers.emplace_back(thread(Worker(*this)));
+    // Roots are listed first, as started nodes update the dependency counts of the others
+    vector<NodeId> roots;
+    for (NodeId id = 0; id < _nodes.size(); ++id)
+        if (_nodes[id]->remainingDependencies == 0)
+            roots.push_back(id);
+
+    for (auto id : roots)
+        _tasks.run([=]() { runNode(id); });
+}
+
+/*************/
+void TaskGraph::runNode(NodeId id)
+{
+    auto& node = *_nodes[id];
+    node.function();
+
+    // Successors are queued from this worker, which will most likely run them next
+    for (auto successor : node.successors)
+        if (--_nodes[successor]->remainingDependencies == 0)
+            _tasks.run([=]() { runNode(successor); });
 }
 
 /*************/
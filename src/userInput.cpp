@@ -1,6 +1,7 @@
 #include "./userInput.h"
 
 #include "./scene.h"
+#include "./threadPlacement.h"
 
 using namespace std;
 
@@ -35,6 +36,7 @@ UserInput::UserInput(weak_ptr<RootObject> root)
     _type = "userInput";
     registerAttributes();
     _updateThread = thread([&]() {
+        auto threadPlacement = ThreadPlacement::get().registerThread(ThreadPlacement::Class::background);
         _running = true;
         updateLoop();
     });
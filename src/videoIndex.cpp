@@ -0,0 +1,156 @@
+#include "./videoIndex.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <sys/stat.h>
+
+#define SPLASH_VIDEO_INDEX_EXTENSION ".splashindex"
+#define SPLASH_VIDEO_INDEX_MAGIC "SPLASHIDX"
+#define SPLASH_VIDEO_INDEX_VERSION 1
+
+using namespace std;
+
+namespace Splash
+{
+
+/*************/
+namespace
+{
+struct IndexHeader
+{
+    char magic[sizeof(SPLASH_VIDEO_INDEX_MAGIC)];
+    uint32_t version;
+    uint64_t mediaSize;
+    int64_t mediaTime;
+    uint64_t count;
+};
+
+struct IndexRecord
+{
+    int64_t pts;
+    uint8_t keyframe;
+    uint8_t padding[7];
+};
+} // end of anonymous namespace
+
+/*************/
+string VideoIndex::getIndexPath(const string& mediaPath)
+{
+    return mediaPath + SPLASH_VIDEO_INDEX_EXTENSION;
+}
+
+/*************/
+bool VideoIndex::getFileStamp(const string& path, uint64_t& size, int64_t& modificationTime)
+{
+    struct stat fileStat;
+    if (stat(path.c_str(), &fileStat) != 0)
+        return false;
+    size = static_cast<uint64_t>(fileStat.st_size);
+    modificationTime = static_cast<int64_t>(fileStat.st_mtime);
+    return true;
+}
+
+/*************/
+bool VideoIndex::load(const string& mediaPath)
+{
+    uint64_t mediaSize;
+    int64_t mediaTime;
+    if (!getFileStamp(mediaPath, mediaSize, mediaTime))
+        return false;
+
+    ifstream file(getIndexPath(mediaPath), ios::in | ios::binary);
+    if (!file.is_open())
+        return false;
+
+    IndexHeader header;
+    if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)))
+        return false;
+    if (strncmp(header.magic, SPLASH_VIDEO_INDEX_MAGIC, sizeof(header.magic)) != 0 || header.version != SPLASH_VIDEO_INDEX_VERSION)
+        return false;
+    if (header.mediaSize != mediaSize || header.mediaTime != mediaTime)
+        return false;
+
+    // A truncated or corrupted index is rebuilt, instead of trusting its record count
+    auto recordsStart = file.tellg();
+    file.seekg(0, ios::end);
+    auto remainingSize = static_cast<uint64_t>(file.tellg() - recordsStart);
+    file.seekg(recordsStart);
+    if (header.count > remainingSize / sizeof(IndexRecord))
+        return false;
+
+    vector<IndexRecord> records(header.count);
+    if (!file.read(reinterpret_cast<char*>(records.data()), records.size() * sizeof(IndexRecord)))
+        return false;
+
+    vector<Entry> entries(records.size());
+    for (size_t i = 0; i < records.size(); ++i)
+        entries[i] = {records[i].pts, records[i].keyframe != 0};
+    setEntries(std::move(entries));
+    return true;
+}
+
+/*************/
+bool VideoIndex::save(const string& mediaPath) const
+{
+    IndexHeader header;
+    memset(&header, 0, sizeof(header));
+    if (!getFileStamp(mediaPath, header.mediaSize, header.mediaTime))
+        return false;
+    strncpy(header.magic, SPLASH_VIDEO_INDEX_MAGIC, sizeof(header.magic));
+    header.version = SPLASH_VIDEO_INDEX_VERSION;
+    header.count = _entries.size();
+
+    vector<IndexRecord> records(_entries.size());
+    memset(records.data(), 0, records.size() * sizeof(IndexRecord));
+    for (size_t i = 0; i < _entries.size(); ++i)
+    {
+        records[i].pts = _entries[i].pts;
+        records[i].keyframe = _entries[i].keyframe;
+    }
+
+    ofstream file(getIndexPath(mediaPath), ios::out | ios::binary | ios::trunc);
+    if (!file.is_open())
+        return false;
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char*>(records.data()), records.size() * sizeof(IndexRecord));
+    return file.good();
+}
+
+/*************/
+void VideoIndex::setEntries(vector<Entry>&& entries)
+{
+    _entries = std::move(entries);
+    stable_sort(_entries.begin(), _entries.end(), [](const Entry& a, const Entry& b) { return a.pts < b.pts; });
+    _keyframeCount = count_if(_entries.begin(), _entries.end(), [](const Entry& e) { return e.keyframe; });
+}
+
+/*************/
+int64_t VideoIndex::findFrame(int64_t pts) const
+{
+    if (_entries.empty())
+        return pts;
+
+    auto entryIt = lower_bound(_entries.begin(), _entries.end(), pts, [](const Entry& e, int64_t value) { return e.pts < value; });
+    if (entryIt == _entries.end())
+        return _entries.back().pts;
+    return entryIt->pts;
+}
+
+/*************/
+int64_t VideoIndex::findKeyframe(int64_t pts) const
+{
+    auto entryIt = upper_bound(_entries.begin(), _entries.end(), pts, [](int64_t value, const Entry& e) { return value < e.pts; });
+    while (entryIt != _entries.begin())
+    {
+        --entryIt;
+        if (entryIt->keyframe)
+            return entryIt->pts;
+    }
+
+    // Nothing before pts, fall back to the first keyframe
+    auto keyframeIt = find_if(_entries.begin(), _entries.end(), [](const Entry& e) { return e.keyframe; });
+    return keyframeIt == _entries.end() ? pts : keyframeIt->pts;
+}
+
+} // end of namespace
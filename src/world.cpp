@@ -3,17 +3,21 @@
 #include <chrono>
 #include <fstream>
 #include <glm/gtc/matrix_transform.hpp>
+#include <set>
 #include <spawn.h>
 #include <sys/wait.h>
 #include <unistd.h>
 
+#include "./decodeScheduler.h"
 #include "./image.h"
 #include "./link.h"
 #include "./log.h"
+#include "./loopCache.h"
 #include "./mesh.h"
 #include "./osUtils.h"
 #include "./queue.h"
 #include "./scene.h"
+#include "./threadPlacement.h"
 #include "./threadpool.h"
 #include "./timer.h"
 
@@ -23,6 +27,8 @@
 
 #define SPLASH_FILE_CONFIGURATION "splashConfiguration"
 #define SPLASH_FILE_PROJECT "splashProject"
+#define SPLASH_WORLD_REMOTE_SCENE_TIMEOUT 60 // Seconds to wait for a remote Scene to connect
+#define SPLASH_WORLD_FULL_SYNC_PERIOD 60 // Number of world loops between two full synchronizations of the distant attributes
 
 using namespace glm;
 using namespace std;
@@ -56,6 +62,7 @@ World::~World()
 /*************/
 void World::run()
 {
+    auto threadPlacement = ThreadPlacement::get().registerThread(ThreadPlacement::Class::render);
     applyConfig();
 
     while (true)
@@ -64,60 +71,124 @@ void World::run()
         Timer::get() << "innerWorldLoop";
         lock_guard<mutex> lockConfiguration(_configurationMutex);
 
+        // Messages sent during this loop are grouped and sent at once at its end
+        _link->startMessageBatch();
+
         // Execute waiting tasks
         runTasks();
 
         {
             lock_guard<recursive_mutex> lockObjects(_objectsMutex);
 
-            // Read and serialize new buffers
+            // Buffers which got a new subscriber are sent again, otherwise still images would never reach it
+            auto newSubscriptions = _link->getNewBufferSubscriptions();
+            if (!newSubscriptions.empty())
+            {
+                for (auto& o : _objects)
+                {
+                    auto bufferObj = dynamic_pointer_cast<BufferObject>(o.second);
+                    if (bufferObj && find(newSubscriptions.begin(), newSubscriptions.end(), bufferObj->getDistantName()) != newSubscriptions.end())
+                        bufferObj->updateTimestamp();
+                }
+            }
+
+            // Update the local objects in parallel, as reading a new frame can be heavy. They are waited for, as the tasks
+            // and the distant attributes of the next loop access the same objects.
+            // A buffer still in flight from a previous loop is left as is until it is sent
             Timer::get() << "serialize";
-            vector<unsigned int> threadIds;
-            unordered_map<string, shared_ptr<SerializedObject>> serializedObjects;
+            while (!_frameGraphs.empty() && !_frameGraphs.front()->isPending())
+                _frameGraphs.pop_front();
+
+            vector<shared_ptr<BufferObject>> bufferObjects;
+            unordered_set<string> distantNames;
+            TaskGroup updateTasks;
             for (auto& o : _objects)
             {
                 auto bufferObj = dynamic_pointer_cast<BufferObject>(o.second);
-                // This prevents the map structure to be modified in the threads
-                auto serializedObjectIt = serializedObjects.emplace(std::make_pair(bufferObj->getDistantName(), shared_ptr<SerializedObject>(nullptr)));
-                if (!serializedObjectIt.second)
-                    continue; // Error while inserting the object in the map
+                if (!bufferObj)
+                    continue;
 
-                threadIds.push_back(SThread::pool.enqueue([=, &o]() {
-                    // Update the local objects
-                    o.second->update();
+                // Only the first object with a given distant name is handled
+                auto distantName = bufferObj->getDistantName();
+                if (!distantNames.insert(distantName).second)
+                    continue;
 
-                    // Send them the their destinations
-                    if (bufferObj.get() != nullptr)
-                    {
-                        if (bufferObj->wasUpdated()) // if the buffer has been updated
-                        {
-                            auto obj = bufferObj->serialize();
-                            bufferObj->setNotUpdated();
-                            if (obj)
-                                serializedObjectIt.first->second = obj;
-                        }
-                    }
-                }));
+                {
+                    lock_guard<mutex> lockInFlight(_buffersInFlightMutex);
+                    if (!_buffersInFlight.insert(distantName).second)
+                        continue;
+                }
+
+                bufferObjects.push_back(bufferObj);
+                updateTasks.run([=]() { bufferObj->update(); });
             }
-            SThread::pool.waitThreads(threadIds);
-            Timer::get() >> "serialize";
+            updateTasks.wait();
 
-            // Wait for previous buffers to be uploaded
-            _link->waitForBufferSending(chrono::milliseconds((unsigned long long)(1e3 / 30))); // Maximum time to wait for frames to arrive
-            sendMessage(SPLASH_ALL_PEERS, "bufferUploaded", {});
-            Timer::get() >> "upload";
+            // Each updated buffer gets a serialize node, followed by a node sending it as soon as it is serialized.
+            // The World does not wait for them
+            auto frameGraph = unique_ptr<TaskGraph>(new TaskGraph());
+            vector<TaskGraph::NodeId> sendNodes;
+            for (auto& bufferObj : bufferObjects)
+            {
+                // Buffers no Scene subscribed to are not serialized, and stay marked as updated until one does
+                auto distantName = bufferObj->getDistantName();
+                if (!bufferObj->wasUpdated() || !_link->isBufferNeeded(distantName))
+                {
+                    lock_guard<mutex> lockInFlight(_buffersInFlightMutex);
+                    _buffersInFlight.erase(distantName);
+                    continue;
+                }
+
+                // Serialized buffer, and whether it fits a limited bandwidth
+                auto serialized = make_shared<pair<shared_ptr<SerializedObject>, bool>>(nullptr, true);
+                auto serializeNode = frameGraph->addNode([=]() {
+                    if (Timer::get().isDebug())
+                        Timer::get() << "serializeNode " + distantName;
+                    serialized->first = bufferObj->serialize();
+                    serialized->second = bufferObj->fitsLimitedBandwidth();
+                    bufferObj->setNotUpdated();
+                    if (Timer::get().isDebug())
+                        Timer::get() >> "serializeNode " + distantName;
+                });
+
+                auto sendNode = frameGraph->addNode(
+                    [=]() {
+                        if (Timer::get().isDebug())
+                            Timer::get() << "sendNode " + distantName;
+                        if (serialized->first)
+                            _link->sendBuffer(distantName, std::move(serialized->first), serialized->second);
+                        if (Timer::get().isDebug())
+                            Timer::get() >> "sendNode " + distantName;
+
+                        lock_guard<mutex> lockInFlight(_buffersInFlightMutex);
+                        _buffersInFlight.erase(distantName);
+                    },
+                    {serializeNode});
+                sendNodes.push_back(sendNode);
+            }
 
-            // Ask for the upload of the new buffers, during the next world loop
-            Timer::get() << "upload";
-            for (auto& o : serializedObjects)
-                if (o.second)
-                    _link->sendBuffer(o.first, std::move(o.second));
+            // The time taken to serialize and queue the buffers of a loop is shown as the "upload" duration
+            if (!sendNodes.empty())
+            {
+                auto sendStart = Timer::getTime();
+                frameGraph->addNode([=]() { _sendDuration = Timer::getTime() - sendStart; }, sendNodes);
+            }
+            frameGraph->run();
+            _frameGraphs.push_back(std::move(frameGraph));
+            Timer::get().setDuration("upload", _sendDuration);
+            Timer::get() >> "serialize";
+
+            // Buffers are sent in the background, each Scene getting the latest ones once it is done with the previous ones.
+            // A Scene uploads its textures once it has received and deserialized a buffer
         }
 
+        // Only changes are sent to the Scenes, except for a periodic full resync
+        auto fullSync = (_loopIndex++ % SPLASH_WORLD_FULL_SYNC_PERIOD == 0);
+
         // Update the distant attributes
         for (auto& o : _objects)
         {
-            auto attribs = o.second->getDistantAttributes();
+            auto attribs = o.second->getDistantAttributes(fullSync);
             for (auto& attrib : attribs)
             {
                 sendMessage(o.second->getName(), attrib.first, attrib.second);
@@ -130,7 +201,14 @@ void World::run()
             // Send current timings to all Scenes, for display purpose
             auto& durationMap = Timer::get().getDurationMap();
             for (auto& d : durationMap)
-                sendMessage(_masterSceneName, "duration", {d.first, (int)d.second});
+            {
+                auto duration = d.second.load();
+                auto sentDurationIt = _sentDurations.find(d.first);
+                if (!fullSync && sentDurationIt != _sentDurations.end() && sentDurationIt->second == duration)
+                    continue;
+                _sentDurations[d.first] = duration;
+                sendMessage(_masterSceneName, "duration", {d.first, (int)duration});
+            }
             // Also send the master clock if needed
             Values clock;
             if (Timer::get().getMasterClock(clock))
@@ -144,11 +222,18 @@ void World::run()
 
         if (_quit)
         {
+            for (auto& graph : _frameGraphs)
+                graph->wait();
+            _frameGraphs.clear();
+
             for (auto& s : _scenes)
                 sendMessage(s.first, "quit", {});
+            _link->stopMessageBatch();
             break;
         }
 
+        _link->stopMessageBatch();
+
         // Sync with buffer object update
         Timer::get() >> "innerWorldLoop";
         auto elapsed = Timer::get().getDuration("innerWorldLoop");
@@ -326,7 +411,65 @@ void World::applyConfig()
             }
             else
             {
-                Log::get() << Log::WARNING << "World::" << __FUNCTION__ << " - Non-local scenes are not implemented yet" << Log::endl;
+                // Remote Scenes are started by hand on their host, and connect back to this World through TCP
+                if (!jsScenes[i].isMember("name") || !jsScenes[i].isMember("port"))
+                {
+                    Log::get() << Log::ERROR << "World::" << __FUNCTION__ << " - Remote Scenes need a name and a port" << Log::endl;
+                    return;
+                }
+
+                if (_tcpPort == 0)
+                {
+                    Log::get() << Log::ERROR << "World::" << __FUNCTION__ << " - Remote Scenes need the World to listen to a TCP port, see the --port option" << Log::endl;
+                    return;
+                }
+
+                string name = jsScenes[i]["name"].asString();
+                string address = jsScenes[i]["address"].asString();
+                int port = jsScenes[i]["port"].asInt();
+
+                auto compression = Link::BufferCompression::snappy;
+                if (jsScenes[i].isMember("compression"))
+                {
+                    auto compressionName = jsScenes[i]["compression"].asString();
+                    if (compressionName == "none")
+                        compression = Link::BufferCompression::none;
+                    else if (compressionName == "hap")
+                        compression = Link::BufferCompression::hap;
+                }
+
+                Log::get() << Log::MESSAGE << "World::" << __FUNCTION__ << " - Waiting for remote Scene " << name << " on " << address << ":" << port << Log::endl;
+
+                _sceneLaunched = false;
+                _link->connectTo(name, address, port, compression);
+
+                // The remote Scene tells when it is connected to the World
+                unique_lock<mutex> lockChildProcess(_childProcessMutex);
+                while (!_sceneLaunched)
+                {
+                    if (cv_status::timeout == _childProcessConditionVariable.wait_for(lockChildProcess, chrono::seconds(SPLASH_WORLD_REMOTE_SCENE_TIMEOUT)))
+                    {
+                        Log::get() << Log::ERROR << "World::" << __FUNCTION__ << " - Timeout when waiting for remote scene \"" << name << "\". Exiting." << Log::endl;
+                        _quit = true;
+                        return;
+                    }
+                }
+
+                _scenes[name] = 0; // Remote Scenes have no local process
+                if (_masterSceneName == "")
+                    _masterSceneName = name;
+
+                // Set the remaining parameters
+                auto sceneMembers = jsScenes[i].getMemberNames();
+                int idx{0};
+                for (const auto& param : jsScenes[i])
+                {
+                    string paramName = sceneMembers[idx];
+
+                    auto values = jsonToValues(param);
+                    sendMessage(name, paramName, values);
+                    idx++;
+                }
             }
         }
 
@@ -374,6 +517,7 @@ void World::applyConfig()
             sendMessage(SPLASH_ALL_PEERS, "configurationPath", {_configurationPath});
             sendMessage(SPLASH_ALL_PEERS, "mediaPath", {_configurationPath});
             sendMessage(SPLASH_ALL_PEERS, "runInBackground", {_runInBackground});
+            sendMessage(SPLASH_ALL_PEERS, "hugePages", {BufferPool::get().getHugePagesName()});
         }
 
         // Then we link the objects together
@@ -756,6 +900,54 @@ void World::handleSerializedObject(const string& name, shared_ptr<SerializedObje
     _link->sendBuffer(name, std::move(obj));
 }
 
+/*************/
+void World::applyThreadPlacement()
+{
+    // The inner Scene runs in the World process, and remote Scenes are placed by their own host
+    vector<string> sceneProcesses;
+    for (const auto& s : _scenes)
+        if (s.second > 0)
+            sceneProcesses.push_back(s.first);
+    auto processCount = static_cast<int>(sceneProcesses.size()) + 1;
+
+    vector<ThreadPlacement::Assignment> assignments;
+    if (_threadPlacement == "auto")
+    {
+        auto cpus = ThreadPlacement::readTopology();
+        set<int> cores, l3Domains, nodes;
+        for (const auto& cpu : cpus)
+        {
+            cores.insert(cpu.core);
+            l3Domains.insert(cpu.l3);
+            nodes.insert(cpu.node);
+        }
+        Log::get() << Log::MESSAGE << "World::" << __FUNCTION__ << " - Detected " << cpus.size() << " logical CPUs, " << cores.size() << " physical cores, "
+                   << l3Domains.size() << " L3 domains and " << nodes.size() << " NUMA nodes" << Log::endl;
+
+        assignments = ThreadPlacement::computeAssignments(cpus, processCount);
+        if (assignments.empty())
+            Log::get() << Log::WARNING << "World::" << __FUNCTION__ << " - Not enough cores to place the threads of " << processCount
+                       << " processes, falling back to the default placement" << Log::endl;
+    }
+
+    assignments.resize(processCount);
+    for (auto& assignment : assignments)
+        assignment.realtime = _threadPlacementRealtime;
+
+    ThreadPlacement::get().setAssignment(assignments[0]);
+    Log::get() << Log::MESSAGE << "World::" << __FUNCTION__ << " - World: " << ThreadPlacement::describe(assignments[0]) << Log::endl;
+
+    for (size_t i = 0; i < sceneProcesses.size(); ++i)
+    {
+        const auto& assignment = assignments[i + 1];
+        Values message{(int)assignment.realtime};
+        for (const auto& cores : assignment.cores)
+            message.push_back(Value(cores.begin(), cores.end()));
+        sendMessage(sceneProcesses[i], "threadPlacement", message);
+        Log::get() << Log::MESSAGE << "World::" << __FUNCTION__ << " - Scene " << sceneProcesses[i] << ": " << ThreadPlacement::describe(assignment) << Log::endl;
+    }
+}
+
 /*************/
 void World::init()
 {
@@ -1153,10 +1345,28 @@ void World::parseArguments(int argc, char** argv)
             cout << "\t-s (--silent) : disable all messages" << endl;
             cout << "\t-i (--info) : get description for all objects attributes" << endl;
             cout << "\t-H (--hide) : run Splash in background" << endl;
+            cout << "\t-p (--port) [port] : listen to remote Scenes on TCP ports [port] and [port + 1]" << endl;
             cout << "\t-l (--log2file) : write the logs to /var/log/splash.log, if possible" << endl;
             cout << endl;
             exit(0);
         }
+        else if ((string(argv[idx]) == "-p" || string(argv[idx]) == "--port") && idx + 1 < argc)
+        {
+            try
+            {
+                _tcpPort = stoi(string(argv[idx + 1]));
+            }
+            catch (...)
+            {
+                Log::get() << Log::WARNING << "World::" << __FUNCTION__ << " - " << string(argv[idx]) << ": argument expects a positive integer" << Log::endl;
+                exit(0);
+            }
+
+            // The link has to be created again to listen to the given port
+            _link.reset();
+            _link = make_shared<Link>(weak_ptr<World>(_self), _name, _tcpPort);
+            idx += 2;
+        }
         else if (string(argv[idx]) == "-H" || string(argv[idx]) == "--hide")
         {
             _runInBackground = true;
@@ -1338,6 +1548,27 @@ void World::registerAttributes()
         [&]() -> Values { return {(int)_enforceRealtime}; },
         {'n'});
     setAttributeDescription("forceRealtime", "Ask the scheduler to run Splash with realtime priority.");
+
+    addAttribute("threadPlacement",
+        [&](const Values& args) {
+            auto mode = args[0].as<string>();
+            if (mode != "manual" && mode != "auto")
+            {
+                Log::get() << Log::WARNING << "World::" << __FUNCTION__ << " - Unknown thread placement mode: " << mode << Log::endl;
+                return false;
+            }
+
+            _threadPlacement = mode;
+            _threadPlacementRealtime = args.size() > 1 ? args[1].as<int>() : false;
+            addTask([=]() { applyThreadPlacement(); });
+
+            return true;
+        },
+        [&]() -> Values { return {_threadPlacement, (int)_threadPlacementRealtime}; },
+        {'s'});
+    setAttributeDescription("threadPlacement",
+        "Set the thread placement mode, either manual or auto. In auto mode, render, upload, decode and background threads are placed on separate cores depending on the CPU "
+        "topology. A second parameter set to 1 asks for SCHED_FIFO for the render and upload threads.");
 #endif
 
     addAttribute("framerate",
@@ -1427,7 +1658,7 @@ void World::registerAttributes()
                     {
                         sendMessage(s.first, "quit", {});
                         _link->disconnectFrom(s.first);
-                        if (s.second != -1)
+                        if (s.second > 0)
                         {
                             waitpid(s.second, nullptr, 0);
                         }
@@ -1630,6 +1861,19 @@ void World::registerAttributes()
         {'s', 's'});
     setAttributeDescription("sendAll", "Send to the given object in all Scenes the given message (all following arguments)");
 
+    addAttribute("regionOfInterest",
+        [&](const Values& args) {
+            addTask([=]() {
+                auto objectIt = _objects.find(args[1].as<string>());
+                if (objectIt == _objects.end())
+                    return;
+                objectIt->second->setAttribute("regionOfInterest", {args[0], args[2], args[3], args[4], args[5]});
+            });
+            return true;
+        },
+        {'s', 's', 'n', 'n', 'n', 'n'});
+    setAttributeDescription("regionOfInterest", "Set the region of the given image sampled by the given Scene, as normalized coordinates x0, y0, x1, y1");
+
     addAttribute("sendAllScenes",
         [&](const Values& args) {
             string attr = args[0].as<string>();
@@ -1657,6 +1901,59 @@ void World::registerAttributes()
         {'s'});
     setAttributeDescription("sendToMasterScene", "Send the given message to the master Scene");
 
+    addAttribute("sharedMemoryTransport",
+        [&](const Values& args) {
+            _sharedMemoryTransport = args[0].as<int>();
+            _link->setSharedMemoryTransport(_sharedMemoryTransport);
+            return true;
+        },
+        [&]() -> Values { return {(int)_sharedMemoryTransport}; },
+        {'n'});
+    setAttributeDescription("sharedMemoryTransport", "If set to 1, buffers are written once in shared memory and mapped by the Scenes instead of being copied through sockets");
+
+    addAttribute("hugePages",
+        [&](const Values& args) {
+            auto policy = args[0].as<string>();
+            if (!BufferPool::get().setHugePages(policy))
+                return false;
+            addTask([=]() { sendMessage(SPLASH_ALL_PEERS, "hugePages", {policy}); });
+            return true;
+        },
+        [&]() -> Values { return {BufferPool::get().getHugePagesName()}; },
+        {'s'});
+    setAttributeDescription("hugePages",
+        "Huge pages policy for buffers bigger than 2MB, in the World and the Scenes: none, transparent (default) or reserved (requires pages reserved through vm.nr_hugepages)");
+
+    addAttribute("decodeScheduler",
+        [&](const Values& args) {
+            DecodeScheduler::get().setWorkerCount(max(1, args[0].as<int>()));
+            DecodeScheduler::get().setCodecThreadBudget(max(1, args[1].as<int>()));
+            return true;
+        },
+        [&]() -> Values { return {(int)DecodeScheduler::get().getWorkerCount(), DecodeScheduler::get().getCodecThreadBudget()}; },
+        {'n', 'n'});
+    setAttributeDescription("decodeScheduler", "Number of threads decoding the videos, and maximum number of threads shared by all video codecs for frame threading");
+
+    addAttribute("loopCacheSize",
+        [&](const Values& args) {
+            LoopCache::get().setBudget(static_cast<uint64_t>(max(0, args[0].as<int>())) * 1048576);
+            return true;
+        },
+        [&]() -> Values { return {(int64_t)(LoopCache::get().getBudget() / 1048576)}; },
+        {'n'});
+    setAttributeDescription("loopCacheSize", "Memory budget for the videos fully cached in memory through their loopCache attribute (in MB)");
+
+    addAttribute("bufferStats",
+        [&](const Values& args) { return false; },
+        [&]() -> Values {
+            Values stats;
+            for (auto& peer : _link->getBufferStats())
+                stats.push_back(Values({peer.first, (int64_t)peer.second.sent, (int64_t)peer.second.superseded, (int64_t)peer.second.dropped}));
+            return stats;
+        });
+    setAttributeParameter("bufferStats", false, false);
+    setAttributeDescription("bufferStats", "Number of buffers sent, superseded by a newer one before being sent, and dropped, for each Scene");
+
     addAttribute("pingTest",
         [&](const Values& args) {
             auto doPing = args[0].as<int>();
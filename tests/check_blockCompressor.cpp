@@ -0,0 +1,187 @@
+#include <cmath>
+#include <cstring>
+#include <doctest.h>
+#include <vector>
+
+#include "./blockCompressor.h"
+
+using namespace std;
+using namespace Splash;
+
+/*************/
+// Reference decoders, following the BC1, BC3 and BC7 (mode 6 only) specifications
+void decodeColorBlock(const uint8_t* input, uint8_t* block)
+{
+    uint16_t color0 = input[0] | (input[1] << 8);
+    uint16_t color1 = input[2] | (input[3] << 8);
+    int palette[4][3];
+    for (int i = 0; i < 2; ++i)
+    {
+        auto value = i == 0 ? color0 : color1;
+        int r = (value >> 11) & 31, g = (value >> 5) & 63, b = value & 31;
+        palette[i][0] = (r << 3) | (r >> 2);
+        palette[i][1] = (g << 2) | (g >> 4);
+        palette[i][2] = (b << 3) | (b >> 2);
+    }
+    for (int c = 0; c < 3; ++c)
+    {
+        palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+        palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+    }
+
+    uint32_t indices = input[4] | (input[5] << 8) | (input[6] << 16) | (static_cast<uint32_t>(input[7]) << 24);
+    for (int p = 0; p < 16; ++p)
+        for (int c = 0; c < 3; ++c)
+            block[p * 4 + c] = palette[(indices >> (2 * p)) & 3][c];
+}
+
+/*************/
+void decodeAlphaBlock(const uint8_t* input, uint8_t* block)
+{
+    int alpha[8] = {input[0], input[1]};
+    for (int i = 1; i < 7; ++i)
+        alpha[i + 1] = ((7 - i) * alpha[0] + i * alpha[1]) / 7;
+
+    uint64_t indices = 0;
+    for (int i = 0; i < 6; ++i)
+        indices |= static_cast<uint64_t>(input[2 + i]) << (8 * i);
+    for (int p = 0; p < 16; ++p)
+        block[p * 4 + 3] = alpha[(indices >> (3 * p)) & 7];
+}
+
+/*************/
+void decodeBC7Mode6Block(const uint8_t* input, uint8_t* block)
+{
+    static const int weights[16] = {0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+    int position = 0;
+    auto read = [&](int bits) {
+        uint32_t value = 0;
+        for (int b = 0; b < bits; ++b, ++position)
+            value |= ((input[position / 8] >> (position % 8)) & 1) << b;
+        return value;
+    };
+
+    REQUIRE(read(7) == 1 << 6);
+    int endpoints[2][4];
+    for (int c = 0; c < 4; ++c)
+    {
+        endpoints[0][c] = read(7);
+        endpoints[1][c] = read(7);
+    }
+    int p0 = read(1), p1 = read(1);
+    for (int c = 0; c < 4; ++c)
+    {
+        endpoints[0][c] = endpoints[0][c] * 2 + p0;
+        endpoints[1][c] = endpoints[1][c] * 2 + p1;
+    }
+
+    for (int p = 0; p < 16; ++p)
+    {
+        auto index = read(p == 0 ? 3 : 4);
+        for (int c = 0; c < 4; ++c)
+            block[p * 4 + c] = ((64 - weights[index]) * endpoints[0][c] + weights[index] * endpoints[1][c] + 32) >> 6;
+    }
+}
+
+/*************/
+vector<uint8_t> createGradient(int width, int height)
+{
+    auto image = vector<uint8_t>(width * height * 4);
+    for (int y = 0; y < height; ++y)
+        for (int x = 0; x < width; ++x)
+        {
+            auto pixel = &image[(y * width + x) * 4];
+            pixel[0] = x * 255 / (width - 1);
+            pixel[1] = y * 255 / (height - 1);
+            pixel[2] = (x + y) * 127 / (width + height - 2);
+            pixel[3] = 255 - y * 255 / (height - 1);
+        }
+    return image;
+}
+
+/*************/
+// Mean absolute error of the compressed blocks, per channel
+float getBlockError(const vector<uint8_t>& image, int width, int height, const uint8_t* compressed, BlockCompressor::Codec codec, int channels)
+{
+    int blockSize = codec == BlockCompressor::Codec::BC1 ? 8 : 16;
+    uint64_t error = 0;
+    for (int by = 0; by < height / 4; ++by)
+        for (int bx = 0; bx < width / 4; ++bx)
+        {
+            uint8_t block[64];
+            auto input = compressed + (by * (width / 4) + bx) * blockSize;
+            if (codec == BlockCompressor::Codec::BC1)
+                decodeColorBlock(input, block);
+            else if (codec == BlockCompressor::Codec::BC3)
+            {
+                decodeAlphaBlock(input, block);
+                decodeColorBlock(input + 8, block);
+            }
+            else
+                decodeBC7Mode6Block(input, block);
+
+            for (int p = 0; p < 16; ++p)
+                for (int c = 0; c < channels; ++c)
+                    error += abs(block[p * 4 + c] - image[((by * 4 + p / 4) * width + bx * 4 + p % 4) * 4 + c]);
+        }
+    return static_cast<float>(error) / static_cast<float>(width * height * channels);
+}
+
+/*************/
+TEST_CASE("Testing block compression")
+{
+    const int width = 64, height = 32;
+    auto pixels = createGradient(width, height);
+    auto spec = ImageBufferSpec(width, height, 4, 32, ImageBufferSpec::Type::UINT8, "RGBA");
+    auto image = ImageBuffer(spec);
+    memcpy(image.data(), pixels.data(), pixels.size());
+
+    auto bc1 = BlockCompressor::compress(image, BlockCompressor::Codec::BC1);
+    REQUIRE(bc1 != nullptr);
+    CHECK(bc1->getSpec().format == "RGB_DXT1");
+    CHECK(bc1->getSize() == static_cast<size_t>(width * height / 2));
+    CHECK(getBlockError(pixels, width, height, reinterpret_cast<uint8_t*>(bc1->data()), BlockCompressor::Codec::BC1, 3) < 4.f);
+
+    auto bc3 = BlockCompressor::compress(image, BlockCompressor::Codec::BC3);
+    REQUIRE(bc3 != nullptr);
+    CHECK(bc3->getSpec().format == "RGBA_DXT5");
+    CHECK(bc3->getSize() == static_cast<size_t>(width * height));
+    CHECK(getBlockError(pixels, width, height, reinterpret_cast<uint8_t*>(bc3->data()), BlockCompressor::Codec::BC3, 4) < 4.f);
+
+    auto bc7 = BlockCompressor::compress(image, BlockCompressor::Codec::BC7);
+    REQUIRE(bc7 != nullptr);
+    CHECK(bc7->getSpec().format == "RGBA_BC7");
+    CHECK(bc7->getSpec().isCompressed());
+    CHECK(bc7->getSize() == static_cast<size_t>(width * height));
+    CHECK(getBlockError(pixels, width, height, reinterpret_cast<uint8_t*>(bc7->data()), BlockCompressor::Codec::BC7, 4) < 2.f);
+
+    // Only images made of whole blocks are compressed
+    auto oddImage = ImageBuffer(ImageBufferSpec(width + 2, height, 4, 32, ImageBufferSpec::Type::UINT8, "RGBA"));
+    CHECK(BlockCompressor::compress(oddImage, BlockCompressor::Codec::BC7) == nullptr);
+}
+
+/*************/
+TEST_CASE("Testing block compression of uniform blocks")
+{
+    uint8_t block[64];
+    for (int p = 0; p < 16; ++p)
+    {
+        block[p * 4 + 0] = 200;
+        block[p * 4 + 1] = 100;
+        block[p * 4 + 2] = 50;
+        block[p * 4 + 3] = 128;
+    }
+
+    uint8_t compressed[16];
+    uint8_t decoded[64];
+    BlockCompressor::compressBlock(block, compressed, BlockCompressor::Codec::BC7);
+    decodeBC7Mode6Block(compressed, decoded);
+    for (int i = 0; i < 64; ++i)
+        CHECK(abs(decoded[i] - block[i]) <= 1);
+
+    BlockCompressor::compressBlock(block, compressed, BlockCompressor::Codec::BC3);
+    decodeAlphaBlock(compressed, decoded);
+    decodeColorBlock(compressed + 8, decoded);
+    for (int i = 0; i < 64; ++i)
+        CHECK(abs(decoded[i] - block[i]) <= 4);
+}
@@ -0,0 +1,84 @@
+#include <doctest.h>
+#include <vector>
+
+#include "./cgUtils.h"
+#include "./splash.h"
+
+using namespace std;
+using namespace Splash;
+
+/*************/
+// Serial chunk decompression, as a reference for the thread pool callback
+void serialHapDecodeCallback(HapDecodeWorkFunction func, void* p, unsigned int count, void* info)
+{
+    for (unsigned int i = 0; i < count; ++i)
+        func(p, i);
+}
+
+/*************/
+// Fake YCoCg DXT5 texture, compressible enough to look like a real frame
+vector<uint8_t> createTexture(int width, int height)
+{
+    auto texture = vector<uint8_t>(width * height);
+    for (size_t i = 0; i < texture.size(); ++i)
+        texture[i] = static_cast<uint8_t>((i / 64) ^ (i >> 13));
+    return texture;
+}
+
+/*************/
+vector<uint8_t> encodeHapFrame(const vector<uint8_t>& texture, unsigned int chunkCount)
+{
+    auto frame = vector<uint8_t>(HapMaxEncodedLength(texture.size(), HapTextureFormat_YCoCg_DXT5, chunkCount));
+    unsigned long bytesUsed = 0;
+    if (HapEncode(texture.data(), texture.size(), HapTextureFormat_YCoCg_DXT5, HapCompressorSnappy, chunkCount, frame.data(), frame.size(), &bytesUsed) != HapResult_No_Error)
+        return {};
+    frame.resize(bytesUsed);
+    return frame;
+}
+
+/*************/
+TEST_CASE("Testing Hap chunk decompression")
+{
+    auto texture = createTexture(1920, 1080);
+    for (unsigned int chunkCount : {1, 7, 64})
+    {
+        auto frame = encodeHapFrame(texture, chunkCount);
+        REQUIRE(!frame.empty());
+
+        string format;
+        CHECK(hapDecodeFrame(frame.data(), frame.size(), nullptr, 0, format));
+        CHECK(format == "YCoCg_DXT5");
+
+        auto decoded = vector<uint8_t>(texture.size());
+        CHECK(hapDecodeFrame(frame.data(), frame.size(), decoded.data(), decoded.size(), format));
+        CHECK(decoded == texture);
+    }
+}
+
+/*************/
+TEST_CASE("Testing Hap decompression through the thread pool against serial decompression")
+{
+    // 1080p, 4K and 8K Hap Q frames
+    for (auto size : {make_pair(1920, 1080), make_pair(3840, 2160), make_pair(7680, 4320)})
+    {
+        auto texture = createTexture(size.first, size.second);
+
+        for (unsigned int chunkCount : {1, 16, 64})
+        {
+            auto frame = encodeHapFrame(texture, chunkCount);
+            REQUIRE(!frame.empty());
+
+            auto serialDecoded = vector<uint8_t>(texture.size());
+            unsigned long bytesUsed = 0;
+            unsigned int textureFormat = 0;
+            REQUIRE(HapDecode(frame.data(), frame.size(), serialHapDecodeCallback, nullptr, serialDecoded.data(), serialDecoded.size(), &bytesUsed, &textureFormat) ==
+                    HapResult_No_Error);
+
+            string format;
+            auto parallelDecoded = vector<uint8_t>(texture.size());
+            CHECK(hapDecodeFrame(frame.data(), frame.size(), parallelDecoded.data(), parallelDecoded.size(), format));
+            CHECK(parallelDecoded == serialDecoded);
+            CHECK(parallelDecoded == texture);
+        }
+    }
+}
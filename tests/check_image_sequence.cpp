@@ -0,0 +1,167 @@
+#include <cstdio>
+#include <cstdlib>
+#include <doctest.h>
+#include <fstream>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+#include "./image_sequence.h"
+
+using namespace std;
+using namespace Splash;
+
+/*************/
+// Temporary directory, removed with its files
+struct TemporaryDirectory
+{
+    string path;
+    vector<string> files;
+
+    TemporaryDirectory()
+    {
+        char pattern[] = "/tmp/splash_check_image_sequence_XXXXXX";
+        if (mkdtemp(pattern))
+            path = string(pattern) + "/";
+    }
+
+    ~TemporaryDirectory()
+    {
+        for (const auto& file : files)
+            remove((path + file).c_str());
+        if (!path.empty())
+            rmdir(path.c_str());
+    }
+
+    string add(const string& name, const vector<uint8_t>& content = {})
+    {
+        ofstream file(path + name, ios::out | ios::binary);
+        file.write(reinterpret_cast<const char*>(content.data()), content.size());
+        files.push_back(name);
+        return path + name;
+    }
+};
+
+/*************/
+// Big endian 10 bits RGB DPX file, packed with method A
+vector<uint8_t> createDPX(uint32_t width, uint32_t height, const vector<uint32_t>& pixels)
+{
+    const uint32_t dataOffset = 2048;
+    auto dpx = vector<uint8_t>(dataOffset + pixels.size() * 4, 0);
+    auto write16 = [&](size_t offset, uint32_t value) {
+        dpx[offset] = value >> 8;
+        dpx[offset + 1] = value;
+    };
+    auto write32 = [&](size_t offset, uint32_t value) {
+        dpx[offset] = value >> 24;
+        dpx[offset + 1] = value >> 16;
+        dpx[offset + 2] = value >> 8;
+        dpx[offset + 3] = value;
+    };
+
+    dpx[0] = 'S';
+    dpx[1] = 'D';
+    dpx[2] = 'P';
+    dpx[3] = 'X';
+    write32(4, dataOffset);
+    write32(772, width);
+    write32(776, height);
+    dpx[800] = 50; // RGB
+    dpx[803] = 10;
+    write16(804, 1);
+    write16(806, 0);
+    write32(808, dataOffset);
+
+    for (size_t i = 0; i < pixels.size(); ++i)
+        write32(dataOffset + i * 4, pixels[i]);
+
+    return dpx;
+}
+
+/*************/
+uint32_t packDPX10(uint32_t r, uint32_t g, uint32_t b)
+{
+    return (r << 22) | (g << 12) | (b << 2);
+}
+
+/*************/
+TEST_CASE("Testing Image_Sequence frame lookup")
+{
+    TemporaryDirectory directory;
+    REQUIRE(!directory.path.empty());
+
+    // Frame numbers with gaps, and files which do not belong to the sequence
+    for (auto name : {"shot_0010.png", "shot_0002.png", "shot_0001.png", "shot_0003.png", "shot_0100.png", "other_0004.png", "shot_0005.txt", "shot_abcd.png"})
+        directory.add(name);
+
+    auto expected = vector<string>({directory.path + "shot_0001.png",
+        directory.path + "shot_0002.png",
+        directory.path + "shot_0003.png",
+        directory.path + "shot_0010.png",
+        directory.path + "shot_0100.png"});
+
+    // Frames are sorted by number, missing numbers being skipped
+    CHECK(Image_Sequence::findFrames(directory.path + "shot_0001.png") == expected);
+    CHECK(Image_Sequence::findFrames(directory.path + "shot_%04d.png") == expected);
+
+    // A directory holds a single sequence, sorted by name
+    auto all = Image_Sequence::findFrames(directory.path);
+    CHECK(all.size() == 7);
+    CHECK(all.front() == directory.path + "other_0004.png");
+
+    CHECK(Image_Sequence::findFrames(directory.path + "missing_%04d.png").empty());
+    CHECK(Image_Sequence::findFrames(directory.path + "shot_%04x.png").empty());
+}
+
+/*************/
+TEST_CASE("Testing Image_Sequence DPX decoding")
+{
+    TemporaryDirectory directory;
+    REQUIRE(!directory.path.empty());
+
+    const uint32_t width = 3;
+    const uint32_t height = 2;
+    auto pixels = vector<uint32_t>({packDPX10(1023, 0, 0), packDPX10(0, 1023, 0), packDPX10(0, 0, 1023), packDPX10(512, 256, 128), packDPX10(0, 0, 0), packDPX10(1023, 1023, 1023)});
+
+    // Valid 10 bits file
+    {
+        auto image = Image_Sequence::decodeFrame(directory.add("valid.dpx", createDPX(width, height, pixels)));
+        REQUIRE(image != nullptr);
+
+        auto spec = image->getSpec();
+        CHECK(spec.width == width);
+        CHECK(spec.height == height);
+        CHECK(spec.format == "RGBA");
+
+        auto data = reinterpret_cast<const uint8_t*>(image->data());
+        for (size_t i = 0; i < pixels.size(); ++i)
+        {
+            CHECK(data[i * 4] == ((pixels[i] >> 22) & 0x3FF) >> 2);
+            CHECK(data[i * 4 + 1] == ((pixels[i] >> 12) & 0x3FF) >> 2);
+            CHECK(data[i * 4 + 2] == ((pixels[i] >> 2) & 0x3FF) >> 2);
+            CHECK(data[i * 4 + 3] == 255);
+        }
+    }
+
+    // Truncated file
+    {
+        auto dpx = createDPX(width, height, pixels);
+        dpx.resize(dpx.size() - 4);
+        CHECK(Image_Sequence::decodeFrame(directory.add("truncated.dpx", dpx)) == nullptr);
+    }
+
+    // Overflowing dimensions
+    {
+        // 0x40000000 * 4 bytes per pixel wraps around to 0 when computed on 32 bits
+        CHECK(Image_Sequence::decodeFrame(directory.add("overflow.dpx", createDPX(0x40000000, 1, pixels))) == nullptr);
+        CHECK(Image_Sequence::decodeFrame(directory.add("huge.dpx", createDPX(0xFFFFFFFF, 0xFFFFFFFF, pixels))) == nullptr);
+        CHECK(Image_Sequence::decodeFrame(directory.add("empty.dpx", createDPX(0, height, pixels))) == nullptr);
+    }
+
+    // Data offset past the end of the file
+    {
+        auto dpx = createDPX(width, height, pixels);
+        dpx[808] = dpx[4] = 0x7F;
+        CHECK(Image_Sequence::decodeFrame(directory.add("offset.dpx", dpx)) == nullptr);
+    }
+}
@@ -1,4 +1,7 @@
+#include <cstdio>
 #include <doctest.h>
+#include <fstream>
+#include <unistd.h>
 
 #include "./splash.h"
 
@@ -68,3 +71,149 @@ TEST_CASE("Testing ResizableArray copy")
         for (int shift = 100; shift < 500; shift += 100)
             CHECK(checkCopy(size, shift) == size - shift);
 }
+
+/*************/
+TEST_CASE("Testing ResizableArray pooled allocations")
+{
+    auto size = 1 << 20;
+    CHECK(BufferPool::isPooled(size));
+    CHECK(BufferPool::getBucketSize(size) == size);
+    CHECK(BufferPool::getBucketSize(size + 1) == size + size / 8);
+
+    char* firstPtr = nullptr;
+    {
+        auto array = ResizableArray<uint8_t>(size);
+        firstPtr = reinterpret_cast<char*>(array.data());
+    }
+
+    // The block released above must be handed over again
+    auto hits = BufferPool::get().getStats().hits;
+    auto array = ResizableArray<uint8_t>(size);
+    CHECK(reinterpret_cast<char*>(array.data()) == firstPtr);
+    CHECK(BufferPool::get().getStats().hits == hits + 1);
+}
+
+/*************/
+TEST_CASE("Testing ResizableArray alignment")
+{
+    for (int size = 10; size < 1e8; size *= 10)
+    {
+        auto array = ResizableArray<uint8_t>(size);
+        CHECK(reinterpret_cast<uintptr_t>(array.data()) % BufferPool::getAlignment() == 0);
+    }
+}
+
+/*************/
+// Properties of the memory mapping holding an address, read from /proc/self/smaps
+struct Mapping
+{
+    bool found{false};
+    bool hugePageAdvised{false}; //!< madvise(MADV_HUGEPAGE) was called on the mapping
+    int kernelPageSize{0};       //!< Page size in kB
+};
+
+Mapping getMapping(const void* ptr)
+{
+    Mapping mapping;
+#if HAVE_LINUX
+    auto address = reinterpret_cast<uintptr_t>(ptr);
+    ifstream smaps("/proc/self/smaps");
+    string line;
+    bool inMapping = false;
+    while (getline(smaps, line))
+    {
+        uintptr_t start, end;
+        if (sscanf(line.c_str(), "%lx-%lx ", &start, &end) == 2 && line.find(':') > line.find(' '))
+        {
+            if (inMapping)
+                break;
+            inMapping = address >= start && address < end;
+            mapping.found = mapping.found || inMapping;
+            continue;
+        }
+
+        if (!inMapping)
+            continue;
+        if (line.compare(0, 15, "KernelPageSize:") == 0)
+            mapping.kernelPageSize = stoi(line.substr(15));
+        else if (line.compare(0, 8, "VmFlags:") == 0)
+            mapping.hugePageAdvised = line.find(" hg") != string::npos;
+    }
+#endif
+    return mapping;
+}
+
+/*************/
+// Free huge pages from the reserved pool, in kB
+uint64_t getFreeHugePages()
+{
+    ifstream meminfo("/proc/meminfo");
+    string line;
+    uint64_t freePages = 0, pageSize = 0;
+    while (getline(meminfo, line))
+    {
+        if (line.compare(0, 15, "HugePages_Free:") == 0)
+            freePages = stoull(line.substr(15));
+        else if (line.compare(0, 13, "Hugepagesize:") == 0)
+            pageSize = stoull(line.substr(13));
+    }
+    return freePages * pageSize;
+}
+
+/*************/
+bool areTransparentHugePagesEnabled()
+{
+    ifstream file("/sys/kernel/mm/transparent_hugepage/enabled");
+    string mode;
+    getline(file, mode);
+    return !mode.empty() && mode.find("[never]") == string::npos;
+}
+
+/*************/
+TEST_CASE("Testing ResizableArray allocation and copy of frame buffers")
+{
+    const int frames = 4;
+    auto policy = BufferPool::get().getHugePages();
+    auto transparentHugePages = areTransparentHugePagesEnabled();
+
+    // 1080p, 4K and 8K RGBA frames, allocated and filled once per frame as by a video source
+    for (size_t size : {1920 * 1080 * 4, 3840 * 2160 * 4, 7680 * 4320 * 4})
+    {
+        auto source = vector<uint8_t>(size);
+        for (size_t i = 0; i < size; ++i)
+            source[i] = static_cast<uint8_t>(i * 7);
+
+        for (auto hugePages : {BufferPool::HugePages::none, BufferPool::HugePages::transparent, BufferPool::HugePages::reserved})
+        {
+            BufferPool::get().clear();
+            BufferPool::get().setHugePages(hugePages);
+            auto reservedAvailable = getFreeHugePages() * 1024 >= size;
+
+            for (int i = 0; i < frames; ++i)
+            {
+                auto array = ResizableArray<uint8_t>(size);
+                memcpy(array.data(), source.data(), size);
+                CHECK(memcmp(array.data(), source.data(), size) == 0);
+
+                // Frames are big enough to be mapped directly, which aligns them on pages
+                CHECK(reinterpret_cast<uintptr_t>(array.data()) % BufferPool::getAlignment() == 0);
+                CHECK(reinterpret_cast<uintptr_t>(array.data()) % sysconf(_SC_PAGESIZE) == 0);
+
+#if HAVE_LINUX
+                // Huge pages are only checked when the system provides them
+                auto mapping = getMapping(array.data());
+                REQUIRE(mapping.found);
+                if (hugePages == BufferPool::HugePages::none)
+                    CHECK(!mapping.hugePageAdvised);
+                else if (hugePages == BufferPool::HugePages::reserved && reservedAvailable)
+                    CHECK(mapping.kernelPageSize == 2048);
+                else if (transparentHugePages)
+                    CHECK(mapping.hugePageAdvised);
+#endif
+            }
+        }
+    }
+
+    BufferPool::get().clear();
+    BufferPool::get().setHugePages(policy);
+}